@@ -47,7 +47,9 @@
 
 #include "../tinyexpr.h"
 #include <array>
+#include <atomic>
 #include <regex>
+#include <thread>
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_floating_point.hpp>
 #include <catch2/benchmark/catch_benchmark_all.hpp>
@@ -2201,9 +2203,59 @@ TEST_CASE("Lambdas", "[lambdas]")
 TEST_CASE("Random", "[random]")
     {
     te_parser tep;
-    // can't have reproducible results for rand, so just run it and make
-    // sure it doesn't crash
     CHECK_NOTHROW(tep.evaluate("rand()"));
+
+    SECTION("Range")
+        {
+        CHECK(tep.compile("rand()"));
+        for (size_t i = 0; i < 1'000; ++i)
+            {
+            const auto value = tep.evaluate();
+            CHECK(value >= 0);
+            CHECK(value < 1);
+            }
+        }
+    SECTION("Not folded")
+        {
+        // each call is a new number, even in the same expression
+        CHECK(tep.compile("rand()"));
+        CHECK(tep.evaluate() != tep.evaluate());
+        CHECK(tep.evaluate("rand() - rand()") != 0);
+        tep.set_optimization_level(te_parser::optimization_level::aggressive);
+        CHECK(tep.evaluate("rand() - rand()") != 0);
+        }
+    SECTION("Seeded")
+        {
+        te_parser::set_random_seed(42);
+        CHECK(tep.compile("rand()"));
+        const auto first = tep.evaluate();
+        const auto second = tep.evaluate();
+        te_parser::set_random_seed(42);
+        CHECK(tep.evaluate() == first);
+        CHECK(tep.evaluate() == second);
+        te_parser::set_random_seed(43);
+        CHECK(tep.evaluate() != first);
+
+        // the same numbers are filled in
+        te_parser::set_random_seed(42);
+        std::vector<te_type> values(3);
+        te_parser::fill_random(values);
+        CHECK(values[0] == first);
+        CHECK(values[1] == second);
+
+        // another thread has its own generator
+        te_parser::set_random_seed(42);
+        te_type otherThreadValue{ 0 };
+        std::thread([&otherThreadValue]()
+                    {
+                        te_parser::set_random_seed(7);
+                        otherThreadValue = te_parser().evaluate("rand()");
+                    })
+            .join();
+        CHECK(tep.evaluate() == first);
+        te_parser::set_random_seed(7);
+        CHECK(tep.evaluate() == otherThreadValue);
+        }
     }
 
 TEST_CASE("Available functions", "[available]")
@@ -2867,6 +2919,253 @@ TEST_CASE("Unknown symbol resolve throws", "[usr]")
     CHECK(tep.get_last_error_message() == "Unknown stress level!");
     }
 
+TEST_CASE("Unknown symbol resolve batch", "[usr]")
+    {
+    std::vector<std::vector<std::string>> batches;
+    const auto lookUpTags = [&batches](const std::vector<std::string_view>& tags)
+        {
+        batches.emplace_back(tags.cbegin(), tags.cend());
+        std::vector<te_type> values;
+        for (const auto& tag : tags)
+            {
+            values.push_back(tag.starts_with("TAG") ?
+                static_cast<te_type>(std::stoi(std::string{ tag.substr(3) })) :
+                te_parser::te_nan);
+            }
+        return values;
+        };
+    te_parser tep;
+    te_type x{ 10 };
+    tep.set_variables_and_functions({ { "x", &x } });
+
+    SECTION("One call per compile")
+        {
+        tep.set_unknown_symbol_resolver(lookUpTags);
+        // known symbols, numbers (including exponents), comments,
+        // and repeated symbols (in any case) aren't sent
+        CHECK(tep.compile("TAG1 + sqrt(TAG2) * x + 1e2 + tag1 /* TAG9 */ + TAG3 // TAG8"));
+        CHECK(tep.evaluate() == 1 + std::sqrt(2) * 10 + 100 + 1 + 3);
+        REQUIRE(batches.size() == 1);
+        CHECK(batches.front() == std::vector<std::string>{ "TAG1", "TAG2", "TAG3" });
+        // the resolved tags were kept
+        CHECK(tep.evaluate("TAG1 + TAG4") == 5);
+        CHECK(batches.size() == 2);
+        CHECK(batches.back() == std::vector<std::string>{ "TAG4" });
+        }
+    SECTION("Unresolved")
+        {
+        tep.set_unknown_symbol_resolver(lookUpTags, false);
+        CHECK(std::isnan(tep.evaluate("TAG1 + price")));
+        CHECK(tep.get_last_error_position() == 11);
+        // the failed symbol isn't asked about again while parsing
+        CHECK(batches.size() == 1);
+        // nothing was kept, so it's all resolved again
+        CHECK(tep.evaluate("TAG1 + TAG1") == 2);
+        CHECK(batches.size() == 2);
+        }
+    SECTION("Wrong number of values")
+        {
+        tep.set_unknown_symbol_resolver(
+            [](const std::vector<std::string_view>&) { return std::vector<te_type>{}; });
+        CHECK_FALSE(tep.compile("TAG1 + TAG2"));
+        CHECK(tep.get_last_error_message() ==
+              "The unknown-symbol resolver did not return a value for each symbol.");
+        }
+    SECTION("Compile many")
+        {
+        tep.set_unknown_symbol_resolver(lookUpTags);
+        std::vector<std::string> formulas;
+        for (size_t i = 0; i < 500; ++i)
+            {
+            formulas.push_back("x * TAG" + std::to_string(i % 40) + " + TAG100");
+            }
+        const std::vector<std::string_view> expressions(formulas.cbegin(), formulas.cend());
+        const auto results = tep.compile_many(expressions, 4);
+        CHECK(std::all_of(results.cbegin(), results.cend(),
+                          [](const auto& result) { return result.m_success; }));
+        // all of the formulas' tags were resolved together
+        REQUIRE(batches.size() == 1);
+        CHECK(batches.front().size() == 41);
+        CHECK(tep.evaluate("TAG39 + TAG100") == 139);
+        CHECK(batches.size() == 1);
+        }
+    }
+
+#ifdef __cpp_lib_coroutine
+// An in-process stand-in for a key-value daemon: lookups are queued
+// and answered (resuming whoever is waiting on them) when it is polled.
+class test_tag_daemon
+    {
+  public:
+    struct lookup
+        {
+        test_tag_daemon* m_daemon{ nullptr };
+        std::vector<std::string> m_tags;
+        std::vector<te_type> m_values;
+        std::coroutine_handle<> m_waiting;
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> waiting)
+            {
+            m_waiting = waiting;
+            m_daemon->m_pending.push_back(this);
+            }
+        std::vector<te_type> await_resume()
+            {
+            if (m_daemon->m_disconnected)
+                { throw std::runtime_error("Lost connection to the tag daemon."); }
+            return m_values;
+            }
+        };
+
+    // the resolver passed to compile_async()
+    auto resolver()
+        {
+        return [this](const std::vector<std::string_view>& tags)
+            {
+            ++m_requests;
+            return lookup{ this, std::vector<std::string>(tags.cbegin(), tags.cend()), {}, {} };
+            };
+        }
+
+    // answers the queued lookups
+    void poll()
+        {
+        auto pending = std::move(m_pending);
+        m_pending.clear();
+        for (auto* request : pending)
+            {
+            for (const auto& tag : request->m_tags)
+                {
+                const auto found = m_tags.find(tag);
+                request->m_values.push_back(found != m_tags.cend() ?
+                    found->second : te_parser::te_nan);
+                }
+            request->m_waiting.resume();
+            }
+        }
+
+    std::map<std::string, te_type, te_string_less> m_tags{ { "TAG1", 1 }, { "TAG2", 2 } };
+    std::vector<lookup*> m_pending;
+    size_t m_requests{ 0 };
+    bool m_disconnected{ false };
+    };
+
+TEST_CASE("Unknown symbol resolve async", "[usr]")
+    {
+    test_tag_daemon daemon;
+    te_parser tep;
+    te_type x{ 10 };
+    tep.set_variables_and_functions({ { "x", &x } });
+
+    SECTION("Suspends until resolved")
+        {
+        auto task = tep.compile_async("TAG1 + TAG2 * x + tag1", daemon.resolver());
+        // nothing happens until it's started
+        CHECK(daemon.m_requests == 0);
+        task.start();
+        CHECK_FALSE(task.is_done());
+        CHECK_THROWS(task.get_result());
+        REQUIRE(daemon.m_pending.size() == 1);
+        CHECK(daemon.m_pending.front()->m_tags == std::vector<std::string>{ "TAG1", "TAG2" });
+        daemon.poll();
+        REQUIRE(task.is_done());
+        CHECK(task.get_result());
+        CHECK(tep.evaluate() == 1 + 2 * 10 + 1);
+        // the resolved tags were kept
+        CHECK(tep.evaluate("TAG2 * 2") == 4);
+        CHECK(daemon.m_requests == 1);
+        }
+    SECTION("Nothing to resolve")
+        {
+        auto task = tep.compile_async("x * 2", daemon.resolver());
+        task.start();
+        REQUIRE(task.is_done());
+        CHECK(task.get_result());
+        CHECK(daemon.m_requests == 0);
+        CHECK(tep.evaluate() == 20);
+        }
+    SECTION("Moved after starting")
+        {
+        auto task = tep.compile_async("TAG1 + x", daemon.resolver());
+        task.start();
+        REQUIRE(daemon.m_pending.size() == 1);
+        // the moved task is still waiting on the resolver, so starting it does nothing
+        te_compile_task movedTask{ std::move(task) };
+        movedTask.start();
+        CHECK_FALSE(movedTask.is_done());
+        auto assignedTask = tep.compile_async("x", daemon.resolver());
+        assignedTask = std::move(movedTask);
+        assignedTask.start();
+        CHECK_FALSE(assignedTask.is_done());
+        CHECK(daemon.m_requests == 1);
+        daemon.poll();
+        REQUIRE(assignedTask.is_done());
+        CHECK(assignedTask.get_result());
+        CHECK(tep.evaluate() == 11);
+        }
+    SECTION("Started, then awaited")
+        {
+        auto inner = tep.compile_async("TAG1 + x", daemon.resolver());
+        inner.start();
+        REQUIRE(daemon.m_pending.size() == 1);
+        const auto awaitInner = [&inner]() -> te_compile_task
+            {
+            co_return co_await std::move(inner);
+            };
+        auto task = awaitInner();
+        task.start();
+        CHECK_FALSE(task.is_done());
+        CHECK(daemon.m_requests == 1);
+        daemon.poll();
+        REQUIRE(task.is_done());
+        CHECK(task.get_result());
+        CHECK(tep.evaluate() == 11);
+        }
+    SECTION("Unresolved")
+        {
+        auto task = tep.compile_async("TAG1 + TAG3", daemon.resolver());
+        task.start();
+        daemon.poll();
+        REQUIRE(task.is_done());
+        CHECK_FALSE(task.get_result());
+        CHECK(tep.get_last_error_position() == 10);
+        }
+    SECTION("Resolver fails")
+        {
+        daemon.m_disconnected = true;
+        auto task = tep.compile_async("TAG1 + TAG2", daemon.resolver());
+        task.start();
+        daemon.poll();
+        REQUIRE(task.is_done());
+        CHECK_FALSE(task.get_result());
+        CHECK(tep.get_last_error_message() == "Lost connection to the tag daemon.");
+        }
+    SECTION("Awaited")
+        {
+        // two compiles, awaited one after the other from another coroutine
+        te_parser tep2;
+        const auto compileBoth = [&]() -> te_compile_task
+            {
+            const bool first = co_await tep.compile_async("TAG1 + x", daemon.resolver());
+            const bool second = co_await tep2.compile_async("TAG2 * 3", daemon.resolver());
+            co_return first && second;
+            };
+        auto task = compileBoth();
+        task.start();
+        CHECK(daemon.m_pending.size() == 1);
+        daemon.poll();
+        CHECK_FALSE(task.is_done());
+        CHECK(daemon.m_pending.size() == 1);
+        daemon.poll();
+        REQUIRE(task.is_done());
+        CHECK(task.get_result());
+        CHECK(tep.evaluate() == 11);
+        CHECK(tep2.evaluate() == 6);
+        }
+    }
+#endif
+
 TEST_CASE("Unknown symbol resolve dynamic", "[usr]")
     {
     te_parser tep;
@@ -3125,46 +3424,2624 @@ COMBIN(15,
         }
     }
 
-TEST_CASE("Benchmarks", "[!benchmark]")
+TEST_CASE("Expression cache", "[cache]")
     {
-    te_type benchmarkVar{ 9 };
+    te_type x{ 2 }, y{ 3 };
     te_parser tep;
-    tep.set_variables_and_functions({ {"a", &benchmarkVar} });
+    tep.set_variables_and_functions({ {"x", &x}, {"y", &y} });
+    CHECK(tep.get_expression_cache_size() == 32);
 
-    BENCHMARK("a+5 Compiled")
-        { return tep.evaluate("a+5"); };
-    BENCHMARK("a+5 Native")
-        { return bench_a5(benchmarkVar); };
+    SECTION("Reuse")
+        {
+        CHECK(tep.evaluate("x+5") == 7);
+        x = 10;
+        // cached, but still reads the bound variable
+        CHECK(tep.evaluate("x+5") == 15);
+        CHECK(tep.success());
+        CHECK(tep.get_last_error_position() == te_parser::npos);
+        // switch back and forth between cached expressions
+        CHECK(tep.evaluate("y*2 // double Y") == 6);
+        CHECK(tep.get_expression() == "y*2 ");
+#ifndef TE_NO_BOOKKEEPING
+        CHECK(tep.is_variable_used("y"));
+        CHECK_FALSE(tep.is_variable_used("x"));
+#endif
+        CHECK(tep.evaluate("x+5") == 15);
+        CHECK(tep.get_expression() == "x+5");
+#ifndef TE_NO_BOOKKEEPING
+        CHECK(tep.is_variable_used("x"));
+        CHECK_FALSE(tep.is_variable_used("y"));
+#endif
+        CHECK(tep.evaluate("y*2 // double Y") == 6);
+        // a failed parse shouldn't affect the cached ones
+        CHECK(std::isnan(tep.evaluate("x+")));
+        CHECK_FALSE(tep.success());
+        CHECK(tep.evaluate("x+5") == 15);
+        CHECK(tep.success());
+        // evaluation errors are still reported from cached expressions
+        CHECK(std::isnan(tep.evaluate("x/(y-3)")));
+        CHECK_FALSE(tep.success());
+        CHECK(std::isnan(tep.evaluate("x/(y-3)")));
+        CHECK_FALSE(tep.success());
+        CHECK(tep.get_last_error_message() == "Division by zero.");
+        }
+    SECTION("Adding and removing variables")
+        {
+        CHECK(tep.evaluate("x+5") == 7);
+        te_type z{ 100 };
+        // rebind x to a different address
+        tep.add_variable_or_function({ "z", &z });
+        tep.remove_variable_or_function("x");
+        CHECK(std::isnan(tep.evaluate("x+5")));
+        CHECK_FALSE(tep.success());
+        tep.add_variable_or_function({ "x", &z });
+        CHECK(tep.evaluate("x+5") == 105);
+        // constants are optimized into the expression, so changing them needs a recompile
+        tep.set_variables_and_functions({ {"x", static_cast<te_type>(1)} });
+        CHECK(tep.evaluate("x+5") == 6);
+        tep.set_constant("x", 4);
+        CHECK(tep.evaluate("x+5") == 9);
+        // functions too
+        tep.add_variable_or_function({ "f", static_cast<te_fun1>([](te_type v) { return v * 10; }) });
+        CHECK(tep.evaluate("f(x)") == 40);
+        tep.add_variable_or_function({ "f", static_cast<te_fun1>([](te_type v) { return v * 10; }) });
+        tep.get_variables_and_functions().erase(
+            tep.get_variables_and_functions().find(te_variable{ "f", static_cast<te_type>(0) }));
+        tep.add_variable_or_function({ "f", static_cast<te_fun1>([](te_type v) { return v * 100; }) });
+        CHECK(tep.evaluate("f(x)") == 400);
+        }
+    SECTION("Separators")
+        {
+        CHECK(tep.evaluate("pow(x,2)") == 4);
+        tep.set_list_separator(';');
+        CHECK(std::isnan(tep.evaluate("pow(x,2)")));
+        tep.set_decimal_separator(',');
+        CHECK(tep.evaluate("pow(x;2)") == 4);
+        }
+    SECTION("Disabled")
+        {
+        tep.set_expression_cache_size(0);
+        CHECK(tep.get_expression_cache_size() == 0);
+        CHECK(tep.evaluate("x+5") == 7);
+        CHECK(tep.evaluate("x+5") == 7);
+        CHECK(tep.evaluate("x*y") == 6);
+        }
+    SECTION("Least-recently used are removed")
+        {
+        // a pure function with a constant argument is folded when it's compiled,
+        // so this counts how many times the expressions are parsed
+        static size_t compileCount{ 0 };
+        compileCount = 0;
+        tep.add_variable_or_function({ "f",
+            static_cast<te_fun1>([](te_type v) { ++compileCount; return v; }), TE_PURE });
+        tep.set_expression_cache_size(2);
+        CHECK(tep.evaluate("f(1)") == 1);
+        CHECK(tep.evaluate("f(2)") == 2);
+        CHECK(tep.evaluate("f(1)") == 1);
+        CHECK(compileCount == 2);
+        // f(2) is the least-recently used, so it's the one removed
+        CHECK(tep.evaluate("f(3)") == 3);
+        CHECK(tep.evaluate("f(1)") == 1);
+        CHECK(compileCount == 3);
+        CHECK(tep.evaluate("f(2)") == 2);
+        CHECK(compileCount == 4);
+        // growing the cache keeps what's already in it
+        tep.set_expression_cache_size(3);
+        for (size_t i = 0; i < 3; ++i)
+            {
+            CHECK(tep.evaluate("f(1)") == 1);
+            CHECK(tep.evaluate("f(2)") == 2);
+            CHECK(tep.evaluate("f(3)") == 3);
+            }
+        CHECK(compileCount == 5);
+        // shrinking the cache keeps the most-recently used
+        tep.set_expression_cache_size(1);
+        CHECK(tep.evaluate("f(3)") == 3);
+        CHECK(compileCount == 5);
+        }
+    SECTION("Unknown symbols re-resolved")
+        {
+        int resolveCount{ 0 };
+        tep.set_unknown_symbol_resolver(
+            [&resolveCount]([[maybe_unused]] std::string_view str) -> te_type
+                {
+                ++resolveCount;
+                return resolveCount;
+                },
+            false);
+        CHECK(tep.evaluate("x+unknown") == 3);
+        CHECK(tep.evaluate("x+unknown") == 4);
+        CHECK(resolveCount == 2);
+        tep.set_unknown_symbol_resolver(
+            [&resolveCount]([[maybe_unused]] std::string_view str) -> te_type
+                {
+                ++resolveCount;
+                return resolveCount;
+                },
+            true);
+        CHECK(tep.evaluate("x+unknown") == 5);
+        CHECK(tep.evaluate("x+unknown") == 5);
+        CHECK(resolveCount == 3);
+        }
+    }
 
-    BENCHMARK("5+a+5 Compiled")
-        { return tep.evaluate("5+a+5"); };
-    BENCHMARK("5+a+5 Native")
-        { return bench_a55(benchmarkVar); };
+TEST_CASE("Formula cache", "[cache]")
+    {
+    te_type x{ 2 }, y{ 3 };
+    auto cache = std::make_shared<te_formula_cache>(3);
+    CHECK(cache->get_capacity() == 3);
+
+    te_parser tep1;
+    tep1.set_variables_and_functions({ {"x", &x}, {"y", &y} });
+    tep1.set_formula_cache(cache);
+    te_parser tep2;
+    tep2.set_variables_and_functions({ {"x", &x}, {"y", &y} });
+    tep2.set_formula_cache(cache);
+
+    SECTION("Shared between parsers")
+        {
+        CHECK(tep1.compile("x+5"));
+        CHECK(cache->get_misses() == 1);
+        CHECK(cache->get_hits() == 0);
+        CHECK(tep2.compile("x+5"));
+        CHECK(cache->get_hits() == 1);
+        x = 10;
+        CHECK(tep2.evaluate() == 15);
+        CHECK(tep2.success());
+        CHECK(tep2.get_last_error_position() == te_parser::npos);
+#ifndef TE_NO_BOOKKEEPING
+        CHECK(tep2.is_variable_used("x"));
+        CHECK_FALSE(tep2.is_variable_used("y"));
+#endif
+        // whitespace, case, and comments don't matter
+        CHECK(tep2.compile(" X  +\t5 /* add 5 */"));
+        CHECK(tep2.get_expression() == " X  +\t5 ");
+        CHECK(cache->get_hits() == 2);
+        CHECK(tep2.evaluate() == 15);
+        // ...but whitespace inside of tokens does
+        CHECK_FALSE(tep2.compile("x+5 5"));
+        CHECK_FALSE(tep2.compile("x < = 5"));
+        CHECK(tep2.compile("1e+5"));
+        CHECK_FALSE(tep2.compile("1e +5"));
+        CHECK_FALSE(tep2.compile("1e+ 5"));
+        CHECK(cache->get_hits() == 2);
+        CHECK(cache->size() == 2);
+        }
+    SECTION("Bindings")
+        {
+        CHECK(tep1.evaluate("x*y") == 6);
+        te_type otherX{ 7 };
+        te_parser tep3;
+        tep3.set_variables_and_functions({ {"x", &otherX}, {"y", &y} });
+        tep3.set_formula_cache(cache);
+        // x is a different variable in this parser
+        CHECK(tep3.evaluate("x*y") == 21);
+        CHECK(cache->get_hits() == 0);
+        CHECK(cache->get_misses() == 2);
+        // same variables as tep1 now
+        tep3.remove_variable_or_function("x");
+        tep3.add_variable_or_function({ "x", &x });
+        CHECK(tep3.evaluate("x*y") == 6);
+        CHECK(cache->get_hits() == 1);
+        // different constant values
+        tep1.set_variables_and_functions({ {"x", static_cast<te_type>(4)} });
+        tep2.set_variables_and_functions({ {"x", static_cast<te_type>(5)} });
+        CHECK(tep1.evaluate("x+1") == 5);
+        CHECK(tep2.evaluate("x+1") == 6);
+        tep2.set_constant("x", 4);
+        CHECK(tep2.evaluate("x+1") == 5);
+        CHECK(cache->get_hits() == 2);
+        // different separators
+        tep2.set_list_separator(';');
+        CHECK(std::isnan(tep2.evaluate("pow(x,2)")));
+        CHECK(tep1.evaluate("pow(x,2)") == 16);
+        }
+    SECTION("Evictions")
+        {
+        CHECK(tep1.compile("x+1"));
+        CHECK(tep1.compile("x+2"));
+        CHECK(tep1.compile("x+3"));
+        CHECK(tep2.compile("x+1")); // moves x+1 to the front
+        CHECK(tep2.compile("x+4")); // evicts x+2
+        CHECK(cache->get_evictions() == 1);
+        CHECK(cache->size() == 3);
+        CHECK(tep2.compile("x+1"));
+        CHECK(tep2.compile("x+3"));
+        CHECK(cache->get_hits() == 3);
+        CHECK(tep2.compile("x+2"));
+        CHECK(cache->get_misses() == 5);
+        CHECK(cache->get_evictions() == 2);
+        cache->set_capacity(1);
+        CHECK(cache->size() == 1);
+        CHECK(cache->get_evictions() == 4);
+        cache->clear();
+        CHECK(cache->size() == 0);
+        cache->reset_statistics();
+        CHECK(cache->get_hits() == 0);
+        CHECK(cache->get_misses() == 0);
+        CHECK(cache->get_evictions() == 0);
+        }
+    SECTION("Unknown symbols not shared")
+        {
+        tep1.set_unknown_symbol_resolver([]([[maybe_unused]] std::string_view str) -> te_type
+                                         { return 1; });
+        CHECK(tep1.evaluate("x+unknown") == 3);
+        CHECK(cache->get_misses() == 0);
+        CHECK(cache->size() == 0);
+        }
+    SECTION("Threads")
+        {
+        cache->set_capacity(100);
+        std::vector<std::thread> threads;
+        std::atomic<size_t> failures{ 0 };
+        for (size_t i = 0; i < 4; ++i)
+            {
+            threads.emplace_back(
+                [&cache, &x, &y, &failures]()
+                {
+                    for (size_t j = 0; j < 200; ++j)
+                        {
+                        te_parser tep;
+                        tep.set_variables_and_functions({ {"x", &x}, {"y", &y} });
+                        tep.set_formula_cache(cache);
+                        const auto expected = static_cast<te_type>(j % 20);
+                        if (tep.evaluate("x*y-6+" + std::to_string(j % 20)) != expected)
+                            {
+                            ++failures;
+                            }
+                        }
+                });
+            }
+        for (auto& thread : threads)
+            {
+            thread.join();
+            }
+        CHECK(failures == 0);
+        CHECK(cache->size() == 20);
+        CHECK(cache->get_hits() + cache->get_misses() == 800);
+        CHECK(cache->get_misses() >= 20);
+        }
+    }
 
-    BENCHMARK("abs(a+5) Compiled")
-        { return tep.evaluate("abs(a+5)"); };
-    BENCHMARK("abs(a+5) Native")
-        { return bench_a5abs(benchmarkVar); };
+TEST_CASE("Incremental compilation", "[incremental]")
+    {
+    te_type x{ 2 }, y{ 3 };
+    const std::set<te_variable> vars{ {"x", &x}, {"y", &y},
+        {"f", static_cast<te_fun2>([](te_type a, te_type b) { return a * 10 + b; })} };
+    te_parser tep;
+    tep.set_variables_and_functions(vars);
+    tep.set_incremental_compilation(true);
+    CHECK(tep.is_incremental_compilation_enabled());
 
-    BENCHMARK("sqrt(a^1.5+a^2.5) Compiled")
-        { return tep.evaluate("sqrt(a^1.5+a^2.5)"); };
-    BENCHMARK("sqrt(a^1.5+a^2.5) Native")
-        { return bench_as(benchmarkVar); };
+    // compares an edit against compiling the edited expression from scratch
+    const auto checkEdit = [&tep, &vars](const size_t offset, const size_t length,
+                                         const std::string_view replacement)
+        {
+        te_parser fullParser;
+        fullParser.set_variables_and_functions(vars);
+        std::string editedExpression{ tep.get_expression() };
+        editedExpression.replace(offset, length, replacement);
+        const bool expected = fullParser.compile(editedExpression);
+
+        CHECK(tep.recompile(offset, length, replacement) == expected);
+        CHECK(tep.get_expression() == fullParser.get_expression());
+        CHECK(tep.get_last_error_position() == fullParser.get_last_error_position());
+        if (expected)
+            {
+            const auto value = tep.evaluate();
+            const auto expectedValue = fullParser.evaluate();
+            CHECK((value == expectedValue || (std::isnan(value) && std::isnan(expectedValue))));
+            for (const auto& name : { "x", "y" })
+                {
+                CHECK(tep.is_variable_used(name) == fullParser.is_variable_used(name));
+                }
+            for (const auto& name : { "f", "sin", "cos", "pow" })
+                {
+                CHECK(tep.is_function_used(name) == fullParser.is_function_used(name));
+                }
+            }
+        };
 
-    BENCHMARK("a+(5*2) Compiled")
-        { return tep.evaluate("a+(5*2)"); };
-    BENCHMARK("a+(5*2) Native")
-        { return bench_a10(benchmarkVar); };
+    // where text is in the current expression
+    const auto at = [&tep](const std::string_view text) { return tep.get_expression().find(text); };
 
-    BENCHMARK("(a+5)*2 Compiled")
-        { return tep.evaluate("(a+5)*2"); };
-    BENCHMARK("(a+5)*2 Native")
-        { return bench_a52(benchmarkVar); };
+    SECTION("Edits")
+        {
+        CHECK(tep.compile("f(x*2, y+1) + sin(x+(y*3)) - cos(2*(x-1))"));
+        CHECK_THAT(tep.evaluate(), Catch::Matchers::WithinRel(44 + std::sin(11.0) - std::cos(2.0)));
+        checkEdit(at("2,"), 1, "3");           // literal in an argument
+        checkEdit(at("y+1"), 1, "x");          // identifier in an argument
+        checkEdit(at("y*3"), 1, "x");          // inside a nested group
+        checkEdit(at("x-1"), 0, "2*");         // insertion
+        checkEdit(at("*3)"), 2, "");           // deletion
+        checkEdit(at("(x))"), 3, "(y - 1)");   // new groups
+        checkEdit(tep.get_expression().length(), 0, "+1"); // top level
+        checkEdit(0, 0, "1+");                 // top level
+        checkEdit(at("x*3"), 3, "x, y");       // wrong number of arguments
+        checkEdit(at("x, y"), 4, "1");         // back to valid
+        checkEdit(at("x+1"), 1, ")");          // syntax error
+        checkEdit(at(")+1"), 1, "x");          // back to valid
+        CHECK(tep.success());
+        CHECK(tep.get_expression() == "1+f(1, x+1) + sin(x+(y - 1)) - cos(2*(2*x-1))+1");
+        }
+    SECTION("Variables and functions used")
+        {
+        CHECK(tep.compile("f(x, 1) + pow(y, 2)"));
+        CHECK(tep.is_variable_used("x"));
+        checkEdit(at("x,"), 1, "y");
+        CHECK_FALSE(tep.is_variable_used("x"));
+        checkEdit(at("2)"), 1, "sin(x)");
+        CHECK(tep.is_variable_used("x"));
+        CHECK(tep.is_function_used("sin"));
+        checkEdit(at("sin(x)"), 6, "2");
+        CHECK_FALSE(tep.is_function_used("sin"));
+        CHECK_FALSE(tep.is_variable_used("x"));
+        }
+    SECTION("Constants")
+        {
+        // arguments that become constant are folded, as well as what they are in
+        CHECK(tep.compile("x + sin(cos(x))"));
+        checkEdit(at("x))"), 1, "0");
+        checkEdit(at("0))"), 1, "y");
+        CHECK(tep.compile("x + f(y, (1+1))"));
+        checkEdit(at("y,"), 1, "2");
+        checkEdit(at("1+1"), 1, "x");
+        checkEdit(at("f"), 1, "pow");
+        }
+    SECTION("Folding errors")
+        {
+        // folding what an edit is inside of can throw, which shouldn't leave
+        // the compiled expression partly folded
+        CHECK(tep.compile("1/(y)"));
+        checkEdit(at("y"), 1, "0");
+        CHECK_FALSE(tep.success());
+        CHECK(tep.get_last_error_message() == "Division by zero.");
+        CHECK(tep.compile("bitlshift(floor(y),2)"));
+        checkEdit(at("y"), 1, "-1");
+        CHECK_FALSE(tep.success());
+        CHECK(tep.compile("1/(y) + x"));
+        checkEdit(at("y"), 1, "0");
+        checkEdit(at("0"), 1, "y");
+        CHECK(tep.evaluate() == 1.0 / 3 + 2);
+        }
+    SECTION("Comments")
+        {
+        CHECK(tep.compile("f(x/2, y)"));
+        checkEdit(at("/2"), 0, "/");
+        CHECK(tep.get_expression() == "f(x");
+        CHECK_FALSE(tep.success());
+        CHECK(tep.compile("f(x*2, y)"));
+        checkEdit(at("2,"), 1, "/* two */2");
+        CHECK(tep.get_expression() == "f(x*2, y)");
+        }
+    SECTION("Only the edited part is parsed")
+        {
+        int resolveCount{ 0 };
+        tep.set_unknown_symbol_resolver(
+            [&resolveCount]([[maybe_unused]] std::string_view str) -> te_type
+                {
+                ++resolveCount;
+                return 1;
+                },
+            false);
+        CHECK(tep.compile("f(a, b) + f(c, x)"));
+        CHECK(resolveCount == 3);
+        CHECK(tep.recompile(at("b"), 1, "d"));
+        CHECK(resolveCount == 4);
+        CHECK(tep.evaluate() == 23);
+        // not enabled, so the whole expression is compiled
+        tep.set_incremental_compilation(false);
+        CHECK(tep.compile("f(a, b) + f(c, x)"));
+        CHECK(resolveCount == 7);
+        CHECK(tep.recompile(at("b"), 1, "d"));
+        CHECK(resolveCount == 10);
+        CHECK(tep.get_expression() == "f(a, d) + f(c, x)");
+        }
+    SECTION("Variables changed")
+        {
+        CHECK(tep.compile("f(x, y)"));
+        te_type z{ 5 };
+        tep.remove_variable_or_function("y");
+        tep.add_variable_or_function({ "y", &z });
+        CHECK(tep.recompile(2, 1, "1"));
+        CHECK(tep.evaluate() == 15);
+        }
+    SECTION("Bad position")
+        {
+        CHECK(tep.compile("x+y"));
+        CHECK_THROWS(tep.recompile(4, 0, "1"));
+        CHECK(tep.recompile(3, 0, "+1"));
+        CHECK(tep.evaluate() == 6);
+        }
+    }
 
-    BENCHMARK("(1/(a+1)+2/(a+2)+3/(a+3)) Compiled")
-        { return tep.evaluate("(1/(a+1)+2/(a+2)+3/(a+3))"); };
-    BENCHMARK("(1/(a+1)+2/(a+2)+3/(a+3)) Native")
-        { return bench_al(benchmarkVar); };
+TEST_CASE("Validation", "[validate]")
+    {
+    te_type x{ 2 };
+    static int callCount{ 0 };
+    callCount = 0;
+    const std::set<te_variable> vars{ {"x", &x},
+        {"counter", static_cast<te_fun1>([](te_type val)
+            {
+            ++callCount;
+            return val;
+            }), TE_PURE} };
+
+    te_parser tep;
+    tep.set_variables_and_functions(vars);
+    te_parser compiler;
+    compiler.set_variables_and_functions(vars);
+
+    SECTION("Same results as compile")
+        {
+        for (const auto& expression : { "x+5", "=SUM(1, x, 3)", "sin(x) + cos(x)^2", "if(x > 1, 5, 6)",
+                                        "(x*(2+3))", "x /* comment */ + 1 // comment",
+                                        "-+-x", "pi", "pi()", "sqrt x", "x+", "(x*2", "x*2)",
+                                        "pow(x)", "pow(x, 2, 3)", "sum(1,)", "y+1", "1 2",
+                                        "x /* unterminated", "", "x+5 < = 6", "5$2", "max(1, (2))" })
+            {
+            CAPTURE(expression);
+            CHECK(tep.validate(expression) == compiler.compile(expression));
+            CHECK(tep.success() == compiler.success());
+            CHECK(tep.get_last_error_position() == compiler.get_last_error_position());
+            CHECK(tep.get_expression() == compiler.get_expression());
+            }
+        }
+    SECTION("Nothing evaluated")
+        {
+        CHECK(tep.validate("counter(5) + counter(x)"));
+        CHECK(callCount == 0);
+        CHECK(std::isnan(tep.evaluate()));
+        CHECK(tep.is_function_used("counter"));
+        CHECK(tep.is_variable_used("x"));
+        CHECK(compiler.compile("counter(5) + counter(x)"));
+        CHECK(callCount == 1);
+        // errors that only happen when evaluating are not caught
+        CHECK(tep.validate("1 << 64"));
+        CHECK_FALSE(compiler.compile("1 << 64"));
+        }
+    SECTION("Replaces compiled expression")
+        {
+        CHECK(tep.compile("x+1"));
+        CHECK(tep.evaluate() == 3);
+        CHECK(tep.validate("x+2"));
+        CHECK(std::isnan(tep.evaluate()));
+        }
+    }
+
+TEST_CASE("Compile many", "[compile_many]")
+    {
+    te_type x{ 2 }, y{ 3 };
+    te_parser tep;
+    tep.set_variables_and_functions({ {"x", &x}, {"y", &y} });
+
+    std::vector<std::string> formulas;
+    for (size_t i = 0; i < 500; ++i)
+        {
+        formulas.push_back("x*" + std::to_string(i % 50) + " + sin(y)");
+        formulas.push_back((i % 7 == 0) ? "pow(x, " : "pow(x, y) - " + std::to_string(i));
+        }
+    const std::vector<std::string_view> expressions(formulas.cbegin(), formulas.cend());
+
+    const auto checkResults = [&expressions](const std::vector<te_parser::compile_result>& results)
+        {
+        REQUIRE(results.size() == expressions.size());
+        te_type x{ 2 }, y{ 3 };
+        te_parser compiler;
+        compiler.set_variables_and_functions({ {"x", &x}, {"y", &y} });
+        for (size_t i = 0; i < expressions.size(); ++i)
+            {
+            CAPTURE(expressions[i]);
+            CHECK(results[i].m_success == compiler.compile(expressions[i]));
+            CHECK(results[i].m_errorPosition == compiler.get_last_error_position());
+            CHECK(results[i].m_errorMessage == compiler.get_last_error_message());
+            }
+        };
+
+    SECTION("One thread")
+        {
+        CHECK(tep.compile("x+y"));
+        checkResults(tep.compile_many(expressions));
+        // the parser's compiled expression is left alone
+        CHECK(tep.get_expression() == "x+y");
+        CHECK(tep.evaluate() == 5);
+        CHECK(tep.compile_many(std::vector<std::string_view>{}).empty());
+        }
+    SECTION("Multiple threads")
+        {
+        checkResults(tep.compile_many(expressions, 4));
+        }
+    SECTION("Formula cache")
+        {
+        auto cache = std::make_shared<te_formula_cache>(1000);
+        tep.set_formula_cache(cache);
+        const auto results = tep.compile_many(expressions, 4);
+        checkResults(results);
+        CHECK(cache->size() == 50 + 428);
+        const auto hits = cache->get_hits();
+        CHECK(tep.compile("x*7 + sin(y)"));
+        CHECK(cache->get_hits() == hits + 1);
+        CHECK_THAT(tep.evaluate(), Catch::Matchers::WithinRel(14 + std::sin(3.0)));
+        }
+    SECTION("Unknown symbols")
+        {
+        int resolveCount{ 0 };
+        tep.set_unknown_symbol_resolver(
+            [&resolveCount]([[maybe_unused]] std::string_view str) -> te_type
+                {
+                ++resolveCount;
+                return 10;
+                },
+            false);
+        auto results = tep.compile_many({ "a+b", "a*2", "b-x", "c+" }, 4);
+        CHECK(results[0].m_success);
+        CHECK(results[1].m_success);
+        CHECK(results[2].m_success);
+        CHECK_FALSE(results[3].m_success);
+        CHECK(results[3].m_errorPosition == 1);
+        CHECK(resolveCount == 3);
+        // resolved variables were not kept
+        tep.set_unknown_symbol_resolver(te_usr_noop{});
+        CHECK_FALSE(tep.compile("a+b"));
+
+        tep.set_unknown_symbol_resolver(
+            [&resolveCount]([[maybe_unused]] std::string_view str) -> te_type
+                {
+                ++resolveCount;
+                return 10;
+                },
+            true);
+        results = tep.compile_many({ "a+b", "a*2" });
+        CHECK(results[1].m_success);
+        CHECK(resolveCount == 5);
+        tep.set_unknown_symbol_resolver(te_usr_noop{});
+        CHECK(tep.evaluate("a+b") == 20);
+        }
+    SECTION("Unknown symbols with multiple threads")
+        {
+        // the resolver isn't thread safe, so it fails if it's called from two threads at once
+        std::map<std::string, int> resolveCounts;
+        std::atomic<bool> resolving{ false };
+        std::atomic<bool> overlapped{ false };
+        tep.set_unknown_symbol_resolver(
+            [&](std::string_view str) -> te_type
+                {
+                if (resolving.exchange(true))
+                    {
+                    overlapped = true;
+                    }
+                ++resolveCounts[std::string{ str }];
+                resolving = false;
+                return static_cast<te_type>(str.length());
+                },
+            true);
+        std::vector<std::string> unknownFormulas;
+        for (size_t i = 0; i < 2'000; ++i)
+            {
+            unknownFormulas.push_back("x + unknown" + std::to_string(i % 100) + " * y");
+            }
+        const std::vector<std::string_view> unknownExpressions(unknownFormulas.cbegin(),
+                                                              unknownFormulas.cend());
+        const auto results = tep.compile_many(unknownExpressions, 8);
+        CHECK(std::all_of(results.cbegin(), results.cend(),
+                          [](const auto& result) { return result.m_success; }));
+        CHECK_FALSE(overlapped);
+        REQUIRE(resolveCounts.size() == 100);
+        CHECK(std::all_of(resolveCounts.cbegin(), resolveCounts.cend(),
+                          [](const auto& count) { return count.second == 1; }));
+        // the resolved variables were kept
+        tep.set_unknown_symbol_resolver(te_usr_noop{});
+        CHECK(tep.evaluate("unknown42 + unknown7") == 9 + 8);
+        }
+    SECTION("Programs")
+        {
+        te_program_registry registry;
+        const auto results = tep.compile_programs(expressions, registry, 4);
+        checkResults(results);
+        // the duplicate and failed expressions aren't registered
+        CHECK(registry.size() == 50 + 428);
+        const auto program = registry.find("x*7 + sin(y)");
+        REQUIRE(program != nullptr);
+        CHECK_THAT(program->evaluate().m_value,
+                   Catch::Matchers::WithinRel(14 + std::sin(3.0)));
+        CHECK(registry.find("pow(x, ") == nullptr);
+        CHECK(registry.find("x*7") == nullptr);
+
+        // registered expressions aren't compiled again
+        CHECK(tep.compile_programs({ "x*7 + sin(y)", "x-y" }, registry)[0].m_success);
+        CHECK(registry.find("x*7 + sin(y)") == program);
+        CHECK(registry.size() == 50 + 428 + 1);
+        CHECK_FALSE(registry.insert("x-y", program));
+        CHECK_FALSE(registry.insert("x+y", nullptr));
+        registry.clear();
+        CHECK(registry.size() == 0);
+        }
+    SECTION("Same separators")
+        {
+        tep.set_decimal_separator(',');
+        CHECK_THROWS(tep.compile_many(expressions));
+        }
+    }
+
+TEST_CASE("Rebind", "[rebind]")
+    {
+    te_type x{ 2 }, y{ 3 };
+    te_parser tep;
+    tep.set_variables_and_functions({ {"x", &x}, {"y", &y} });
+
+    SECTION("Rebind one variable")
+        {
+        te_type otherX{ 10 };
+        CHECK(tep.compile("x*x + y"));
+        CHECK(tep.get_bound_variable_names() == std::vector<std::string>{ "x", "y" });
+        CHECK(tep.evaluate() == 7);
+        CHECK(tep.rebind("X", &otherX));
+        CHECK(tep.evaluate() == 103);
+        otherX = 5;
+        CHECK(tep.evaluate() == 28);
+        // not in the expression
+        te_type z{ 1 };
+        CHECK_FALSE(tep.rebind("z", &z));
+        // the parser's variables weren't changed, so compiling again uses them
+        CHECK(tep.compile("x*x + y"));
+        CHECK(tep.evaluate() == 7);
+        }
+    SECTION("Rebind all variables")
+        {
+        struct point
+            {
+            te_type m_x{ 0 };
+            te_type m_y{ 0 };
+            };
+        std::vector<point> points;
+        for (size_t i = 0; i < 100; ++i)
+            {
+            points.push_back({ static_cast<te_type>(i), static_cast<te_type>(i * 2) });
+            }
+        CHECK(tep.compile("sqrt(y) + x/2 + (y-x)"));
+        CHECK(tep.get_bound_variable_names() == std::vector<std::string>{ "y", "x" });
+        for (const auto& currentPoint : points)
+            {
+            tep.rebind_all({ &currentPoint.m_y, &currentPoint.m_x });
+            CHECK_THAT(tep.evaluate(), Catch::Matchers::WithinRel(
+                std::sqrt(currentPoint.m_y) + currentPoint.m_x / 2 +
+                (currentPoint.m_y - currentPoint.m_x)));
+            }
+        CHECK_THROWS(tep.rebind_all({ &x }));
+        CHECK(tep.compile("5+6"));
+        CHECK(tep.get_bound_variable_names().empty());
+        CHECK_NOTHROW(tep.rebind_all(std::vector<const te_type*>{}));
+        CHECK(tep.evaluate() == 11);
+        }
+    SECTION("Cached expressions are copied")
+        {
+        te_type otherX{ 10 };
+        CHECK(tep.evaluate("x+y") == 5);
+        CHECK(tep.rebind("x", &otherX));
+        CHECK(tep.evaluate() == 13);
+        // the cached expression is still bound to the parser's variables
+        CHECK(tep.evaluate("x+y") == 5);
+        CHECK(tep.evaluate("x+y") == 5);
+
+        auto cache = std::make_shared<te_formula_cache>();
+        te_parser tep2;
+        tep2.set_variables_and_functions({ {"x", &x}, {"y", &y} });
+        tep.set_formula_cache(cache);
+        tep2.set_formula_cache(cache);
+        CHECK(tep.compile("x*y"));
+        CHECK(tep2.compile("x*y"));
+        CHECK(tep.rebind("x", &otherX));
+        CHECK(tep.evaluate() == 30);
+        CHECK(tep2.evaluate() == 6);
+        }
+    SECTION("Incremental compilation")
+        {
+        te_type otherX{ 10 };
+        tep.set_incremental_compilation(true);
+        CHECK(tep.compile("max(x, 1) + min(y, 100)"));
+        CHECK(tep.recompile(16, 1, "x"));
+        CHECK(tep.get_expression() == "max(x, 1) + min(x, 100)");
+        CHECK(tep.get_bound_variable_names() == std::vector<std::string>{ "x" });
+        CHECK(tep.rebind("x", &otherX));
+        CHECK(tep.evaluate() == 20);
+        // recompiling binds the variables from the parser again
+        CHECK(tep.recompile(7, 1, "2"));
+        CHECK(tep.evaluate() == 4);
+        CHECK(tep.recompile(16, 1, "y"));
+        CHECK(tep.get_bound_variable_names() == std::vector<std::string>{ "x", "y" });
+        CHECK(tep.rebind("y", &otherX));
+        CHECK(tep.evaluate() == 12);
+        }
+    }
+
+TEST_CASE("Common subexpression elimination", "[cse]")
+    {
+    te_type a{ 2 }, b{ 3 };
+    static int pureCount{ 0 };
+    static int impureCount{ 0 };
+    static int closureCount{ 0 };
+    pureCount = impureCount = closureCount = 0;
+    te_expr context{ TE_DEFAULT, &a };
+    const std::set<te_variable> vars{ {"a", &a}, {"b", &b},
+        {"pure", static_cast<te_fun1>([](te_type val)
+            {
+            ++pureCount;
+            return val;
+            }), TE_PURE},
+        {"impure", static_cast<te_fun1>([](te_type val)
+            {
+            ++impureCount;
+            return val;
+            }), TE_DEFAULT},
+        {"closure", static_cast<te_confun1>([](const te_expr*, te_type val)
+            {
+            ++closureCount;
+            return val;
+            }), TE_PURE, &context} };
+
+    te_parser tep;
+    tep.set_variables_and_functions(vars);
+    tep.set_common_subexpression_elimination(true);
+    CHECK(tep.is_common_subexpression_elimination_enabled());
+    te_parser tepNoCse;
+    tepNoCse.set_variables_and_functions(vars);
+    CHECK_FALSE(tepNoCse.is_common_subexpression_elimination_enabled());
+
+    SECTION("Pure subexpressions are evaluated once")
+        {
+        CHECK(tep.compile("pure(a+1)*pure(a+1)/sqrt(pure(a+1))"));
+        CHECK_THAT(tep.evaluate(), Catch::Matchers::WithinRel(9 / std::sqrt(3.0)));
+        CHECK(pureCount == 1);
+        a = 5;
+        CHECK_THAT(tep.evaluate(), Catch::Matchers::WithinRel(36 / std::sqrt(6.0)));
+        CHECK(pureCount == 2);
+
+        pureCount = 0;
+        CHECK(tepNoCse.compile("pure(a+1)*pure(a+1)/sqrt(pure(a+1))"));
+        CHECK_THAT(tepNoCse.evaluate(), Catch::Matchers::WithinRel(36 / std::sqrt(6.0)));
+        CHECK(pureCount == 3);
+        }
+    SECTION("Impure functions and closures are always called")
+        {
+        CHECK(tep.compile("impure(a) + impure(a) + closure(a) + closure(a) + pure(impure(b)) + pure(impure(b))"));
+        CHECK(tep.evaluate() == 14);
+        CHECK(impureCount == 4);
+        CHECK(closureCount == 2);
+        CHECK(pureCount == 2);
+        }
+    SECTION("Nested repeats")
+        {
+        CHECK(tep.compile("pure(a+1)*2 + pure(a+1) + (pure(a+1)*2) - pure(pure(a+1)*2)"));
+        CHECK(tep.evaluate() == 9);
+        CHECK(pureCount == 2);
+        }
+    SECTION("Same results")
+        {
+        const std::vector<std::string> formulas{
+            "(a+1)*(a+1)/sqrt(a+1)",
+            "sin(a)^2 + cos(a)^2 + sin(a)*cos(a)",
+            "max(a, b, a+b, a+b) - min(a+b, sum(a, b, a*b), a*b)",
+            "if(a > b, a-b, b-a) + if(a > b, a-b, b-a)*2",
+            "(a^b + b^a) / (a^b - b^a) + (a^b + b^a)",
+            "sqrt(sqrt(a*b) + sqrt(a*b)) * sqrt(a*b)",
+            "(a+b)*(b+a) + (a+b)",
+            "round(a/b, 2) + round(a/b) + round(a/b, 2)",
+            "a*b - a*b + 5*(1+2)"
+            };
+        for (const auto& formula : formulas)
+            {
+            CAPTURE(formula);
+            CHECK(tep.compile(formula));
+            CHECK(tepNoCse.compile(formula));
+            for (const auto& [aValue, bValue] :
+                 std::vector<std::pair<te_type, te_type>>{ { 2, 3 }, { -1, 4 }, { 0, 0 }, { 7.5, 0.25 } })
+                {
+                a = aValue;
+                b = bValue;
+                const auto expected = tepNoCse.evaluate();
+                const auto result = tep.evaluate();
+                CHECK(((std::isnan(expected) && std::isnan(result)) || expected == result));
+                }
+            }
+        }
+    SECTION("Rebind and caching")
+        {
+        te_type otherA{ 10 };
+        CHECK(tep.evaluate("pure(a+1)*pure(a+1)") == 9);
+        CHECK(tep.rebind("a", &otherA));
+        CHECK(tep.evaluate() == 121);
+        CHECK(tep.evaluate("pure(a+1)*pure(a+1)") == 9);
+
+        auto cache = std::make_shared<te_formula_cache>();
+        te_parser tep2;
+        tep2.set_variables_and_functions(vars);
+        tep2.set_common_subexpression_elimination(true);
+        tep.set_formula_cache(cache);
+        tep2.set_formula_cache(cache);
+        tepNoCse.set_formula_cache(cache);
+        CHECK(tep.compile("(a+b)*(a+b)"));
+        CHECK(tep2.compile("(a+b)*(a+b)"));
+        CHECK(cache->get_hits() == 1);
+        // compiled differently, so not shared
+        CHECK(tepNoCse.compile("(a+b)*(a+b)"));
+        CHECK(cache->get_hits() == 1);
+        CHECK(tep.evaluate() == 25);
+        CHECK(tep2.evaluate() == 25);
+        CHECK(tepNoCse.evaluate() == 25);
+        CHECK(tep2.rebind("b", &otherA));
+        CHECK(tep2.evaluate() == 144);
+        CHECK(tep.evaluate() == 25);
+        }
+    SECTION("Incremental compilation")
+        {
+        tep.set_incremental_compilation(true);
+        CHECK(tep.compile("pure(a+1)*pure(a+1)"));
+        CHECK(tep.evaluate() == 9);
+        CHECK(pureCount == 2);
+        CHECK(tep.recompile(7, 1, "2"));
+        CHECK(tep.evaluate() == 12);
+        }
+    }
+
+TEST_CASE("Simplification", "[simplify]")
+    {
+    te_type x{ 2 }, y{ 3 };
+    static int impureCount{ 0 };
+    impureCount = 0;
+    te_parser tep;
+    tep.set_variables_and_functions({ {"x", &x}, {"y", &y},
+        {"impure", static_cast<te_fun1>([](te_type val)
+            {
+            ++impureCount;
+            return val;
+            }), TE_DEFAULT} });
+    CHECK(tep.get_simplification() == te_parser::simplification::ieee_safe);
+
+    const auto removedCount = [&tep](const std::string_view rule)
+        {
+        const auto count = tep.get_simplification_counts().find(rule);
+        return (count != tep.get_simplification_counts().cend()) ? count->second : 0;
+        };
+
+    SECTION("IEEE-safe rules")
+        {
+        CHECK(tep.evaluate("x*1 + 1*y") == 5);
+        CHECK(removedCount("x*1") == 4);
+        CHECK(tep.evaluate("x/1") == 2);
+        CHECK(removedCount("x/1") == 2);
+        CHECK(tep.evaluate("x-0") == 2);
+        CHECK(removedCount("x-0") == 2);
+        CHECK(tep.evaluate("x^1 + pow(y, 1)") == 5);
+        CHECK(removedCount("x^1") == 4);
+        CHECK(tep.evaluate("-(-x)") == 2);
+        CHECK(removedCount("--x") == 2);
+        CHECK(tep.evaluate("abs(abs(abs(-x)))") == 2);
+        CHECK(removedCount("abs(abs(x))") == 2);
+        CHECK(tep.evaluate("if(1, x, y) + if(0, x, y*2)") == 8);
+        CHECK(removedCount("if(constant)") == 6);
+        // simplified into a constant, which the rest is folded with
+        CHECK(tep.evaluate("(5*1 + 0*x^1)*2") == 10);
+        // not in the fast-math tier
+        CHECK(tep.evaluate("x+0") == 2);
+        CHECK(removedCount("x+0") == 0);
+        CHECK(removedCount("x*0") == 0);
+
+        tep.reset_simplification_counts();
+        CHECK(tep.get_simplification_counts().empty());
+        }
+    SECTION("IEEE semantics are kept")
+        {
+        x = -0.0;
+        CHECK(tep.compile("x-0"));
+        CHECK(std::signbit(tep.evaluate()));
+        CHECK(tep.compile("x*1"));
+        CHECK(std::signbit(tep.evaluate()));
+        // -0 + 0 is 0
+        CHECK(tep.compile("x+0"));
+        CHECK_FALSE(std::signbit(tep.evaluate()));
+        // x - -0 is x + 0
+        CHECK(tep.compile("x-(-0)"));
+        CHECK_FALSE(std::signbit(tep.evaluate()));
+
+        x = std::numeric_limits<te_type>::quiet_NaN();
+        CHECK(tep.compile("x*0"));
+        CHECK(std::isnan(tep.evaluate()));
+        CHECK(tep.compile("x*1"));
+        CHECK(std::isnan(tep.evaluate()));
+        }
+    SECTION("Impure functions are kept")
+        {
+        // the branch that isn't taken is never evaluated, so it can be removed
+        CHECK(tep.evaluate("if(1, x, impure(y))") == 2);
+        CHECK(impureCount == 0);
+        CHECK(removedCount("if(constant)") == 4);
+        CHECK(tep.evaluate("impure(y)*1") == 3);
+        CHECK(impureCount == 1);
+        CHECK(removedCount("x*1") == 2);
+
+        tep.set_simplification(te_parser::simplification::fast_math);
+        CHECK(tep.evaluate("impure(y)*0") == 0);
+        CHECK(impureCount == 2);
+        CHECK(removedCount("x*0") == 0);
+        }
+    SECTION("Fast math")
+        {
+        x = std::numeric_limits<te_type>::quiet_NaN();
+        CHECK(std::isnan(tep.evaluate("x*0 + y")));
+        tep.set_simplification(te_parser::simplification::fast_math);
+        CHECK(tep.get_simplification() == te_parser::simplification::fast_math);
+        CHECK(tep.evaluate("x*0 + y") == 3);
+        CHECK(removedCount("x*0") == 2);
+        CHECK(removedCount("x+0") == 2);
+        CHECK(tep.get_bound_variable_names() == std::vector<std::string>{ "y" });
+
+        x = -0.0;
+        CHECK(tep.compile("x+0"));
+        CHECK(std::signbit(tep.evaluate()));
+        }
+    SECTION("No simplification")
+        {
+        tep.set_simplification(te_parser::simplification::none);
+        CHECK(tep.evaluate("x*1 + if(1, x, y) + abs(abs(x))") == 6);
+        CHECK(tep.get_simplification_counts().empty());
+        }
+    SECTION("Incremental compilation")
+        {
+        tep.set_incremental_compilation(true);
+        CHECK(tep.compile("sqrt(x*1) + (y+1)"));
+        CHECK(removedCount("x*1") == 2);
+        CHECK(tep.recompile(15, 1, "2/1"));
+        CHECK(tep.get_expression() == "sqrt(x*1) + (y+2/1)");
+        CHECK(tep.evaluate() == std::sqrt(2.0) + 5);
+        CHECK(tep.recompile(15, 3, "1*x"));
+        CHECK(tep.evaluate() == std::sqrt(2.0) + 5);
+        CHECK(removedCount("x*1") == 4);
+        }
+    SECTION("Compile many")
+        {
+        const auto results = tep.compile_many({ "x*1", "y/1", "-(-x)*1" }, 2);
+        CHECK(results.size() == 3);
+        CHECK(removedCount("x*1") == 4);
+        CHECK(removedCount("x/1") == 2);
+        CHECK(removedCount("--x") == 2);
+        }
+    }
+
+TEST_CASE("Strength reduction", "[simplify]")
+    {
+    te_type x{ 2 };
+    te_parser tep;
+    tep.set_variables_and_functions({ {"x", &x} });
+    te_parser tepNoSimplify;
+    tepNoSimplify.set_variables_and_functions({ {"x", &x} });
+    tepNoSimplify.set_simplification(te_parser::simplification::none);
+
+    const auto removedCount = [&tep](const std::string_view rule)
+        {
+        const auto count = tep.get_simplification_counts().find(rule);
+        return (count != tep.get_simplification_counts().cend()) ? count->second : 0;
+        };
+    const std::vector<te_type> values{ 0.0, -0.0, 1, -1, 2, -2.5, 0.1, 1e-3, 1e300, -1e300,
+        123456.789, std::numeric_limits<te_type>::denorm_min(),
+        std::numeric_limits<te_type>::infinity(), -std::numeric_limits<te_type>::infinity(),
+        std::numeric_limits<te_type>::quiet_NaN() };
+
+    SECTION("Same results as pow")
+        {
+        for (const auto& formula : { "x^2", "x^-1", "x^0.5", "x^0", "pow(x, 2)", "x/2", "x/-0.25" })
+            {
+            CAPTURE(formula);
+            CHECK(tep.compile(formula));
+            CHECK(tepNoSimplify.compile(formula));
+            for (const auto value : values)
+                {
+                CAPTURE(value);
+                x = value;
+                const auto expected = tepNoSimplify.evaluate();
+                const auto result = tep.evaluate();
+                CHECK(((std::isnan(expected) && std::isnan(result)) ||
+                       (expected == result && std::signbit(expected) == std::signbit(result))));
+                }
+            }
+        CHECK(removedCount("x^2") == 2);
+        CHECK(removedCount("x^-1") == 1);
+        CHECK(removedCount("x^0.5") == 1);
+        CHECK(removedCount("x^0") == 2);
+        CHECK(removedCount("x/c") == 2);
+        }
+    SECTION("Only exact rewrites by default")
+        {
+        constexpr std::string_view formula{ "x^3 + x^4 + x^1.5 + x^2.5 + x/3" };
+        CHECK(tep.evaluate(formula) == tepNoSimplify.evaluate(formula));
+        CHECK(tep.get_simplification_counts().empty());
+        // still an error
+        CHECK(std::isnan(tep.evaluate("x/0")));
+        // raising to zero doesn't hide errors from the base
+        te_type y{ 0 };
+        tep.add_variable_or_function({ "y", &y });
+        for (const auto& formula : { "(x/y)^0", "pow(x/0, 0)", "(x<<2.5)^0" })
+            {
+            CAPTURE(formula);
+            CHECK(std::isnan(tep.evaluate(formula)));
+            CHECK_FALSE(tep.success());
+            }
+        CHECK(tep.get_last_error_message() ==
+              "Additive expression of left shift (<<) operation must be an integer.");
+        }
+    SECTION("Fast math")
+        {
+        tep.set_simplification(te_parser::simplification::fast_math);
+        for (const auto& formula : { "x^3", "x^4", "x^1.5", "x^2.5", "x/3", "sqrt(x^1.5+x^2.5)" })
+            {
+            CAPTURE(formula);
+            CHECK(tep.compile(formula));
+            CHECK(tepNoSimplify.compile(formula));
+            for (const auto value : { 0.0, 1.0, 2.0, 0.1, 7.25, 123456.789 })
+                {
+                CAPTURE(value);
+                x = value;
+                CHECK_THAT(tep.evaluate(), Catch::Matchers::WithinRel(tepNoSimplify.evaluate(),
+                                                                      static_cast<te_type>(1e-6)));
+                }
+            }
+        CHECK(removedCount("x^3") == 1);
+        CHECK(removedCount("x^4") == 1);
+        // errors in a base raised to zero are hidden with fast math
+        CHECK(tep.evaluate("(x/0)^0") == 1);
+        CHECK(removedCount("x^1.5") == 2);
+        CHECK(removedCount("x^2.5") == 2);
+        CHECK(removedCount("x/c") == 1);
+        }
+    }
+
+TEST_CASE("Reassociation", "[reassociate]")
+    {
+    te_type a{ 2 }, b{ 3 };
+    te_parser tep;
+    tep.set_variables_and_functions({ {"a", &a}, {"b", &b} });
+    CHECK(tep.get_reassociation() == te_parser::reassociation::none);
+    te_parser tepNone;
+    tepNone.set_variables_and_functions({ {"a", &a}, {"b", &b} });
+
+    const auto removedCount = [&tep]()
+        {
+        const auto count = tep.get_simplification_counts().find("reassociation");
+        return (count != tep.get_simplification_counts().cend()) ? count->second : 0;
+        };
+    const std::vector<std::string> formulas{
+        "5+a+5", "5-a-5+b", "2*a*3*b*4", "a-5+b-3", "1+2*a+3+4*b+5", "-a+5+5",
+        "a*b+5+a+5-b+7", "(a+1)+(b+2)+(a+3)+(b+4)", "sqrt(5+a+5) * 2 * a * 0.5",
+        "a+0.1+0.2", "a*0.5*4", "a-0+5-5", "a+b+a+b+a+b+a+b" };
+
+    const auto checkResults = [&]()
+        {
+        for (const auto& formula : formulas)
+            {
+            CAPTURE(formula);
+            CHECK(tep.compile(formula));
+            CHECK(tepNone.compile(formula));
+            for (const auto& [aValue, bValue] : std::vector<std::pair<te_type, te_type>>{
+                     { 2, 3 }, { -1, 4 }, { 0.5, -7.25 }, { 100, 1e-3 } })
+                {
+                a = aValue;
+                b = bValue;
+                CHECK_THAT(tep.evaluate(), Catch::Matchers::WithinRel(tepNone.evaluate(),
+                                                                      static_cast<te_type>(1e-6)));
+                }
+            }
+        };
+
+    SECTION("Disabled")
+        {
+        CHECK(tep.compile("5+a+5"));
+        CHECK(removedCount() == 0);
+        }
+    SECTION("Strict")
+        {
+        tep.set_reassociation(te_parser::reassociation::strict);
+        CHECK(tep.get_reassociation() == te_parser::reassociation::strict);
+        CHECK(tep.compile("5+a+5"));
+        // two constants and two operations become one of each
+        CHECK(removedCount() == 2);
+        CHECK(tep.evaluate() == 12);
+        tep.reset_simplification_counts();
+        CHECK(tep.compile("2*a*3*b*4"));
+        CHECK(removedCount() == 4);
+        CHECK(tep.evaluate() == 144);
+        // not integers, so left alone
+        tep.reset_simplification_counts();
+        CHECK(tep.compile("a+0.1+0.2"));
+        CHECK(removedCount() == 0);
+        // the other terms keep their grouping
+        CHECK(tep.compile("a+(b+5)+5"));
+        CHECK(removedCount() == 0);
+        // -0 is kept
+        a = -0.0;
+        CHECK(tep.compile("a+5-5"));
+        CHECK_FALSE(std::signbit(tep.evaluate()));
+        CHECK(tepNone.compile("a+(-0)+(-0)"));
+        CHECK(tep.compile("a+(-0)+(-0)"));
+        CHECK(std::signbit(tepNone.evaluate()));
+        CHECK(std::signbit(tep.evaluate()));
+        // exact constants around an inexact term still round differently
+        a = 3;
+        CHECK(tepNone.compile("a/9+1+-1"));
+        CHECK(tep.compile("a/9+1+-1"));
+        CHECK(tep.evaluate() == a / 9);
+        CHECK(tepNone.evaluate() != tep.evaluate());
+        checkResults();
+        }
+    SECTION("Relaxed")
+        {
+        tep.set_reassociation(te_parser::reassociation::relaxed);
+        CHECK(tep.compile("a+0.1+0.2"));
+        CHECK(removedCount() == 2);
+        CHECK_THAT(tep.evaluate(), Catch::Matchers::WithinRel(static_cast<te_type>(2.3),
+                                                              static_cast<te_type>(1e-6)));
+        tep.reset_simplification_counts();
+        CHECK(tep.compile("a+(b+5)+5"));
+        CHECK(removedCount() == 2);
+        CHECK(tep.evaluate() == 15);
+        tep.reset_simplification_counts();
+        CHECK(tep.compile("a+5-5"));
+        CHECK(removedCount() == 4);
+        CHECK(tep.evaluate() == 2);
+        checkResults();
+        }
+    SECTION("Bound variables and incremental compilation")
+        {
+        tep.set_reassociation(te_parser::reassociation::relaxed);
+        te_type otherA{ 10 };
+        CHECK(tep.compile("5+a-b+a+5"));
+        CHECK(tep.get_bound_variable_names() == std::vector<std::string>{ "a", "b" });
+        CHECK(tep.rebind("a", &otherA));
+        CHECK(tep.evaluate() == 27);
+
+        // skipped so that the reparse units stay valid
+        tep.reset_simplification_counts();
+        tep.set_incremental_compilation(true);
+        CHECK(tep.compile("5+a+5"));
+        CHECK(removedCount() == 0);
+        CHECK(tep.evaluate() == 12);
+        }
+    }
+
+TEST_CASE("Short-circuit evaluation", "[lazy]")
+    {
+    te_type x{ 2 };
+    static int callCount{ 0 };
+    callCount = 0;
+    te_parser tep;
+    tep.set_variables_and_functions({ {"x", &x},
+        {"counter", static_cast<te_fun1>([](te_type val)
+            {
+            ++callCount;
+            return val;
+            }), TE_DEFAULT},
+        {"pure_counter", static_cast<te_fun1>([](te_type val)
+            {
+            ++callCount;
+            return val;
+            }), TE_PURE} });
+    const auto nan = std::numeric_limits<te_type>::quiet_NaN();
+
+    SECTION("If")
+        {
+        CHECK(tep.compile("if(x > 0, counter(x), counter(-x))"));
+        CHECK(tep.evaluate() == 2);
+        CHECK(callCount == 1);
+        x = -3;
+        CHECK(tep.evaluate() == 3);
+        CHECK(callCount == 2);
+        // NaN is false
+        x = nan;
+        CHECK(tep.compile("if(x, counter(1), counter(2))"));
+        CHECK(tep.evaluate() == 2);
+        CHECK(callCount == 3);
+        }
+    SECTION("Ifs")
+        {
+        CHECK(tep.compile("ifs(x < 0, counter(1), x < 5, counter(2), x < 10, counter(3))"));
+        CHECK(tep.evaluate() == 2);
+        CHECK(callCount == 1);
+        x = 20;
+        CHECK(std::isnan(tep.evaluate()));
+        CHECK(callCount == 1);
+        x = 7;
+        CHECK(tep.compile("ifs(x < 0, counter(1), x < 10, counter(3))"));
+        CHECK(tep.evaluate() == 3);
+        CHECK(callCount == 2);
+        CHECK(tep.compile("ifs(counter(0), 1, counter(nan), 2, counter(1), 3)"));
+        CHECK(tep.evaluate() == 3);
+        CHECK(callCount == 5);
+        }
+    SECTION("And and or")
+        {
+        CHECK(tep.compile("x < 0 && counter(1)"));
+        CHECK(tep.evaluate() == 0);
+        CHECK(tep.compile("x > 0 || counter(1)"));
+        CHECK(tep.evaluate() == 1);
+        CHECK(tep.compile("and(x < 0, counter(1), counter(1))"));
+        CHECK(tep.evaluate() == 0);
+        CHECK(tep.compile("or(x > 0, counter(1), counter(1))"));
+        CHECK(tep.evaluate() == 1);
+        CHECK(callCount == 0);
+        CHECK(tep.compile("and(x > 0, counter(1), counter(0), counter(1))"));
+        CHECK(tep.evaluate() == 0);
+        CHECK(callCount == 2);
+        CHECK(tep.compile("or(x < 0, counter(0), counter(1), counter(1))"));
+        CHECK(tep.evaluate() == 1);
+        CHECK(callCount == 4);
+        CHECK(tep.compile("x > 0 && counter(0)"));
+        CHECK(tep.evaluate() == 0);
+        CHECK(callCount == 5);
+        }
+    SECTION("NaN handling is unchanged")
+        {
+        const std::vector<te_type> values{ 0, 1, nan, std::numeric_limits<te_type>::infinity() };
+        for (const auto first : values)
+            {
+            for (const auto second : values)
+                {
+                CAPTURE(first, second);
+                te_type a{ first }, b{ second }, c{ nan };
+                te_parser logic;
+                logic.set_variables_and_functions({ {"a", &a}, {"b", &b}, {"c", &c} });
+                const auto sameAs = [&logic](const std::string& expression, const te_type expected)
+                    {
+                    CAPTURE(expression);
+                    const auto result = logic.evaluate(expression);
+                    CHECK((result == expected || (std::isnan(result) && std::isnan(expected))));
+                    };
+                const auto toBool = [](const te_type val)
+                    { return te_parser::double_to_bool(val); };
+                const bool bothInvalid = !std::isfinite(first) && !std::isfinite(second);
+                sameAs("a && b", bothInvalid ? nan : (toBool(first) && toBool(second)));
+                sameAs("a || b", bothInvalid ? nan : (toBool(first) || toBool(second)));
+                sameAs("and(a, b, c)",
+                       !std::isfinite(first) ? nan :
+                       std::isfinite(second) ? (toBool(first) && toBool(second)) : toBool(first));
+                sameAs("or(a, c, b)",
+                       !std::isfinite(first) ? nan :
+                       std::isfinite(second) ? (toBool(first) || toBool(second)) : toBool(first));
+                sameAs("if(a, b, 5)", toBool(first) ? second : 5);
+                sameAs("ifs(a, 1, b, 2)", toBool(first) ? 1 : toBool(second) ? 2 : nan);
+                }
+            }
+        }
+    SECTION("Shared subexpressions stay lazy")
+        {
+        tep.set_common_subexpression_elimination(true);
+        x = -1;
+        CHECK(tep.compile("if(x > 0, pure_counter(x)*2 + pure_counter(x)*2, 0) + sin(x)*sin(x)"));
+        CHECK_THAT(tep.evaluate(), Catch::Matchers::WithinRel(std::sin(x) * std::sin(x)));
+        CHECK(callCount == 0);
+        x = 1;
+        CHECK_THAT(tep.evaluate(), Catch::Matchers::WithinRel(4 + std::sin(x) * std::sin(x)));
+        CHECK(callCount == 2);
+        }
+    }
+
+TEST_CASE("Variadic argument counts", "[variadic]")
+    {
+    te_type a{ 2 }, b{ 3 }, c{ 5 };
+    te_parser tep;
+    static int callCount{ 0 };
+    callCount = 0;
+    tep.set_variables_and_functions({ {"a", &a}, {"b", &b}, {"c", &c},
+        {"counter", static_cast<te_fun1>([](te_type val)
+            {
+            ++callCount;
+            return val;
+            }), TE_DEFAULT},
+        // returns the number of valid arguments, with the first argument's value
+        // as the fractional part
+        {"valid_count", static_cast<te_fun7>([](te_type v1, te_type v2, te_type v3, te_type v4,
+                                                 te_type v5, te_type v6, te_type v7)
+            {
+            te_type count{ 0 };
+            for (const auto value : { v1, v2, v3, v4, v5, v6, v7 })
+                {
+                count += std::isfinite(value) ? 1 : 0;
+                }
+            return count + (v1 / 10);
+            }), static_cast<te_variable_flags>(TE_PURE | TE_VARIADIC)} });
+
+    SECTION("Same results as passing NaN for the unused arguments")
+        {
+        const auto nan = std::numeric_limits<te_type>::quiet_NaN();
+        const auto inf = std::numeric_limits<te_type>::infinity();
+        for (const std::string function : { "sum", "average", "max", "min", "and", "or" })
+            {
+            for (const auto& [aValue, bValue, cValue] :
+                 std::vector<std::tuple<te_type, te_type, te_type>>{
+                     { 2, 3, 5 }, { -2, 0, 0.5 }, { nan, 3, 1 }, { 4, nan, -1 }, { -0.0, 0, -0.0 },
+                     { inf, -inf, 7 }, { nan, nan, nan }, { 0, 0, 0 } })
+                {
+                a = aValue;
+                b = bValue;
+                c = cValue;
+                for (const std::string arguments :
+                     { "a", "a,b", "a,b,c", "a,b,c,a", "a,b,c,a,b", "a,b,c,a,b,c" })
+                    {
+                    const std::string call{ function + "(" + arguments + ")" };
+                    CAPTURE(call, aValue, bValue, cValue);
+                    std::string padded{ function + "(" + arguments };
+                    for (auto argumentCount = std::count(arguments.cbegin(), arguments.cend(), ',');
+                         argumentCount < 6; ++argumentCount)
+                        {
+                        padded += ",nan";
+                        }
+                    padded += ")";
+                    const auto expected = tep.evaluate(padded);
+                    const auto result = tep.evaluate(call);
+                    CHECK((result == expected || (std::isnan(result) && std::isnan(expected))));
+                    CHECK(std::signbit(result) == std::signbit(expected));
+                    }
+                }
+            }
+        }
+    SECTION("Unused arguments aren't evaluated")
+        {
+        CHECK(tep.evaluate("max(counter(a), b)") == 3);
+        CHECK(callCount == 1);
+        CHECK(tep.evaluate("sum(counter(a), b, counter(c))") == 10);
+        CHECK(callCount == 3);
+        }
+    SECTION("Custom variadic functions")
+        {
+        CHECK(tep.evaluate("valid_count(a)") == 1.2);
+        CHECK(tep.evaluate("valid_count(a, b, c)") == 3.2);
+        CHECK(tep.evaluate("valid_count(a, b, c, a, b, c, a)") == 7.2);
+        CHECK(tep.compile("valid_count(a, b) + sum(a, b)"));
+        CHECK(tep.evaluate() == 7.2);
+        b = std::numeric_limits<te_type>::quiet_NaN();
+        CHECK(tep.evaluate() == 3.2);
+        }
+    SECTION("Incremental compilation")
+        {
+        tep.set_incremental_compilation(true);
+        CHECK(tep.compile("max(a, b) + valid_count(c, a)"));
+        CHECK(tep.evaluate() == 5.5);
+        CHECK(tep.recompile(4, 1, "c"));
+        CHECK(tep.evaluate() == 7.5);
+        CHECK(tep.recompile(24, 1, "b"));
+        CHECK(tep.evaluate() == 7.3);
+        }
+    }
+
+TEST_CASE("Incremental evaluation", "[dirty]")
+    {
+    te_type x{ 2 }, y{ 3 }, z{ 4 };
+    static int pureCount{ 0 };
+    static int impureCount{ 0 };
+    pureCount = impureCount = 0;
+    te_parser tep;
+    tep.set_variables_and_functions({ {"x", &x}, {"y", &y}, {"z", &z},
+        {"pure", static_cast<te_fun1>([](te_type val)
+            {
+            ++pureCount;
+            return val;
+            }), TE_PURE},
+        {"impure", static_cast<te_fun1>([](te_type val)
+            {
+            ++impureCount;
+            return val;
+            }), TE_DEFAULT} });
+    CHECK_FALSE(tep.is_incremental_evaluation_enabled());
+    tep.set_incremental_evaluation(true);
+    CHECK(tep.is_incremental_evaluation_enabled());
+
+    SECTION("Only dirty paths are evaluated")
+        {
+        CHECK(tep.compile("pure(x) + pure(y) * pure(z)"));
+        CHECK(tep.evaluate() == 14);
+        CHECK(pureCount == 3);
+        // nothing changed
+        CHECK(tep.evaluate() == 14);
+        CHECK(pureCount == 3);
+        y = 10;
+        CHECK(tep.mark_variable_dirty("Y"));
+        CHECK(tep.evaluate() == 42);
+        CHECK(pureCount == 4);
+        // not marked, so not seen
+        x = 100;
+        CHECK(tep.evaluate() == 42);
+        CHECK(tep.mark_variable_dirty("x"));
+        CHECK(tep.evaluate() == 140);
+        CHECK(pureCount == 5);
+        CHECK_FALSE(tep.mark_variable_dirty("w"));
+        }
+    SECTION("Impure functions are always evaluated")
+        {
+        CHECK(tep.compile("pure(x) + impure(y) + pure(z)"));
+        CHECK(tep.evaluate() == 9);
+        CHECK(tep.evaluate() == 9);
+        CHECK(pureCount == 2);
+        CHECK(impureCount == 2);
+        }
+    SECTION("Impure closures are always evaluated")
+        {
+        te_expr_array teArray{ TE_DEFAULT };
+        auto variables = tep.get_variables_and_functions();
+        variables.insert({ "cell", cell, TE_DEFAULT, &teArray });
+        variables.insert({ "cellmax", cell_max, TE_DEFAULT, &teArray });
+        tep.set_variables_and_functions(variables);
+        CHECK(tep.compile("pure(cell(x)) + cellmax() + pure(y)"));
+        CHECK(tep.evaluate() == 19);
+        CHECK(pureCount == 2);
+        // the closures' data changed, but no variable was marked as dirty
+        teArray.m_data = { 1, 2, 3, 4, 10 };
+        CHECK(tep.evaluate() == 16);
+        CHECK(pureCount == 3);
+        }
+    SECTION("Branches that weren't taken")
+        {
+        CHECK(tep.compile("if(x > 0, pure(y), pure(z))"));
+        CHECK(tep.evaluate() == 3);
+        CHECK(pureCount == 1);
+        z = 8;
+        CHECK(tep.mark_variable_dirty("z"));
+        CHECK(tep.evaluate() == 3);
+        CHECK(pureCount == 1);
+        x = -1;
+        CHECK(tep.mark_variable_dirty("x"));
+        CHECK(tep.evaluate() == 8);
+        CHECK(pureCount == 2);
+        // z is changed again while its branch isn't taken
+        x = 1;
+        CHECK(tep.mark_variable_dirty("x"));
+        CHECK(tep.evaluate() == 3);
+        z = 16;
+        CHECK(tep.mark_variable_dirty("z"));
+        CHECK(tep.evaluate() == 3);
+        x = -1;
+        CHECK(tep.mark_variable_dirty("x"));
+        CHECK(tep.evaluate() == 16);
+        }
+    SECTION("Shared subexpressions")
+        {
+        tep.set_common_subexpression_elimination(true);
+        CHECK(tep.compile("pure(x+y) * pure(x+y) + pure(z) / pure(z)"));
+        CHECK(tep.evaluate() == 26);
+        CHECK(pureCount == 2);
+        z = 2;
+        CHECK(tep.mark_variable_dirty("z"));
+        CHECK(tep.evaluate() == 26);
+        CHECK(pureCount == 3);
+        x = 3;
+        CHECK(tep.mark_variable_dirty("x"));
+        CHECK(tep.evaluate() == 37);
+        CHECK(pureCount == 4);
+        }
+    SECTION("Rebinding and recompiling")
+        {
+        te_type otherY{ 20 };
+        // (so that rebinding doesn't need to copy the compiled expression)
+        tep.set_expression_cache_size(0);
+        CHECK(tep.compile("pure(x) + pure(y)"));
+        CHECK(tep.evaluate() == 5);
+        CHECK(tep.rebind("y", &otherY));
+        CHECK(tep.evaluate() == 22);
+        CHECK(pureCount == 3);
+        tep.rebind_all({ &y, &z });
+        CHECK(tep.evaluate() == 7);
+
+        tep.set_incremental_compilation(true);
+        CHECK(tep.compile("pure(x) + pure(y)"));
+        CHECK(tep.evaluate() == 5);
+        CHECK(tep.recompile(15, 1, "z"));
+        CHECK(tep.evaluate() == 6);
+        }
+    SECTION("Same results as a full evaluation")
+        {
+        te_parser full;
+        full.set_variables_and_functions(tep.get_variables_and_functions());
+        for (const auto* expression :
+             { "sqrt(x^2 + y^2) * if(x > y, 1, -1) + z", "sum(x, y, z) / max(x, y, z)",
+               "x && y || z", "ifs(x < 0, y, x < 5, z, 1, x*y*z)", "(x+y+z)^2 - x*y*z" })
+            {
+            CAPTURE(expression);
+            CHECK(tep.compile(expression));
+            CHECK(full.compile(expression));
+            for (const auto& [name, variable] :
+                 std::vector<std::pair<std::string, te_type*>>{ { "x", &x }, { "y", &y },
+                                                                { "z", &z }, { "x", &x } })
+                {
+                for (const te_type value : { -3.0, 0.0, 2.5, 7.0 })
+                    {
+                    *variable = value;
+                    CHECK(tep.mark_variable_dirty(name));
+                    CHECK(tep.evaluate() == full.evaluate());
+                    }
+                }
+            }
+        }
+    }
+
+TEST_CASE("Optimization levels", "[optimization]")
+    {
+    te_type a{ 2 };
+    te_parser tep;
+    tep.set_variables_and_functions({ {"a", &a} });
+    CHECK(tep.get_optimization_level() == te_parser::optimization_level::basic);
+    CHECK(tep.is_constant_folding_enabled());
+
+    const auto passNames = [&tep]()
+        {
+        std::vector<std::string> names;
+        for (const auto& pass : tep.get_optimization_report())
+            {
+            names.push_back(pass.m_name);
+            }
+        return names;
+        };
+    const auto passChanged = [&tep](const std::string_view name)
+        {
+        for (const auto& pass : tep.get_optimization_report())
+            {
+            if (pass.m_name == name)
+                {
+                CHECK(pass.m_duration.count() >= 0);
+                return pass.m_changed;
+                }
+            }
+        return false;
+        };
+    const std::string formula{ "(5+a+5)*(2*3) + (a+1)*(a+1) + a^2*1 + 0*a" };
+
+    SECTION("None")
+        {
+        tep.set_optimization_level(te_parser::optimization_level::none);
+        CHECK_FALSE(tep.is_constant_folding_enabled());
+        CHECK(tep.get_simplification() == te_parser::simplification::none);
+        CHECK(tep.compile(formula));
+        CHECK(tep.evaluate() == 85);
+        CHECK(passNames().empty());
+        CHECK(tep.compile("2*3"));
+        CHECK(tep.evaluate() == 6);
+        }
+    SECTION("Basic")
+        {
+        CHECK(tep.compile(formula));
+        CHECK(tep.evaluate() == 85);
+        CHECK(passNames() == std::vector<std::string>{ "constant folding", "simplification",
+                                                       "integer evaluation" });
+        CHECK(passChanged("constant folding"));
+        CHECK(passChanged("simplification"));
+        CHECK(tep.compile("a"));
+        CHECK(passNames() == std::vector<std::string>{ "constant folding", "simplification",
+                                                       "integer evaluation" });
+        CHECK_FALSE(passChanged("constant folding"));
+        CHECK_FALSE(passChanged("simplification"));
+        }
+    SECTION("Standard")
+        {
+        tep.set_optimization_level(te_parser::optimization_level::standard);
+        CHECK(tep.get_reassociation() == te_parser::reassociation::none);
+        CHECK(tep.is_common_subexpression_elimination_enabled());
+        CHECK(tep.compile(formula));
+        CHECK(tep.evaluate() == 85);
+        CHECK(passNames() == std::vector<std::string>{ "constant folding", "simplification",
+                                                       "integer evaluation",
+                                                       "common subexpression elimination" });
+        CHECK(passChanged("common subexpression elimination"));
+        // regrouping can change results (e.g., 3/9+1+-1), so it is left out of O2
+        a = 3;
+        CHECK(tep.compile("a/9+1+-1"));
+        te_parser tepNone;
+        tepNone.set_variables_and_functions({ { "a", &a } });
+        CHECK(tepNone.compile("a/9+1+-1"));
+        CHECK(tep.evaluate() == tepNone.evaluate());
+        }
+    SECTION("Aggressive")
+        {
+        tep.set_optimization_level(te_parser::optimization_level::aggressive);
+        CHECK(tep.get_simplification() == te_parser::simplification::fast_math);
+        CHECK(tep.get_reassociation() == te_parser::reassociation::relaxed);
+        CHECK(tep.compile(formula));
+        CHECK(tep.evaluate() == 85);
+        CHECK(passNames().size() == 5);
+        }
+    SECTION("Individual passes")
+        {
+        tep.set_optimization_level(te_parser::optimization_level::aggressive);
+        tep.set_constant_folding(false);
+        tep.set_common_subexpression_elimination(false);
+        CHECK(tep.get_optimization_level() == te_parser::optimization_level::aggressive);
+        CHECK(tep.compile("2*3 + a*0"));
+        CHECK(passNames() == std::vector<std::string>{ "reassociation", "simplification",
+                                                       "integer evaluation" });
+        CHECK(tep.evaluate() == 6);
+        // a*0 is still simplified
+        CHECK(passChanged("simplification"));
+        tep.set_constant_folding(true);
+        CHECK(tep.compile("2*3 + a*0"));
+        CHECK(passChanged("constant folding"));
+        CHECK(passChanged("simplification"));
+        }
+    SECTION("Cached expressions aren't optimized again")
+        {
+        CHECK(tep.evaluate("a+1") == 3);
+        CHECK(passNames().size() == 3);
+        CHECK(tep.evaluate("a+2") == 4);
+        CHECK(tep.evaluate("a+1") == 3);
+        CHECK(passNames().empty());
+        }
+    }
+
+#if __cplusplus >= 202002L && !defined(TE_FLOAT)
+TEST_CASE("Integer evaluation", "[integer]")
+    {
+    te_type a{ 0 }, b{ 0 }, c{ 0 };
+    te_parser tep;
+    tep.set_variables_and_functions({ {"a", &a}, {"b", &b}, {"c", &c} });
+    CHECK(tep.is_integer_evaluation_enabled());
+    // the bitwise operations evaluated one at a time
+    te_parser tepReference;
+    tepReference.set_integer_evaluation(false);
+    tepReference.set_variables_and_functions({ {"a", &a}, {"b", &b}, {"c", &c} });
+
+    const auto integerEvaluated = [&tep]()
+        {
+        for (const auto& pass : tep.get_optimization_report())
+            {
+            if (pass.m_name == "integer evaluation")
+                {
+                return pass.m_changed;
+                }
+            }
+        return false;
+        };
+
+    SECTION("Only nested operations")
+        {
+        CHECK(tep.compile("bitor(a << 8, b)"));
+        CHECK(integerEvaluated());
+        CHECK(tep.compile("bitor(bitand(a, 240) >> 4, bitlshift(b, c))"));
+        CHECK(integerEvaluated());
+        CHECK(tep.compile("sqrt(a << 8) + (b >> 2)"));
+        CHECK_FALSE(integerEvaluated());
+        CHECK(tep.compile("a << 8"));
+        CHECK_FALSE(integerEvaluated());
+        CHECK(tep.compile("bitor(5, 8) << 1"));
+        CHECK_FALSE(integerEvaluated());
+        CHECK(tep.evaluate() == 26);
+        }
+    SECTION("Same results and errors")
+        {
+        const std::vector<std::string> formulas{
+            "bitor(a << 8, b)",
+            "bitxor((a >> 4), bitnot8(b)) + 1",
+            "bitor(bitlshift(a, c), bitrshift(b, c))",
+            "bitor(bitand(a, b), bitxor(a, c))",
+            "(a << 40) << c",
+            "(a >> c) >> b",
+            "bitlrotate8(bitand(a, 255), c) <<< b",
+            "bitnot16(bitnot8(a)) >>> c",
+            "bitnot(bitnot32(a))",
+            "sqrt(bitor(a, b) << 1) + bitand(a, bitor(b, 1))",
+            "if(a > 4, bitor(a, b) >> 1, c)"
+        };
+        const std::vector<te_type> values{ 0, 1, 3, 5, 8, 255, 256, 281474976710655, -1, 2.5,
+                                           std::numeric_limits<te_type>::quiet_NaN() };
+
+        for (const auto& formula : formulas)
+            {
+            CHECK(tep.compile(formula));
+            CHECK(tepReference.compile(formula));
+            for (const auto aValue : values)
+                {
+                for (const auto bValue : values)
+                    {
+                    for (const te_type cValue : { 0.0, 1.0, 3.0, -2.0, 60.0, 8.5 })
+                        {
+                        a = aValue;
+                        b = bValue;
+                        c = cValue;
+                        const auto result = tep.evaluate();
+                        const auto expected = tepReference.evaluate();
+                        if (std::isnan(expected))
+                            {
+                            CHECK(std::isnan(result));
+                            CHECK(tep.get_last_error_message() ==
+                                  tepReference.get_last_error_message());
+                            }
+                        else
+                            {
+                            CHECK(result == expected);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    SECTION("Disabled")
+        {
+        tep.set_integer_evaluation(false);
+        CHECK(tep.compile("bitor(a << 8, b)"));
+        CHECK(tep.get_optimization_report().size() == 2);
+        tep.set_optimization_level(te_parser::optimization_level::none);
+        CHECK_FALSE(tep.is_integer_evaluation_enabled());
+        tep.set_optimization_level(te_parser::optimization_level::basic);
+        CHECK(tep.is_integer_evaluation_enabled());
+        }
+    }
+#endif
+
+TEST_CASE("Programs", "[program]")
+    {
+    te_type a{ 2 }, b{ 3 };
+    te_parser tep;
+    tep.set_variables_and_functions({ {"a", &a}, {"b", &b} });
+
+    SECTION("Compiling")
+        {
+        CHECK(tep.compile_program("a+") == nullptr);
+        CHECK_FALSE(tep.success());
+        CHECK(tep.get_last_error_position() == 1);
+
+        const auto program = tep.compile_program("b*a + 1");
+        REQUIRE(program != nullptr);
+        CHECK(program->get_expression() == "b*a + 1");
+        CHECK(program->get_bound_variable_names() == std::vector<std::string>{ "b", "a" });
+        CHECK(program->evaluate().m_value == 7);
+        a = 5;
+        CHECK(program->evaluate().m_value == 16);
+        // the program doesn't change when the parser does
+        CHECK(tep.compile("a-b"));
+        CHECK(program->evaluate().m_value == 16);
+        tep.rebind("a", &b);
+        CHECK(program->evaluate().m_value == 16);
+        }
+    SECTION("Errors are returned")
+        {
+        const auto program = tep.compile_program("bitand(a, 1)");
+        REQUIRE(program != nullptr);
+        auto result = program->evaluate();
+        CHECK(result.m_success);
+        CHECK(result.m_value == 0);
+        CHECK(result.m_errorMessage.empty());
+        a = -1;
+        result = program->evaluate();
+        CHECK_FALSE(result.m_success);
+        CHECK(std::isnan(result.m_value));
+        CHECK(result.m_errorMessage == "Bitwise AND operation must use positive integers.");
+        // the parser isn't affected
+        CHECK(tep.success());
+        CHECK(tep.get_last_error_message().empty());
+        a = 3;
+        CHECK(program->evaluate().m_success);
+        }
+    SECTION("Common subexpressions")
+        {
+        tep.set_common_subexpression_elimination(true);
+        const auto program = tep.compile_program("sqrt(a*b+1) + sqrt(a*b+1)/(a*b+1)");
+        REQUIRE(program != nullptr);
+        CHECK(program->evaluate().m_value == tep.evaluate());
+        a = 8;
+        CHECK(program->evaluate().m_value == 5 + 5.0 / 25);
+        CHECK(tep.evaluate("a*b") == 24);
+        CHECK(program->evaluate().m_value == 5 + 5.0 / 25);
+        }
+    SECTION("Threads")
+        {
+        tep.set_common_subexpression_elimination(true);
+        const auto program = tep.compile_program("(a+b)^2 + (a+b)*2 + if(rand() < 2, 1, 0)");
+        REQUIRE(program != nullptr);
+        std::vector<std::thread> threads;
+        std::atomic<size_t> failures{ 0 };
+        for (size_t i = 0; i < 8; ++i)
+            {
+            threads.emplace_back(
+                [&program, &failures]()
+                {
+                    for (size_t j = 0; j < 1'000; ++j)
+                        {
+                        const auto result = program->evaluate();
+                        if (!result.m_success || result.m_value != 36)
+                            {
+                            ++failures;
+                            }
+                        }
+                });
+            }
+        for (auto& thread : threads)
+            {
+            thread.join();
+            }
+        CHECK(failures == 0);
+        }
+    SECTION("Evaluation contexts")
+        {
+        tep.set_common_subexpression_elimination(true);
+        const auto program = tep.compile_program("(b-a)^2 + sqrt((b-a)^2) + A");
+        REQUIRE(program != nullptr);
+        CHECK(program->get_bound_variable_names() == std::vector<std::string>{ "b", "a" });
+        CHECK(program->get_variable_slot("a") == 1);
+        CHECK(program->get_variable_slot("B") == 0);
+        CHECK(program->get_variable_slot("c") == te_program::npos);
+        // the bound variables are used when no values are passed
+        CHECK(program->evaluate().m_value == 4);
+        CHECK(program->evaluate(std::vector<te_type>{ 10, 6 }).m_value == 26);
+        CHECK(a == 2);
+        CHECK(b == 3);
+        CHECK(program->evaluate().m_value == 4);
+
+        const auto wrongCount = program->evaluate(std::vector<te_type>{ 1 });
+        CHECK_FALSE(wrongCount.m_success);
+        CHECK(std::isnan(wrongCount.m_value));
+
+        const auto noVariables = tep.compile_program("5*2");
+        REQUIRE(noVariables != nullptr);
+        CHECK(noVariables->evaluate(std::vector<te_type>{}).m_value == 10);
+        CHECK_FALSE(noVariables->evaluate(std::vector<te_type>{ 1 }).m_success);
+
+        // each thread evaluates its own rows
+        std::vector<std::thread> threads;
+        std::atomic<size_t> failures{ 0 };
+        for (size_t i = 0; i < 8; ++i)
+            {
+            threads.emplace_back(
+                [&program, &failures, i]()
+                {
+                    for (size_t j = 0; j < 1'000; ++j)
+                        {
+                        const std::vector<te_type> row{ static_cast<te_type>(i + j + 3),
+                                                        static_cast<te_type>(j) };
+                        const auto result = program->evaluate(row);
+                        const te_type difference = static_cast<te_type>(i + 3);
+                        if (!result.m_success ||
+                            result.m_value != difference * difference + difference + j)
+                            {
+                            ++failures;
+                            }
+                        }
+                });
+            }
+        for (auto& thread : threads)
+            {
+            thread.join();
+            }
+        CHECK(failures == 0);
+        }
+    SECTION("Rows")
+        {
+        tep.set_common_subexpression_elimination(true);
+        // b, a
+        const auto program = tep.compile_program("bitand(b, 255) + (b-a)^2 + sqrt((b-a)^2)");
+        REQUIRE(program != nullptr);
+        constexpr size_t rowCount{ 10'000 };
+        std::vector<te_type> rows;
+        for (size_t i = 0; i < rowCount; ++i)
+            {
+            rows.push_back(static_cast<te_type>(i));
+            rows.push_back(static_cast<te_type>(i + (i % 5)));
+            }
+        // a negative value makes these rows fail
+        rows[2 * 7'001] = -1;
+        rows[2 * 501] = -1;
+
+        std::vector<te_type> expected;
+        const auto singleThreaded = program->evaluate_rows(rows, expected);
+        REQUIRE(expected.size() == rowCount);
+        CHECK(singleThreaded.m_failedRows == 2);
+        CHECK(singleThreaded.m_firstFailedRow == 501);
+        CHECK(singleThreaded.m_errorMessage ==
+              "Bitwise AND operation must use positive integers.");
+        CHECK(std::isnan(expected[501]));
+        CHECK(std::isnan(expected[7'001]));
+        CHECK(expected[12] == (12 & 255) + 4 + 2);
+        CHECK(expected[9'999] == (9'999 & 255) + 16 + 4);
+        // the bound variables aren't changed
+        CHECK(a == 2);
+        CHECK(b == 3);
+
+        for (const size_t threadCount : { 2, 3, 8 })
+            {
+            te_program::batch_options options;
+            options.m_threadCount = threadCount;
+            options.m_rowsPerChunk = 97;
+            options.m_pinThreads = (threadCount == 2);
+            std::vector<te_type> results;
+            const auto multiThreaded = program->evaluate_rows(rows, results, options);
+            CHECK(multiThreaded.m_failedRows == 2);
+            CHECK(multiThreaded.m_firstFailedRow == 501);
+            CHECK(multiThreaded.m_errorMessage == singleThreaded.m_errorMessage);
+            REQUIRE(results.size() == rowCount);
+            CHECK(std::equal(results.cbegin(), results.cend(), expected.cbegin(), expected.cend(),
+                             [](const auto lhv, const auto rhv)
+                             { return (lhv == rhv) || (std::isnan(lhv) && std::isnan(rhv)); }));
+            }
+
+        std::vector<te_type> results;
+        CHECK_THROWS(program->evaluate_rows(std::vector<te_type>{ 1, 2, 3 }, results));
+        CHECK(program->evaluate_rows(std::vector<te_type>{}, results).m_failedRows == 0);
+        CHECK(results.empty());
+
+        // without variables, each result is evaluated
+        const auto noVariables = tep.compile_program("5*2");
+        REQUIRE(noVariables != nullptr);
+        results.resize(3);
+        CHECK(noVariables->evaluate_rows(std::vector<te_type>{}, results).m_failedRows == 0);
+        CHECK(results == std::vector<te_type>{ 10, 10, 10 });
+        }
+    }
+
+TEST_CASE("Formula sets", "[formulaset]")
+    {
+    te_type a{ 2 }, b{ 3 };
+    te_parser tep;
+    tep.set_variables_and_functions({ {"a", &a}, {"b", &b} });
+
+    SECTION("Costs")
+        {
+        const auto cheap = tep.compile_program("a");
+        const auto expensive = tep.compile_program("sqrt(a+b) * sin(a) + cos(b) - a*b");
+        REQUIRE(cheap != nullptr);
+        REQUIRE(expensive != nullptr);
+        CHECK(cheap->get_estimated_cost() == 1);
+        CHECK(expensive->get_estimated_cost() > 10 * cheap->get_estimated_cost());
+        }
+    SECTION("Evaluating")
+        {
+        te_formula_set formulas(4);
+        CHECK(formulas.get_thread_count() == 4);
+        CHECK(formulas.evaluate().m_failedPrograms == 0);
+        CHECK(formulas.get_results().empty());
+        CHECK_THROWS(formulas.add(tep.compile_program("a+")));
+
+        // programs with very different costs
+        std::vector<te_type> expected;
+        for (size_t i = 0; i < 2'000; ++i)
+            {
+            std::string formula = "a*" + std::to_string(i);
+            for (size_t j = 0; j < (i % 50); ++j)
+                {
+                formula += "+sqrt(b*" + std::to_string(j) + ")";
+                }
+            te_parser verifier;
+            verifier.set_variables_and_functions({ {"a", &a}, {"b", &b} });
+            expected.push_back(verifier.evaluate(formula));
+            CHECK(formulas.add(tep.compile_program(formula)) == i);
+            }
+        CHECK(formulas.add(tep.compile_program("bitand(a, 1)")) == 2'000);
+        expected.push_back(0);
+        CHECK(formulas.size() == 2'001);
+
+        const auto& tick = formulas.evaluate();
+        CHECK(tick.m_failedPrograms == 0);
+        CHECK(tick.m_threadCount == 4);
+        CHECK(formulas.get_results() == expected);
+
+        // errors are reported for each program
+        a = -1;
+        formulas.set_thread_count(3);
+        CHECK(formulas.evaluate().m_failedPrograms == 1);
+        CHECK(formulas.get_failed_programs() == std::vector<size_t>{ 2'000 });
+        CHECK(std::isnan(formulas.get_results().back()));
+        CHECK(formulas.get_results()[1] == -1);
+        CHECK(formulas.get_last_tick().m_threadCount == 3);
+
+        CHECK(formulas.get_tick_count() == 3);
+        CHECK(formulas.get_max_latency() >= formulas.get_last_tick().m_latency);
+        CHECK(formulas.get_mean_latency() <= formulas.get_max_latency());
+        }
+    }
+
+TEST_CASE("Variable stores", "[store]")
+    {
+    te_variable_store store({ "bid", "ask", "Volume" });
+
+    SECTION("Slots")
+        {
+        CHECK(store.size() == 3);
+        CHECK(store.get_slot("ASK") == 1);
+        CHECK(store.get_slot("volume") == 2);
+        CHECK(store.get_slot("last") == te_variable_store::npos);
+        CHECK(store.get_values() == std::vector<te_type>{ 0, 0, 0 });
+        CHECK(store.get_version() == 0);
+        CHECK_THROWS(te_variable_store({ "a", "b", "A" }));
+        }
+    SECTION("Updates")
+        {
+            {
+            te_variable_store::update update(store);
+            update.set("bid", 99.5);
+            update.set(1, 100.5);
+            CHECK_THROWS(update.set("last", 1));
+            CHECK_THROWS(update.set(3, 1));
+            }
+        CHECK(store.get_version() == 1);
+        store.set(2, 1'000);
+        CHECK(store.get_version() == 2);
+        CHECK(store.get_values() == std::vector<te_type>{ 99.5, 100.5, 1'000 });
+        CHECK_THROWS(store.set(te_variable_store::npos, 1));
+        CHECK(store.get_values() == std::vector<te_type>{ 99.5, 100.5, 1'000 });
+        }
+    SECTION("Binding")
+        {
+        te_parser tep;
+        auto variables = store.get_variables();
+        te_type fee{ 0.5 };
+        variables.insert({ "fee", &fee });
+        tep.set_variables_and_functions(variables);
+        CHECK(tep.compile("(ask - bid) + fee"));
+        CHECK(tep.evaluate() == 0.5);
+            {
+            te_variable_store::update update(store);
+            update.set("bid", 99.5);
+            update.set("ask", 100.5);
+            }
+        // the variables aren't folded into constants
+        CHECK(tep.evaluate() == 1.5);
+        CHECK(tep.evaluate("bid * 2") == 199);
+
+        const auto program = tep.compile_program("ask - bid");
+        REQUIRE(program != nullptr);
+        store.set(1, 101.5);
+        CHECK(program->evaluate().m_value == 2);
+
+        // incremental evaluation always reads the store again
+        tep.set_incremental_evaluation(true);
+        CHECK(tep.compile("ask - bid + fee"));
+        CHECK(tep.evaluate() == 2.5);
+        store.set(0, 100.5);
+        CHECK(tep.evaluate() == 1.5);
+        }
+    SECTION("Consistent snapshots")
+        {
+        // the writer keeps bid and ask (and volume) summing to zero,
+        // so an evaluation that sees part of an update won't be zero
+        te_parser tep;
+        tep.set_variables_and_functions(store.get_variables());
+        const auto program = tep.compile_program("bid + ask + volume");
+        REQUIRE(program != nullptr);
+
+        std::atomic<bool> done{ false };
+        std::atomic<size_t> inconsistent{ 0 };
+        std::vector<std::thread> evaluators;
+        for (size_t i = 0; i < 4; ++i)
+            {
+            evaluators.emplace_back(
+                [&]()
+                {
+                    while (!done)
+                        {
+                        if (program->evaluate().m_value != 0)
+                            {
+                            ++inconsistent;
+                            }
+                        }
+                });
+            }
+        for (size_t i = 1; i <= 20'000; ++i)
+            {
+            te_variable_store::update update(store);
+            update.set(0, static_cast<te_type>(i));
+            update.set(1, -static_cast<te_type>(i) * 2);
+            update.set(2, static_cast<te_type>(i));
+            }
+        done = true;
+        for (auto& evaluator : evaluators)
+            {
+            evaluator.join();
+            }
+        CHECK(inconsistent == 0);
+        CHECK(store.get_version() == 20'000);
+        }
+    }
+
+TEST_CASE("Program handles", "[handle]")
+    {
+    te_type x{ 2 };
+    te_parser tep;
+    tep.set_variables_and_functions({ { "x", &x } });
+
+    SECTION("Publishing")
+        {
+        te_program_handle handle;
+        CHECK(handle.load() == nullptr);
+        CHECK_FALSE(handle.evaluate().m_success);
+        CHECK(std::isnan(handle.evaluate().m_value));
+
+        CHECK(handle.publish(tep.compile_program("x^2")) == nullptr);
+        CHECK(handle.get_version() == 1);
+        CHECK(handle.evaluate().m_value == 4);
+        CHECK(handle.evaluate(std::vector<te_type>{ 3 }).m_value == 9);
+
+        // a program that was loaded before a new one is published is still usable
+        const auto held = handle.load();
+        const auto previous = handle.publish(tep.compile_program("x^3"));
+        CHECK(previous == held);
+        CHECK(handle.get_version() == 2);
+        CHECK(handle.evaluate().m_value == 8);
+        CHECK(held->evaluate().m_value == 4);
+        // recompiling the parser doesn't affect the published program
+        CHECK(tep.compile("x+1"));
+        CHECK(handle.evaluate().m_value == 8);
+        }
+    SECTION("Publishing while evaluating")
+        {
+        // every formula evaluates to its version, so each result must be one that was published
+        te_program_handle handle(tep.compile_program("0 * x"));
+        std::atomic<bool> done{ false };
+        std::atomic<size_t> failures{ 0 };
+        std::vector<std::thread> evaluators;
+        for (size_t i = 0; i < 4; ++i)
+            {
+            evaluators.emplace_back(
+                [&]()
+                {
+                    te_type lastValue{ 0 };
+                    while (!done)
+                        {
+                        const auto result = handle.evaluate();
+                        // versions are only published in order
+                        if (!result.m_success || result.m_value < lastValue)
+                            {
+                            ++failures;
+                            }
+                        lastValue = result.m_value;
+                        }
+                });
+            }
+        for (size_t i = 1; i <= 2'000; ++i)
+            {
+            handle.publish(tep.compile_program(std::to_string(i) + " + 0 * x"));
+            }
+        done = true;
+        for (auto& evaluator : evaluators)
+            {
+            evaluator.join();
+            }
+        CHECK(failures == 0);
+        CHECK(handle.get_version() == 2'000);
+        CHECK(handle.evaluate().m_value == 2'000);
+        }
+    }
+
+TEST_CASE("Benchmarks", "[!benchmark]")
+    {
+    te_type benchmarkVar{ 9 };
+    te_parser tep;
+    tep.set_variables_and_functions({ {"a", &benchmarkVar} });
+
+    te_parser tepNoCache;
+    tepNoCache.set_expression_cache_size(0);
+    tepNoCache.set_variables_and_functions({ {"a", &benchmarkVar} });
+
+    te_parser tepReassociated;
+    tepReassociated.set_reassociation(te_parser::reassociation::strict);
+    tepReassociated.set_variables_and_functions({ {"a", &benchmarkVar} });
+
+    te_parser tepFastMath;
+    tepFastMath.set_simplification(te_parser::simplification::fast_math);
+    tepFastMath.set_variables_and_functions({ {"a", &benchmarkVar} });
+
+    BENCHMARK("a+5 Compiled")
+        { return tep.evaluate("a+5"); };
+    BENCHMARK("a+5 Compiled (no caching)")
+        { return tepNoCache.evaluate("a+5"); };
+    BENCHMARK("a+5 Native")
+        { return bench_a5(benchmarkVar); };
+
+    BENCHMARK("5+a+5 Compiled")
+        { return tep.evaluate("5+a+5"); };
+    BENCHMARK("5+a+5 Compiled (reassociated)")
+        { return tepReassociated.evaluate("5+a+5"); };
+    BENCHMARK("5+a+5 Native")
+        { return bench_a55(benchmarkVar); };
+
+    BENCHMARK("abs(a+5) Compiled")
+        { return tep.evaluate("abs(a+5)"); };
+    BENCHMARK("abs(a+5) Native")
+        { return bench_a5abs(benchmarkVar); };
+
+    BENCHMARK("sqrt(a^1.5+a^2.5) Compiled")
+        { return tep.evaluate("sqrt(a^1.5+a^2.5)"); };
+    BENCHMARK("sqrt(a^1.5+a^2.5) Compiled (fast math)")
+        { return tepFastMath.evaluate("sqrt(a^1.5+a^2.5)"); };
+    BENCHMARK("sqrt(a^1.5+a^2.5) Native")
+        { return bench_as(benchmarkVar); };
+
+    BENCHMARK("a+(5*2) Compiled")
+        { return tep.evaluate("a+(5*2)"); };
+    BENCHMARK("a+(5*2) Native")
+        { return bench_a10(benchmarkVar); };
+
+    BENCHMARK("(a+5)*2 Compiled")
+        { return tep.evaluate("(a+5)*2"); };
+    BENCHMARK("(a+5)*2 Native")
+        { return bench_a52(benchmarkVar); };
+
+    BENCHMARK("(1/(a+1)+2/(a+2)+3/(a+3)) Compiled")
+        { return tep.evaluate("(1/(a+1)+2/(a+2)+3/(a+3))"); };
+    BENCHMARK("(1/(a+1)+2/(a+2)+3/(a+3)) Native")
+        { return bench_al(benchmarkVar); };
+
+    // a ~5,000 character formula, with an edit to a literal in the middle of it
+    std::string longFormula{ "0" };
+    for (size_t i = 0; i < 250; ++i)
+        {
+        longFormula.append("+pow(a*").append(std::to_string(i % 10)).append(", 2)/(a+1)");
+        }
+    te_parser tepIncremental;
+    tepIncremental.set_variables_and_functions({ {"a", &benchmarkVar} });
+    tepIncremental.set_incremental_compilation(true);
+    tepIncremental.compile(longFormula);
+    const auto editPosition = longFormula.find("a*5", longFormula.length() / 2) + 2;
+    size_t editCount{ 0 };
+
+    BENCHMARK("5k-character formula Compiled")
+        { return tepNoCache.compile(longFormula); };
+    BENCHMARK("5k-character formula Validated")
+        { return tepNoCache.validate(longFormula); };
+
+    // a batch of 10,000 formulas
+    std::vector<std::string> batchFormulas;
+    for (size_t i = 0; i < 10'000; ++i)
+        {
+        batchFormulas.push_back("sqrt(a^1.5+a^" + std::to_string(i) + ")+max(a, " +
+                                std::to_string(i) + ")/abs(a-2)");
+        }
+    const std::vector<std::string_view> batch(batchFormulas.cbegin(), batchFormulas.cend());
+
+    BENCHMARK("10k formulas Compiled individually")
+        {
+        size_t compiled{ 0 };
+        for (const auto& formula : batch)
+            {
+            compiled += tepNoCache.compile(formula) ? 1 : 0;
+            }
+        return compiled;
+        };
+    BENCHMARK("10k formulas Compiled as a batch")
+        { return tepNoCache.compile_many(batch).size(); };
+    BENCHMARK("10k formulas Compiled as a batch (4 threads)")
+        { return tepNoCache.compile_many(batch, 4).size(); };
+    BENCHMARK("5k-character formula Recompiled after an edit")
+        { return tepIncremental.recompile(editPosition, 1, std::to_string(++editCount % 10)); };
+
+    // a one-shot formula, compiled with and without optimizations
+    constexpr std::string_view oneShotFormula{
+        "sqrt(a^1.5+a^2.5)*sqrt(a^1.5+a^2.5) + (sin(a)*cos(a))/(1+sin(a)*cos(a)) + 5+a+5" };
+    te_parser tepO0;
+    tepO0.set_variables_and_functions({ {"a", &benchmarkVar} });
+    tepO0.set_optimization_level(te_parser::optimization_level::none);
+    te_parser tepO3;
+    tepO3.set_variables_and_functions({ {"a", &benchmarkVar} });
+    tepO3.set_optimization_level(te_parser::optimization_level::aggressive);
+
+    BENCHMARK("One-shot formula Compiled (O0)")
+        { return tepO0.compile(oneShotFormula); };
+    BENCHMARK("One-shot formula Compiled (O3)")
+        { return tepO3.compile(oneShotFormula); };
+
+    // a formula with repeated subexpressions
+    constexpr std::string_view repeatedFormula{
+        "sqrt(a^1.5+a^2.5)*sqrt(a^1.5+a^2.5) + (sin(a)*cos(a))/(1+sin(a)*cos(a)) + sqrt(a^1.5+a^2.5)" };
+    te_parser tepRepeated;
+    tepRepeated.set_variables_and_functions({ {"a", &benchmarkVar} });
+    [[maybe_unused]] const bool repeatedCompiled = tepRepeated.compile(repeatedFormula);
+    te_parser tepCse;
+    tepCse.set_variables_and_functions({ {"a", &benchmarkVar} });
+    tepCse.set_common_subexpression_elimination(true);
+    [[maybe_unused]] const bool cseCompiled = tepCse.compile(repeatedFormula);
+
+    BENCHMARK("Repeated subexpressions")
+        { return tepRepeated.evaluate(); };
+    BENCHMARK("Repeated subexpressions shared")
+        { return tepCse.evaluate(); };
+
+    BENCHMARK("max(a, a+1) + sum(a, 2, a) Compiled")
+        { return tep.evaluate("max(a, a+1) + sum(a, 2, a)"); };
+
+    // a formula where the expensive branch is rarely taken
+    te_parser tepBranch;
+    tepBranch.set_variables_and_functions({ {"a", &benchmarkVar} });
+    [[maybe_unused]] const bool branchCompiled = tepBranch.compile(
+        "if(a > 100 && a < 200, sqrt(a^1.5+a^2.5)*sin(a)*cos(a)/(1+sin(a)*cos(a)), a*2)");
+
+    BENCHMARK("if() with an expensive branch not taken")
+        { return tepBranch.evaluate(); };
+
+    // a large formula where only one of its variables changes between evaluations
+    std::vector<te_type> controlValues(30, 1.5);
+    std::set<te_variable> controlVariables;
+    std::string controlFormula;
+    for (size_t i = 0; i < controlValues.size(); ++i)
+        {
+        controlVariables.insert({ "v" + std::to_string(i), &controlValues[i] });
+        controlFormula += (i > 0 ? "+" : "") + std::string{ "sqrt(v" } + std::to_string(i) +
+                          "^2+1)*sin(v" + std::to_string(i) + ")/(1+abs(v" +
+                          std::to_string(i) + "))";
+        }
+    te_parser tepControl;
+    tepControl.set_variables_and_functions(controlVariables);
+    [[maybe_unused]] const bool controlCompiled = tepControl.compile(controlFormula);
+    te_parser tepControlIncremental;
+    tepControlIncremental.set_variables_and_functions(controlVariables);
+    tepControlIncremental.set_incremental_evaluation(true);
+    [[maybe_unused]] const bool controlIncrementalCompiled =
+        tepControlIncremental.compile(controlFormula);
+    size_t controlStep{ 0 };
+
+    BENCHMARK("30 variables, 1 changed Evaluated")
+        {
+        controlValues[++controlStep % controlValues.size()] += 1;
+        return tepControl.evaluate();
+        };
+    BENCHMARK("30 variables, 1 changed Evaluated incrementally")
+        {
+        const size_t changed = ++controlStep % controlValues.size();
+        controlValues[changed] += 1;
+        [[maybe_unused]] const bool marked =
+            tepControlIncremental.mark_variable_dirty("v" + std::to_string(changed));
+        return tepControlIncremental.evaluate();
+        };
+
+    // the same formula evaluated against 10,000 objects
+    std::vector<std::pair<te_type, te_type>> records(10'000);
+    for (size_t i = 0; i < records.size(); ++i)
+        {
+        records[i] = { static_cast<te_type>(i), static_cast<te_type>(i % 7) };
+        }
+    te_type recordX{ 0 }, recordY{ 0 };
+    te_parser tepRecords;
+    tepRecords.set_variables_and_functions({ {"x", &recordX}, {"y", &recordY} });
+    constexpr std::string_view recordFormula{ "sqrt(x^2 + y^2) * if(x > y, 1, -1)" };
+
+    BENCHMARK("10k records Compiled for each")
+        {
+        te_type total{ 0 };
+        for (const auto& record : records)
+            {
+            tepRecords.set_variables_and_functions({ {"x", &record.first}, {"y", &record.second} });
+            total += tepRecords.evaluate(recordFormula);
+            }
+        return total;
+        };
+    BENCHMARK("10k records Rebound")
+        {
+        te_type total{ 0 };
+        [[maybe_unused]] const bool compiled = tepRecords.compile(recordFormula);
+        for (const auto& record : records)
+            {
+            tepRecords.rebind_all({ &record.first, &record.second });
+            total += tepRecords.evaluate();
+            }
+        return total;
+        };
+
+    // decoding the fields of a packed value
+    constexpr std::string_view packetFormula{
+        "bitor(bitand(a >> 4, 15) << 8, bitxor(bitand(a, 255), 90)) >> 2" };
+    te_parser tepPacket;
+    tepPacket.set_variables_and_functions({ {"a", &benchmarkVar} });
+    [[maybe_unused]] const bool packetCompiled = tepPacket.compile(packetFormula);
+    te_parser tepPacketNoInteger;
+    tepPacketNoInteger.set_integer_evaluation(false);
+    tepPacketNoInteger.set_variables_and_functions({ {"a", &benchmarkVar} });
+    [[maybe_unused]] const bool packetNoIntegerCompiled =
+        tepPacketNoInteger.compile(packetFormula);
+
+    BENCHMARK("Packed fields Evaluated")
+        { return tepPacketNoInteger.evaluate(); };
+    BENCHMARK("Packed fields Evaluated (integers)")
+        { return tepPacket.evaluate(); };
+
+    // Monte Carlo samples
+    te_parser tepRandom;
+    [[maybe_unused]] const bool randomCompiled = tepRandom.compile("rand()");
+    std::vector<te_type> randomValues(1'000);
+
+    BENCHMARK("rand() Evaluated")
+        { return tepRandom.evaluate(); };
+    BENCHMARK("1,000 rand() values Filled")
+        {
+        te_parser::fill_random(randomValues);
+        return randomValues.back();
+        };
+
+    // the same formula evaluated from 4 threads at once
+    te_parser tepShared;
+    tepShared.set_variables_and_functions({ {"a", &benchmarkVar} });
+    [[maybe_unused]] const bool sharedCompiled = tepShared.compile("sqrt(a^1.5+a^2.5)");
+    std::mutex sharedMutex;
+    const auto sharedProgram = tepShared.compile_program("sqrt(a^1.5+a^2.5)");
+    const auto evaluateFromThreads = [](const auto& evaluate)
+        {
+        std::vector<std::thread> threads;
+        std::atomic<size_t> evaluated{ 0 };
+        for (size_t i = 0; i < 4; ++i)
+            {
+            threads.emplace_back(
+                [&evaluate, &evaluated]()
+                {
+                    for (size_t j = 0; j < 10'000; ++j)
+                        {
+                        evaluated += std::isnan(evaluate()) ? 0 : 1;
+                        }
+                });
+            }
+        for (auto& thread : threads)
+            {
+            thread.join();
+            }
+        return evaluated.load();
+        };
+
+    BENCHMARK("4 threads x 10k Evaluated (locked parser)")
+        {
+        return evaluateFromThreads(
+            [&]()
+            {
+                const std::lock_guard<std::mutex> lock(sharedMutex);
+                return tepShared.evaluate();
+            });
+        };
+    BENCHMARK("4 threads x 10k Evaluated (program)")
+        { return evaluateFromThreads([&]() { return sharedProgram->evaluate().m_value; }); };
+
+    // the records from above, passed to a program as its variables' values
+    const auto recordProgram = tepRecords.compile_program(recordFormula);
+    BENCHMARK("10k records Evaluated with values")
+        {
+        te_type total{ 0 };
+        std::vector<te_type> recordValues(2);
+        for (const auto& record : records)
+            {
+            recordValues[0] = record.first;
+            recordValues[1] = record.second;
+            total += recordProgram->evaluate(recordValues).m_value;
+            }
+        return total;
+        };
+
+    // 1M rows evaluated with 1 to N threads
+    std::vector<te_type> rowValues;
+    rowValues.reserve(2'000'000);
+    for (size_t i = 0; i < 1'000'000; ++i)
+        {
+        rowValues.push_back(static_cast<te_type>(i));
+        rowValues.push_back(static_cast<te_type>(i % 7));
+        }
+    std::vector<te_type> rowResults;
+    te_program::batch_options rowOptions;
+    const auto evaluateRows = [&](const size_t threadCount)
+        {
+        rowOptions.m_threadCount = threadCount;
+        return recordProgram->evaluate_rows(rowValues, rowResults, rowOptions).m_failedRows;
+        };
+    const size_t maxThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+
+    BENCHMARK("1M rows Evaluated (1 thread)") { return evaluateRows(1); };
+    BENCHMARK("1M rows Evaluated (2 threads)") { return evaluateRows(2); };
+    BENCHMARK("1M rows Evaluated (4 threads)") { return evaluateRows(4); };
+    BENCHMARK("1M rows Evaluated (all cores)") { return evaluateRows(maxThreads); };
+    rowOptions.m_pinThreads = true;
+    BENCHMARK("1M rows Evaluated (all cores, pinned)") { return evaluateRows(maxThreads); };
+
+    // 20k formulas whose costs vary greatly (with the expensive ones grouped together),
+    // split evenly between 4 threads versus balanced by their costs
+    std::vector<std::shared_ptr<const te_program>> tickPrograms;
+    te_formula_set tickFormulas(4);
+    for (size_t i = 0; i < 20'000; ++i)
+        {
+        std::string formula = "a*" + std::to_string(i);
+        const size_t terms = (i < 1'000) ? 200 : 1;
+        for (size_t j = 0; j < terms; ++j)
+            {
+            formula += "+sqrt(a*" + std::to_string(j) + ")";
+            }
+        tickPrograms.push_back(tep.compile_program(formula));
+        tickFormulas.add(tickPrograms.back());
+        }
+    std::vector<te_type> tickResults(tickPrograms.size());
+
+    BENCHMARK("20k formulas Evaluated (split evenly)")
+        {
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < 4; ++i)
+            {
+            threads.emplace_back(
+                [&tickPrograms, &tickResults, i]()
+                {
+                    const size_t first = (tickPrograms.size() * i) / 4;
+                    const size_t last = (tickPrograms.size() * (i + 1)) / 4;
+                    for (size_t j = first; j < last; ++j)
+                        {
+                        tickResults[j] = tickPrograms[j]->evaluate().m_value;
+                        }
+                });
+            }
+        for (auto& thread : threads)
+            {
+            thread.join();
+            }
+        return tickResults.back();
+        };
+    BENCHMARK("20k formulas Evaluated (formula set)")
+        { return tickFormulas.evaluate().m_failedPrograms; };
+
+    // the batch of formulas from above, compiled into a registry of programs
+    BENCHMARK("10k formulas Compiled into programs")
+        {
+        te_program_registry registry;
+        return tepNoCache.compile_programs(batch, registry).size();
+        };
+    BENCHMARK("10k formulas Compiled into programs (4 threads)")
+        {
+        te_program_registry registry;
+        return tepNoCache.compile_programs(batch, registry, 4).size();
+        };
+
+    // the same formula, bound to a variable store instead of a variable
+    te_variable_store benchmarkStore({ "a" });
+    benchmarkStore.set(0, benchmarkVar);
+    te_parser tepStore;
+    tepStore.set_variables_and_functions(benchmarkStore.get_variables());
+    [[maybe_unused]] const bool storeCompiled = tepStore.compile("sqrt(a^1.5+a^2.5)");
+
+    BENCHMARK("sqrt(a^1.5+a^2.5) Evaluated (variable store)") { return tepStore.evaluate(); };
+    BENCHMARK("Variable store Updated") { benchmarkStore.set(0, benchmarkVar); };
+
+    // the same formula, evaluated through a handle that it can be swapped out of
+    te_parser tepHandle;
+    tepHandle.set_variables_and_functions({ { "a", &benchmarkVar } });
+    te_program_handle benchmarkHandle(tepHandle.compile_program("sqrt(a^1.5+a^2.5)"));
+    const auto benchmarkProgram = benchmarkHandle.load();
+
+    BENCHMARK("sqrt(a^1.5+a^2.5) Evaluated (program)")
+        {
+        return benchmarkProgram->evaluate().m_value;
+        };
+    BENCHMARK("sqrt(a^1.5+a^2.5) Evaluated (program handle)")
+        {
+        return benchmarkHandle.evaluate().m_value;
+        };
+    BENCHMARK("Program handle Published")
+        {
+        return benchmarkHandle.publish(benchmarkProgram) != nullptr;
+        };
+
+    // a formula with 40 unknown tags, resolved from a metadata store on each compile
+    std::map<std::string, te_type, te_string_less> tagStore;
+    std::string tagFormula{ "0" };
+    for (size_t i = 0; i < 40; ++i)
+        {
+        tagStore.emplace("TAG" + std::to_string(i), static_cast<te_type>(i));
+        tagFormula += " + TAG" + std::to_string(i);
+        }
+    te_parser tepTags;
+    tepTags.set_unknown_symbol_resolver(
+        [&](std::string_view tag)
+        {
+            const auto found = tagStore.find(std::string{ tag });
+            return (found != tagStore.cend()) ? found->second : te_parser::te_nan;
+        },
+        false);
+    te_parser tepTagsBatch;
+    tepTagsBatch.set_unknown_symbol_resolver(
+        [&](const std::vector<std::string_view>& tags)
+        {
+            std::vector<te_type> values;
+            values.reserve(tags.size());
+            for (const auto& tag : tags)
+                {
+                const auto found = tagStore.find(std::string{ tag });
+                values.push_back((found != tagStore.cend()) ? found->second : te_parser::te_nan);
+                }
+            return values;
+        },
+        false);
+
+    BENCHMARK("40 unknown symbols Compiled (resolver)") { return tepTags.compile(tagFormula); };
+    BENCHMARK("40 unknown symbols Compiled (batch resolver)")
+        {
+        return tepTagsBatch.compile(tagFormula);
+        };
     }
 } // namespace TETesting
 
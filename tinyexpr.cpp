@@ -48,6 +48,11 @@
  */
 
 #include "tinyexpr.h"
+#include <thread>
+#if defined(__linux__) && defined(__GLIBC__)
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 // builtin functions
 namespace te_builtins
@@ -357,13 +362,77 @@ namespace te_builtins
         return std::tgamma(val);
         }
 
+    /// @brief xoshiro256** generator (see https://prng.di.unimi.it/),
+    ///     which is much faster to create and run than @c std::mt19937.
+    class te_random_generator
+        {
+      public:
+        te_random_generator()
+            {
+            std::random_device rdev;
+            seed((static_cast<uint64_t>(rdev()) << 32) ^ static_cast<uint64_t>(rdev()));
+            }
+
+        /// @brief Seeds the state with splitmix64, as the generator's authors recommend.
+        void seed(uint64_t value) noexcept
+            {
+            for (auto& word : m_state)
+                {
+                value += 0x9E3779B97F4A7C15;
+                uint64_t mixed{ value };
+                mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9;
+                mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EB;
+                word = mixed ^ (mixed >> 31);
+                }
+            }
+
+        /// @returns The next random number between 0 and 1 (not including 1).
+        [[nodiscard]]
+        te_type next() noexcept
+            {
+            // use as many of the high bits as the floating-point type can hold exactly
+            constexpr int bits{ std::min(std::numeric_limits<te_type>::digits, 64) };
+            constexpr te_type scale{ 1 /
+                                     (static_cast<te_type>(uint64_t{ 1 } << (bits - 1)) * 2) };
+            return static_cast<te_type>(next_bits() >> (64 - bits)) * scale;
+            }
+
+      private:
+        [[nodiscard]]
+        constexpr static uint64_t rotate_left(const uint64_t value, const int shift) noexcept
+            {
+            return (value << shift) | (value >> (64 - shift));
+            }
+
+        [[nodiscard]]
+        uint64_t next_bits() noexcept
+            {
+            const uint64_t result{ rotate_left(m_state[1] * 5, 7) * 9 };
+            const uint64_t shifted{ m_state[1] << 17 };
+            m_state[2] ^= m_state[0];
+            m_state[3] ^= m_state[1];
+            m_state[1] ^= m_state[2];
+            m_state[0] ^= m_state[3];
+            m_state[2] ^= shifted;
+            m_state[3] = rotate_left(m_state[3], 45);
+            return result;
+            }
+
+        std::array<uint64_t, 4> m_state{};
+        };
+
+    /// @returns The calling thread's random number generator.
+    [[nodiscard]]
+    static te_random_generator& te_thread_random_generator()
+        {
+        thread_local te_random_generator generator;
+        return generator;
+        }
+
     [[nodiscard]]
     static te_type te_random()
         {
-        std::random_device rdev;
-        std::mt19937 gen(rdev());
-        std::uniform_real_distribution<te_type> distr(0, 1);
-        return distr(gen);
+        return te_thread_random_generator().next();
         }
 
     [[nodiscard]]
@@ -507,16 +576,59 @@ namespace te_builtins
         return val1 * val2;
         }
 
+    // Bitwise operations are written for either type of operand: a te_type, which has to be
+    // checked for being a whole, non-negative number, or the uint64_t result of another bitwise
+    // operation (see te_parser::te_eval_integer()), which already is one.
+    //--------------------------------------------------
+    template<typename T>
+    [[nodiscard]]
+    static bool te_is_whole(const T val)
+        {
+        if constexpr (std::is_same_v<T, uint64_t>)
+            {
+            return true;
+            }
+        else
+            {
+            return std::floor(val) == val;
+            }
+        }
+
+    //--------------------------------------------------
+    template<typename T>
+    [[nodiscard]]
+    constexpr static bool te_is_negative(const T val) noexcept
+        {
+        if constexpr (std::is_same_v<T, uint64_t>)
+            {
+            return false;
+            }
+        else
+            {
+            return val < 0;
+            }
+        }
+
+    /// @brief Marks a subtree of bitwise operations that te_parser::te_eval_node() evaluates
+    ///     with integers (the result is the same as evaluating it normally).
+    //--------------------------------------------------
+    [[nodiscard]]
+    static te_type te_integer_subtree(te_type val) noexcept
+        {
+        return val;
+        }
+
 #if __cplusplus >= 202002L && !defined(TE_FLOAT)
     //--------------------------------------------------
+    template<typename T1, typename T2>
     [[nodiscard]]
-    static te_type te_right_rotate8(te_type val1, te_type val2)
+    static uint64_t te_right_rotate8_integer(const T1 val1, const T2 val2)
         {
-        if (std::floor(val1) != val1 || std::floor(val2) != val2)
+        if (!te_is_whole(val1) || !te_is_whole(val2))
             {
             throw std::runtime_error("Bitwise RIGHT ROTATE operation must use integers.");
             }
-        else if (val1 < 0)
+        else if (te_is_negative(val1))
             {
             throw std::runtime_error("Bitwise RIGHT ROTATE value must be positive.");
             }
@@ -525,18 +637,26 @@ namespace te_builtins
             throw std::runtime_error("Rotation operation must be between 0-8.");
             }
 
-        return static_cast<te_type>(std::rotr(static_cast<uint8_t>(val1), static_cast<int>(val2)));
+        return std::rotr(static_cast<uint8_t>(val1), static_cast<int>(val2));
         }
 
     //--------------------------------------------------
     [[nodiscard]]
-    static te_type te_left_rotate8(te_type val1, te_type val2)
+    static te_type te_right_rotate8(te_type val1, te_type val2)
+        {
+        return static_cast<te_type>(te_right_rotate8_integer(val1, val2));
+        }
+
+    //--------------------------------------------------
+    template<typename T1, typename T2>
+    [[nodiscard]]
+    static uint64_t te_left_rotate8_integer(const T1 val1, const T2 val2)
         {
-        if (std::floor(val1) != val1 || std::floor(val2) != val2)
+        if (!te_is_whole(val1) || !te_is_whole(val2))
             {
             throw std::runtime_error("Bitwise LEFT ROTATE operation must use integers.");
             }
-        else if (val1 < 0)
+        else if (te_is_negative(val1))
             {
             throw std::runtime_error("Bitwise LEFT ROTATE value must be positive.");
             }
@@ -545,18 +665,26 @@ namespace te_builtins
             throw std::runtime_error("Rotation operation must be between 0-8.");
             }
 
-        return static_cast<te_type>(std::rotl(static_cast<uint8_t>(val1), static_cast<int>(val2)));
+        return std::rotl(static_cast<uint8_t>(val1), static_cast<int>(val2));
         }
 
     //--------------------------------------------------
     [[nodiscard]]
-    static te_type te_right_rotate16(te_type val1, te_type val2)
+    static te_type te_left_rotate8(te_type val1, te_type val2)
+        {
+        return static_cast<te_type>(te_left_rotate8_integer(val1, val2));
+        }
+
+    //--------------------------------------------------
+    template<typename T1, typename T2>
+    [[nodiscard]]
+    static uint64_t te_right_rotate16_integer(const T1 val1, const T2 val2)
         {
-        if (std::floor(val1) != val1 || std::floor(val2) != val2)
+        if (!te_is_whole(val1) || !te_is_whole(val2))
             {
             throw std::runtime_error("Bitwise RIGHT ROTATE operation must use integers.");
             }
-        else if (val1 < 0)
+        else if (te_is_negative(val1))
             {
             throw std::runtime_error("Bitwise RIGHT ROTATE value must be positive.");
             }
@@ -565,18 +693,26 @@ namespace te_builtins
             throw std::runtime_error("Rotation operation must be between 0-16.");
             }
 
-        return static_cast<te_type>(std::rotr(static_cast<uint16_t>(val1), static_cast<int>(val2)));
+        return std::rotr(static_cast<uint16_t>(val1), static_cast<int>(val2));
         }
 
     //--------------------------------------------------
     [[nodiscard]]
-    static te_type te_left_rotate16(te_type val1, te_type val2)
+    static te_type te_right_rotate16(te_type val1, te_type val2)
+        {
+        return static_cast<te_type>(te_right_rotate16_integer(val1, val2));
+        }
+
+    //--------------------------------------------------
+    template<typename T1, typename T2>
+    [[nodiscard]]
+    static uint64_t te_left_rotate16_integer(const T1 val1, const T2 val2)
         {
-        if (std::floor(val1) != val1 || std::floor(val2) != val2)
+        if (!te_is_whole(val1) || !te_is_whole(val2))
             {
             throw std::runtime_error("Bitwise LEFT ROTATE operation must use integers.");
             }
-        else if (val1 < 0)
+        else if (te_is_negative(val1))
             {
             throw std::runtime_error("Bitwise LEFT ROTATE value must be positive.");
             }
@@ -585,22 +721,30 @@ namespace te_builtins
             throw std::runtime_error("Rotation operation must be between 0-16.");
             }
 
-        return static_cast<te_type>(std::rotl(static_cast<uint16_t>(val1), static_cast<int>(val2)));
+        return std::rotl(static_cast<uint16_t>(val1), static_cast<int>(val2));
         }
 
     //--------------------------------------------------
     [[nodiscard]]
-    static te_type te_right_rotate32(te_type val1, te_type val2)
+    static te_type te_left_rotate16(te_type val1, te_type val2)
+        {
+        return static_cast<te_type>(te_left_rotate16_integer(val1, val2));
+        }
+
+    //--------------------------------------------------
+    template<typename T1, typename T2>
+    [[nodiscard]]
+    static uint64_t te_right_rotate32_integer(const T1 val1, const T2 val2)
         {
         if constexpr (!te_parser::supports_32bit())
             {
             throw std::runtime_error("32-bit bitwise operations are not supported.");
             }
-        if (std::floor(val1) != val1 || std::floor(val2) != val2)
+        if (!te_is_whole(val1) || !te_is_whole(val2))
             {
             throw std::runtime_error("Bitwise RIGHT ROTATE operation must use integers.");
             }
-        else if (val1 < 0)
+        else if (te_is_negative(val1))
             {
             throw std::runtime_error("Bitwise RIGHT ROTATE value must be positive.");
             }
@@ -609,22 +753,30 @@ namespace te_builtins
             throw std::runtime_error("Rotation operation must be between 0-32.");
             }
 
-        return static_cast<te_type>(std::rotr(static_cast<uint32_t>(val1), static_cast<int>(val2)));
+        return std::rotr(static_cast<uint32_t>(val1), static_cast<int>(val2));
         }
 
     //--------------------------------------------------
     [[nodiscard]]
-    static te_type te_left_rotate32(te_type val1, te_type val2)
+    static te_type te_right_rotate32(te_type val1, te_type val2)
+        {
+        return static_cast<te_type>(te_right_rotate32_integer(val1, val2));
+        }
+
+    //--------------------------------------------------
+    template<typename T1, typename T2>
+    [[nodiscard]]
+    static uint64_t te_left_rotate32_integer(const T1 val1, const T2 val2)
         {
         if constexpr (!te_parser::supports_32bit())
             {
             throw std::runtime_error("32-bit bitwise operations are not supported.");
             }
-        if (std::floor(val1) != val1 || std::floor(val2) != val2)
+        if (!te_is_whole(val1) || !te_is_whole(val2))
             {
             throw std::runtime_error("Bitwise LEFT ROTATE operation must use integers.");
             }
-        else if (val1 < 0)
+        else if (te_is_negative(val1))
             {
             throw std::runtime_error("Bitwise LEFT ROTATE value must be positive.");
             }
@@ -633,22 +785,30 @@ namespace te_builtins
             throw std::runtime_error("Rotation operation must be between 0-32.");
             }
 
-        return static_cast<te_type>(std::rotl(static_cast<uint32_t>(val1), static_cast<int>(val2)));
+        return std::rotl(static_cast<uint32_t>(val1), static_cast<int>(val2));
         }
 
     //--------------------------------------------------
     [[nodiscard]]
-    static te_type te_right_rotate64(te_type val1, te_type val2)
+    static te_type te_left_rotate32(te_type val1, te_type val2)
+        {
+        return static_cast<te_type>(te_left_rotate32_integer(val1, val2));
+        }
+
+    //--------------------------------------------------
+    template<typename T1, typename T2>
+    [[nodiscard]]
+    static uint64_t te_right_rotate64_integer(const T1 val1, const T2 val2)
         {
         if constexpr (!te_parser::supports_64bit())
             {
             throw std::runtime_error("64-bit bitwise operations are not supported.");
             }
-        if (std::floor(val1) != val1 || std::floor(val2) != val2)
+        if (!te_is_whole(val1) || !te_is_whole(val2))
             {
             throw std::runtime_error("Bitwise RIGHT ROTATE operation must use integers.");
             }
-        else if (val1 < 0)
+        else if (te_is_negative(val1))
             {
             throw std::runtime_error("Bitwise RIGHT ROTATE value must be positive.");
             }
@@ -657,22 +817,30 @@ namespace te_builtins
             throw std::runtime_error("Rotation operation must be between 0-63");
             }
 
-        return static_cast<te_type>(std::rotr(static_cast<uint64_t>(val1), static_cast<int>(val2)));
+        return std::rotr(static_cast<uint64_t>(val1), static_cast<int>(val2));
         }
 
     //--------------------------------------------------
     [[nodiscard]]
-    static te_type te_left_rotate64(te_type val1, te_type val2)
+    static te_type te_right_rotate64(te_type val1, te_type val2)
+        {
+        return static_cast<te_type>(te_right_rotate64_integer(val1, val2));
+        }
+
+    //--------------------------------------------------
+    template<typename T1, typename T2>
+    [[nodiscard]]
+    static uint64_t te_left_rotate64_integer(const T1 val1, const T2 val2)
         {
         if constexpr (!te_parser::supports_64bit())
             {
             throw std::runtime_error("64-bit bitwise operations are not supported.");
             }
-        if (std::floor(val1) != val1 || std::floor(val2) != val2)
+        if (!te_is_whole(val1) || !te_is_whole(val2))
             {
             throw std::runtime_error("Bitwise LEFT ROTATE operation must use integers.");
             }
-        else if (val1 < 0)
+        else if (te_is_negative(val1))
             {
             throw std::runtime_error("Bitwise LEFT ROTATE value must be positive.");
             }
@@ -681,54 +849,78 @@ namespace te_builtins
             throw std::runtime_error("Rotation operation must be between 0-63");
             }
 
-        return static_cast<te_type>(std::rotl(static_cast<uint64_t>(val1), static_cast<int>(val2)));
+        return std::rotl(static_cast<uint64_t>(val1), static_cast<int>(val2));
         }
 
     //--------------------------------------------------
     [[nodiscard]]
-    static te_type te_right_rotate(te_type val1, te_type val2)
+    static te_type te_left_rotate64(te_type val1, te_type val2)
+        {
+        return static_cast<te_type>(te_left_rotate64_integer(val1, val2));
+        }
+
+    //--------------------------------------------------
+    template<typename T1, typename T2>
+    [[nodiscard]]
+    static uint64_t te_right_rotate_integer(const T1 val1, const T2 val2)
         {
         if constexpr (te_parser::supports_64bit())
             {
-            return te_right_rotate64(val1, val2);
+            return te_right_rotate64_integer(val1, val2);
             }
         else if constexpr (te_parser::supports_32bit())
             {
-            return te_right_rotate32(val1, val2);
+            return te_right_rotate32_integer(val1, val2);
             }
         else
             {
-            return te_right_rotate16(val1, val2);
+            return te_right_rotate16_integer(val1, val2);
             }
         }
 
     //--------------------------------------------------
     [[nodiscard]]
-    static te_type te_left_rotate(te_type val1, te_type val2)
+    static te_type te_right_rotate(te_type val1, te_type val2)
+        {
+        return static_cast<te_type>(te_right_rotate_integer(val1, val2));
+        }
+
+    //--------------------------------------------------
+    template<typename T1, typename T2>
+    [[nodiscard]]
+    static uint64_t te_left_rotate_integer(const T1 val1, const T2 val2)
         {
         if constexpr (te_parser::supports_64bit())
             {
-            return te_left_rotate64(val1, val2);
+            return te_left_rotate64_integer(val1, val2);
             }
         else if constexpr (te_parser::supports_32bit())
             {
-            return te_left_rotate32(val1, val2);
+            return te_left_rotate32_integer(val1, val2);
             }
         else
             {
-            return te_left_rotate16(val1, val2);
+            return te_left_rotate16_integer(val1, val2);
             }
         }
+
+    //--------------------------------------------------
+    [[nodiscard]]
+    static te_type te_left_rotate(te_type val1, te_type val2)
+        {
+        return static_cast<te_type>(te_left_rotate_integer(val1, val2));
+        }
 #endif
     //--------------------------------------------------
+    template<typename T>
     [[nodiscard]]
-    static te_type te_bitwise_not8(te_type val)
+    static uint64_t te_bitwise_not8_integer(const T val)
         {
-        if (std::floor(val) != val)
+        if (!te_is_whole(val))
             {
             throw std::runtime_error("Bitwise NOT must use integers.");
             }
-        else if (val < 0)
+        else if (te_is_negative(val))
             {
             throw std::runtime_error("Bitwise NOT value must be positive.");
             }
@@ -740,18 +932,26 @@ namespace te_builtins
         // force the bit manipulation to stay unsigned, like what Excel does
         const uint8_t intVal{ static_cast<uint8_t>(val) };
         const decltype(intVal) result{ static_cast<decltype(intVal)>(~intVal) };
-        return static_cast<te_type>(result);
+        return result;
         }
 
     //--------------------------------------------------
     [[nodiscard]]
-    static te_type te_bitwise_not16(te_type val)
+    static te_type te_bitwise_not8(te_type val)
+        {
+        return static_cast<te_type>(te_bitwise_not8_integer(val));
+        }
+
+    //--------------------------------------------------
+    template<typename T>
+    [[nodiscard]]
+    static uint64_t te_bitwise_not16_integer(const T val)
         {
-        if (std::floor(val) != val)
+        if (!te_is_whole(val))
             {
             throw std::runtime_error("Bitwise NOT must use integers.");
             }
-        else if (val < 0)
+        else if (te_is_negative(val))
             {
             throw std::runtime_error("Bitwise NOT value must be positive.");
             }
@@ -762,22 +962,30 @@ namespace te_builtins
 
         const uint16_t intVal{ static_cast<uint16_t>(val) };
         const decltype(intVal) result{ static_cast<decltype(intVal)>(~intVal) };
-        return static_cast<te_type>(result);
+        return result;
         }
 
     //--------------------------------------------------
     [[nodiscard]]
-    static te_type te_bitwise_not32(te_type val)
+    static te_type te_bitwise_not16(te_type val)
+        {
+        return static_cast<te_type>(te_bitwise_not16_integer(val));
+        }
+
+    //--------------------------------------------------
+    template<typename T>
+    [[nodiscard]]
+    static uint64_t te_bitwise_not32_integer(const T val)
         {
         if constexpr (!te_parser::supports_32bit())
             {
             throw std::runtime_error("32-bit bitwise operations are not supported.");
             }
-        if (std::floor(val) != val)
+        if (!te_is_whole(val))
             {
             throw std::runtime_error("Bitwise NOT must use integers.");
             }
-        else if (val < 0)
+        else if (te_is_negative(val))
             {
             throw std::runtime_error("Bitwise NOT value must be positive.");
             }
@@ -788,22 +996,30 @@ namespace te_builtins
 
         const uint32_t intVal{ static_cast<uint32_t>(val) };
         const decltype(intVal) result{ static_cast<decltype(intVal)>(~intVal) };
-        return static_cast<te_type>(result);
+        return result;
         }
 
     //--------------------------------------------------
     [[nodiscard]]
-    static te_type te_bitwise_not64(te_type val)
+    static te_type te_bitwise_not32(te_type val)
+        {
+        return static_cast<te_type>(te_bitwise_not32_integer(val));
+        }
+
+    //--------------------------------------------------
+    template<typename T>
+    [[nodiscard]]
+    static uint64_t te_bitwise_not64_integer(const T val)
         {
         if constexpr (!te_parser::supports_64bit())
             {
             throw std::runtime_error("64-bit bitwise operations are not supported.");
             }
-        if (std::floor(val) != val)
+        if (!te_is_whole(val))
             {
             throw std::runtime_error("Bitwise NOT must use integers.");
             }
-        else if (val < 0)
+        else if (te_is_negative(val))
             {
             throw std::runtime_error("Bitwise NOT value must be positive.");
             }
@@ -814,38 +1030,54 @@ namespace te_builtins
 
         const uint64_t intVal{ static_cast<uint64_t>(val) };
         const decltype(intVal) result{ static_cast<decltype(intVal)>(~intVal) };
-        return static_cast<te_type>(result);
+        return result;
         }
 
     //--------------------------------------------------
     [[nodiscard]]
-    static te_type te_bitwise_not(te_type val)
+    static te_type te_bitwise_not64(te_type val)
+        {
+        return static_cast<te_type>(te_bitwise_not64_integer(val));
+        }
+
+    //--------------------------------------------------
+    template<typename T>
+    [[nodiscard]]
+    static uint64_t te_bitwise_not_integer(const T val)
         {
         if constexpr (te_parser::supports_64bit())
             {
-            return te_bitwise_not64(val);
+            return te_bitwise_not64_integer(val);
             }
         else if constexpr (te_parser::supports_32bit())
             {
-            return te_bitwise_not32(val);
+            return te_bitwise_not32_integer(val);
             }
         else
             {
-            return te_bitwise_not16(val);
+            return te_bitwise_not16_integer(val);
             }
         }
 
     //--------------------------------------------------
     [[nodiscard]]
-    static te_type te_bitwise_or(te_type val1, te_type val2)
+    static te_type te_bitwise_not(te_type val)
+        {
+        return static_cast<te_type>(te_bitwise_not_integer(val));
+        }
+
+    //--------------------------------------------------
+    template<typename T1, typename T2>
+    [[nodiscard]]
+    static uint64_t te_bitwise_or_integer(const T1 val1, const T2 val2)
         {
-        if (std::floor(val1) != val1 || std::floor(val2) != val2)
+        if (!te_is_whole(val1) || !te_is_whole(val2))
             {
             throw std::runtime_error("Bitwise OR operation must use integers.");
             }
         // negative technically should be allowed, but spreadsheet programs do
         // not allow them; hence, we won't either
-        else if (val1 < 0 || val2 < 0)
+        else if (te_is_negative(val1) || te_is_negative(val2))
             {
             throw std::runtime_error("Bitwise OR operation must use positive integers.");
             }
@@ -853,20 +1085,28 @@ namespace te_builtins
             {
             throw std::runtime_error("Value is too large for bitwise operation.");
             }
-        return static_cast<te_type>(static_cast<uint64_t>(val1) | static_cast<uint64_t>(val2));
+        return static_cast<uint64_t>(val1) | static_cast<uint64_t>(val2);
         }
 
     //--------------------------------------------------
     [[nodiscard]]
-    static te_type te_bitwise_xor(te_type val1, te_type val2)
+    static te_type te_bitwise_or(te_type val1, te_type val2)
+        {
+        return static_cast<te_type>(te_bitwise_or_integer(val1, val2));
+        }
+
+    //--------------------------------------------------
+    template<typename T1, typename T2>
+    [[nodiscard]]
+    static uint64_t te_bitwise_xor_integer(const T1 val1, const T2 val2)
         {
-        if (std::floor(val1) != val1 || std::floor(val2) != val2)
+        if (!te_is_whole(val1) || !te_is_whole(val2))
             {
             throw std::runtime_error("Bitwise XOR operation must use integers.");
             }
         // negative technically should be allowed, but spreadsheet programs do
         // not allow them; hence, we won't either
-        else if (val1 < 0 || val2 < 0)
+        else if (te_is_negative(val1) || te_is_negative(val2))
             {
             throw std::runtime_error("Bitwise XOR operation must use positive integers.");
             }
@@ -874,20 +1114,28 @@ namespace te_builtins
             {
             throw std::runtime_error("Value is too large for bitwise operation.");
             }
-        return static_cast<te_type>(static_cast<uint64_t>(val1) ^ static_cast<uint64_t>(val2));
+        return static_cast<uint64_t>(val1) ^ static_cast<uint64_t>(val2);
         }
 
     //--------------------------------------------------
     [[nodiscard]]
-    static te_type te_bitwise_and(te_type val1, te_type val2)
+    static te_type te_bitwise_xor(te_type val1, te_type val2)
+        {
+        return static_cast<te_type>(te_bitwise_xor_integer(val1, val2));
+        }
+
+    //--------------------------------------------------
+    template<typename T1, typename T2>
+    [[nodiscard]]
+    static uint64_t te_bitwise_and_integer(const T1 val1, const T2 val2)
         {
-        if (std::floor(val1) != val1 || std::floor(val2) != val2)
+        if (!te_is_whole(val1) || !te_is_whole(val2))
             {
             throw std::runtime_error("Bitwise AND operation must use integers.");
             }
         // negative technically should be allowed, but spreadsheet programs do
         // not allow them; hence, we won't either
-        else if (val1 < 0 || val2 < 0)
+        else if (te_is_negative(val1) || te_is_negative(val2))
             {
             throw std::runtime_error("Bitwise AND operation must use positive integers.");
             }
@@ -895,29 +1143,37 @@ namespace te_builtins
             {
             throw std::runtime_error("Value is too large for bitwise operation.");
             }
-        return static_cast<te_type>(static_cast<uint64_t>(val1) & static_cast<uint64_t>(val2));
+        return static_cast<uint64_t>(val1) & static_cast<uint64_t>(val2);
+        }
+
+    //--------------------------------------------------
+    [[nodiscard]]
+    static te_type te_bitwise_and(te_type val1, te_type val2)
+        {
+        return static_cast<te_type>(te_bitwise_and_integer(val1, val2));
         }
 
     // Shift operators
     //--------------------------------------------------
+    template<typename T1, typename T2>
     [[nodiscard]]
-    static te_type te_left_shift(te_type val1, te_type val2)
+    static uint64_t te_left_shift_integer(const T1 val1, const T2 val2)
         {
         // For 64-bit, you can shift 63 bits.
         // If we are limited to something like 53 bits, then we can use that (same as Excel)
         constexpr static auto MAX_BITNESS_PARAM =
             (te_parser::supports_64bit() ? te_parser::get_max_integer_bitness() - 1 :
                                            te_parser::get_max_integer_bitness());
-        if (std::floor(val1) != val1)
+        if (!te_is_whole(val1))
             {
             throw std::runtime_error("Left side of left shift (<<) operation must be an integer.");
             }
-        else if (std::floor(val2) != val2)
+        else if (!te_is_whole(val2))
             {
             throw std::runtime_error(
                 "Additive expression of left shift (<<) operation must be an integer.");
             }
-        else if (val1 < 0)
+        else if (te_is_negative(val1))
             {
             throw std::runtime_error("Left side of left shift (<<) operation cannot be negative.");
             }
@@ -927,7 +1183,7 @@ namespace te_builtins
             }
         // bitness is limited to 53-bit or 64-bit, so ensure shift doesn't go beyond that
         // and cause undefined behavior
-        else if (val2 < 0 || val2 > MAX_BITNESS_PARAM)
+        else if (te_is_negative(val2) || val2 > MAX_BITNESS_PARAM)
             {
             throw std::runtime_error(
                 "Additive expression of left shift (<<) operation must be between 0-" +
@@ -941,27 +1197,35 @@ namespace te_builtins
             throw std::runtime_error(
                 "Overflow in left shift (<<) operation; base number is too large.");
             }
-        return static_cast<te_type>(static_cast<uint64_t>(val1) << static_cast<uint64_t>(val2));
+        return static_cast<uint64_t>(val1) << static_cast<uint64_t>(val2);
         }
 
     //--------------------------------------------------
     [[nodiscard]]
-    static te_type te_right_shift(te_type val1, te_type val2)
+    static te_type te_left_shift(te_type val1, te_type val2)
+        {
+        return static_cast<te_type>(te_left_shift_integer(val1, val2));
+        }
+
+    //--------------------------------------------------
+    template<typename T1, typename T2>
+    [[nodiscard]]
+    static uint64_t te_right_shift_integer(const T1 val1, const T2 val2)
         {
         constexpr static auto MAX_BITNESS_PARAM =
             (te_parser::supports_64bit() ? te_parser::get_max_integer_bitness() - 1 :
                                            te_parser::get_max_integer_bitness());
 
-        if (std::floor(val1) != val1)
+        if (!te_is_whole(val1))
             {
             throw std::runtime_error("Left side of right shift (>>) operation must be an integer.");
             }
-        else if (std::floor(val2) != val2)
+        else if (!te_is_whole(val2))
             {
             throw std::runtime_error(
                 "Additive expression of right shift (>>) operation must be an integer.");
             }
-        else if (val1 < 0)
+        else if (te_is_negative(val1))
             {
             throw std::runtime_error("Left side of right shift (<<) operation cannot be negative.");
             }
@@ -969,32 +1233,73 @@ namespace te_builtins
             {
             throw std::runtime_error("Value is too large for bitwise operation.");
             }
-        else if (val2 < 0 || val2 > MAX_BITNESS_PARAM)
+        else if (te_is_negative(val2) || val2 > MAX_BITNESS_PARAM)
             {
             throw std::runtime_error(
                 "Additive expression of right shift (>>) operation must be between 0-" +
                 std::to_string(MAX_BITNESS_PARAM));
             }
 
-        return static_cast<te_type>(static_cast<uint64_t>(val1) >> static_cast<uint64_t>(val2));
+        return static_cast<uint64_t>(val1) >> static_cast<uint64_t>(val2);
+        }
+
+    //--------------------------------------------------
+    [[nodiscard]]
+    static te_type te_right_shift(te_type val1, te_type val2)
+        {
+        return static_cast<te_type>(te_right_shift_integer(val1, val2));
         }
 
     /// @warning This emulates Excel, where a negative shift amount acts as a right shift.\n
     ///     Be aware of this if using this function outside of TinyExpr++.
+    //--------------------------------------------------
+    template<typename T1, typename T2>
+    [[nodiscard]]
+    static uint64_t te_left_shift_or_right_integer(const T1 val1, const T2 val2)
+        {
+        // a shift amount from another bitwise operation is never negative
+        if constexpr (std::is_same_v<T2, uint64_t>)
+            {
+            return te_left_shift_integer(val1, val2);
+            }
+        else
+            {
+            return (val2 >= 0) ? te_left_shift_integer(val1, val2) :
+                                 te_right_shift_integer(val1, std::abs(val2));
+            }
+        }
+
     //--------------------------------------------------
     [[nodiscard]]
     static te_type te_left_shift_or_right(te_type val1, te_type val2)
         {
-        return (val2 >= 0) ? te_left_shift(val1, val2) : te_right_shift(val1, std::abs(val2));
+        return static_cast<te_type>(te_left_shift_or_right_integer(val1, val2));
         }
 
     /// @warning This emulates Excel, where a negative shift amount acts as a right shift.\n
     ///     Be aware of this if using this function outside of TinyExpr++.
+    //--------------------------------------------------
+    template<typename T1, typename T2>
+    [[nodiscard]]
+    static uint64_t te_right_shift_or_left_integer(const T1 val1, const T2 val2)
+        {
+        // a shift amount from another bitwise operation is never negative
+        if constexpr (std::is_same_v<T2, uint64_t>)
+            {
+            return te_right_shift_integer(val1, val2);
+            }
+        else
+            {
+            return (val2 >= 0) ? te_right_shift_integer(val1, val2) :
+                                 te_left_shift_integer(val1, std::abs(val2));
+            }
+        }
+
     //--------------------------------------------------
     [[nodiscard]]
     static te_type te_right_shift_or_left(te_type val1, te_type val2)
         {
-        return (val2 >= 0) ? te_right_shift(val1, val2) : te_left_shift(val1, std::abs(val2));
+        return static_cast<te_type>(te_right_shift_or_left_integer(val1, val2));
         }
 
     [[nodiscard]]
@@ -1152,53 +1457,174 @@ namespace te_builtins
         return -val;
         }
 
+    // Cheaper versions of pow() for specific exponents, which the optimizer uses.
+    // x^2, x^-1, and x^0.5 give the same results as pow();
+    // the others can be off by a rounding.
     [[nodiscard]]
-    constexpr static te_type te_comma([[maybe_unused]] te_type unusedVal, // NOLINT
-                                      te_type val2) noexcept
+    constexpr static te_type te_square(te_type val) noexcept
         {
-        return val2;
+        return val * val;
         }
-    } // namespace te_builtins
 
-//--------------------------------------------------
-void te_parser::te_free_parameters(te_expr* texp)
-    {
-    if (texp == nullptr)
+    [[nodiscard]]
+    constexpr static te_type te_cube(te_type val) noexcept
         {
-        return;
+        return val * val * val;
         }
-    if (is_closure(texp->m_value))
+
+    [[nodiscard]]
+    constexpr static te_type te_fourth_power(te_type val) noexcept
         {
-        // last param is the context object, we don't manage that here
-        for (auto param = texp->m_parameters.begin(); param != texp->m_parameters.end() - 1;
-             ++param)
-            {
-            te_free(*param);
-            *param = nullptr;
-            }
+        const te_type squared{ val * val };
+        return squared * squared;
         }
-    else if (is_function(texp->m_value))
+
+    // unlike te_divide, division by zero is allowed (like pow(0, -1))
+    [[nodiscard]]
+    constexpr static te_type te_reciprocal(te_type val) noexcept
         {
-        for (auto* param : texp->m_parameters)
-            {
-            te_free(param);
-            param = nullptr;
-            }
+        return 1 / val;
         }
-    }
 
-//--------------------------------------------------
-const std::set<te_variable> te_parser::m_functions = { // NOLINT
-    { "abs", static_cast<te_fun1>(te_builtins::te_absolute_value), TE_PURE },
-    { "acos", static_cast<te_fun1>(te_builtins::te_acos), TE_PURE },
-    // variadic, accepts 1-7 arguments
-    { "and", static_cast<te_fun7>(te_builtins::te_and_variadic),
-      static_cast<te_variable_flags>(TE_PURE | TE_VARIADIC) },
-    { "asin", static_cast<te_fun1>(te_builtins::te_asin), TE_PURE },
-    { "atan", static_cast<te_fun1>(te_builtins::te_atan), TE_PURE },
-    { "atan2", static_cast<te_fun2>(te_builtins::te_atan2), TE_PURE },
-    { "average", static_cast<te_fun7>(te_builtins::te_average),
-      static_cast<te_variable_flags>(TE_PURE | TE_VARIADIC) },
+    // pow(-0, 0.5) is 0 and pow(-inf, 0.5) is inf, while sqrt() returns -0 and NaN
+    [[nodiscard]]
+    static te_type te_pow_half(te_type val)
+        {
+        return (val == -std::numeric_limits<te_type>::infinity()) ?
+                   std::numeric_limits<te_type>::infinity() :
+                   std::fabs(std::sqrt(val));
+        }
+
+    [[nodiscard]]
+    static te_type te_pow_one_and_half(te_type val)
+        {
+        return val * te_pow_half(val);
+        }
+
+    [[nodiscard]]
+    static te_type te_pow_two_and_half(te_type val)
+        {
+        return val * val * te_pow_half(val);
+        }
+
+    // Variadic functions specialized for the number of arguments that they are called with,
+    // so that they don't have to check (and skip) the unused NaN arguments.
+    // These return the same results as their te_fun7 versions.
+    struct te_sum_of
+        {
+        template<typename... Values>
+        [[nodiscard]]
+        static te_type eval(te_type first, Values... rest) noexcept
+            {
+            return ((te_type{ 0 } + (!std::isfinite(first) ? 0 : first)) + ... +
+                    (!std::isfinite(rest) ? 0 : rest));
+            }
+        };
+
+    struct te_average_of
+        {
+        template<typename... Values>
+        [[nodiscard]]
+        static te_type eval(te_type first, Values... rest)
+            {
+            const auto validN =
+                ((!std::isfinite(first) ? 0 : 1) + ... + (!std::isfinite(rest) ? 0 : 1));
+            return te_divide(te_sum_of::eval(first, rest...), static_cast<te_type>(validN));
+            }
+        };
+
+    struct te_max_of
+        {
+        template<typename... Values>
+        [[nodiscard]]
+        static te_type eval(te_type first, Values... rest) noexcept
+            {
+            ((first = te_max_maybe_nan(first, rest)), ...);
+            return first;
+            }
+        };
+
+    struct te_min_of
+        {
+        template<typename... Values>
+        [[nodiscard]]
+        static te_type eval(te_type first, Values... rest) noexcept
+            {
+            ((first = te_min_maybe_nan(first, rest)), ...);
+            return first;
+            }
+        };
+
+    /// @returns The version of @c Function that takes @c argumentCount (1-6) arguments.
+    template<typename Function>
+    [[nodiscard]]
+    static te_variant_type te_specialized(const size_t argumentCount)
+        {
+        using T = te_type;
+        switch (argumentCount)
+            {
+        case 1:
+            return static_cast<te_fun1>(Function::template eval<>);
+        case 2:
+            return static_cast<te_fun2>(Function::template eval<T>);
+        case 3:
+            return static_cast<te_fun3>(Function::template eval<T, T>);
+        case 4:
+            return static_cast<te_fun4>(Function::template eval<T, T, T>);
+        case 5:
+            return static_cast<te_fun5>(Function::template eval<T, T, T, T>);
+        default:
+            return static_cast<te_fun6>(Function::template eval<T, T, T, T, T>);
+            }
+        }
+
+    [[nodiscard]]
+    constexpr static te_type te_comma([[maybe_unused]] te_type unusedVal, // NOLINT
+                                      te_type val2) noexcept
+        {
+        return val2;
+        }
+    } // namespace te_builtins
+
+//--------------------------------------------------
+void te_parser::te_free_parameters(te_expr* texp)
+    {
+    if (texp == nullptr)
+        {
+        return;
+        }
+    if (is_closure(texp->m_value))
+        {
+        // last param is the context object, we don't manage that here
+        for (auto param = texp->m_parameters.begin(); param != texp->m_parameters.end() - 1;
+             ++param)
+            {
+            te_free(*param);
+            *param = nullptr;
+            }
+        }
+    else if (is_function(texp->m_value))
+        {
+        for (auto* param : texp->m_parameters)
+            {
+            te_free(param);
+            param = nullptr;
+            }
+        }
+    }
+
+//--------------------------------------------------
+const std::set<te_variable> te_parser::m_functions = { // NOLINT
+    { "abs", static_cast<te_fun1>(te_builtins::te_absolute_value), TE_PURE },
+    { "acos", static_cast<te_fun1>(te_builtins::te_acos), TE_PURE },
+    // variadic, accepts 1-7 arguments
+    { "and", static_cast<te_fun7>(te_builtins::te_and_variadic),
+      static_cast<te_variable_flags>(TE_PURE | TE_VARIADIC) },
+    { "asin", static_cast<te_fun1>(te_builtins::te_asin), TE_PURE },
+    { "atan", static_cast<te_fun1>(te_builtins::te_atan), TE_PURE },
+    { "atan2", static_cast<te_fun2>(te_builtins::te_atan2), TE_PURE },
+    { "average", static_cast<te_fun7>(te_builtins::te_average),
+      static_cast<te_variable_flags>(TE_PURE | TE_VARIADIC) },
 #ifndef TE_FLOAT
     { "bitand", static_cast<te_fun2>(te_builtins::te_bitwise_and), TE_PURE },
     { "bitor", static_cast<te_fun2>(te_builtins::te_bitwise_or), TE_PURE },
@@ -1267,7 +1693,8 @@ const std::set<te_variable> te_parser::m_functions = { // NOLINT
     { "pi", static_cast<te_fun0>(te_builtins::te_pi), TE_PURE },
     { "pow", static_cast<te_fun2>(te_builtins::te_pow), TE_PURE },
     { "power", /* Excel alias*/ static_cast<te_fun2>(te_builtins::te_pow), TE_PURE },
-    { "rand", static_cast<te_fun0>(te_builtins::te_random), TE_PURE },
+    // not pure, so that it is not evaluated once at compile time
+    { "rand", static_cast<te_fun0>(te_builtins::te_random), TE_DEFAULT },
     { "round", static_cast<te_fun2>(te_builtins::te_round),
       static_cast<te_variable_flags>(TE_PURE | TE_VARIADIC) },
     { "sign", static_cast<te_fun1>(te_builtins::te_sign), TE_PURE },
@@ -1286,6 +1713,151 @@ const std::set<te_variable> te_parser::m_functions = { // NOLINT
     { "trunc", static_cast<te_fun1>(te_builtins::te_trunc), TE_PURE }
 };
 
+//--------------------------------------------------
+te_type te_parser::resolve_unknown_symbol(const std::string_view name)
+    {
+    const auto callResolver = [this, name]()
+    {
+        // "te_type usr(string_view)" resolver
+        if (m_unknownSymbolResolve.index() == 1)
+            {
+            return std::get<1>(m_unknownSymbolResolve)(name);
+            }
+        // "te_type usr(string_view, string&)" resolver
+        if (m_unknownSymbolResolve.index() == 2)
+            {
+            return std::get<2>(m_unknownSymbolResolve)(name, m_lastErrorMessage);
+            }
+        // batch resolver, for a symbol that the scan before parsing didn't find
+        if (m_unknownSymbolResolve.index() == 3)
+            {
+            auto& requestedSymbols = (m_sharedResolutions != nullptr) ?
+                                         m_sharedResolutions->m_batchRequestedSymbols :
+                                         m_batchRequestedSymbols;
+            if (!requestedSymbols.emplace(name).second)
+                {
+                return te_nan;
+                }
+            const auto values = std::get<3>(m_unknownSymbolResolve)({ name });
+            return (values.size() == 1) ? values.front() : te_nan;
+            }
+        return te_nan;
+    };
+
+    if (m_sharedResolutions == nullptr)
+        {
+        return callResolver();
+        }
+    const std::lock_guard<std::mutex> lock(m_sharedResolutions->m_mutex);
+    if (const auto resolved = m_sharedResolutions->m_values.find(std::string{ name });
+        resolved != m_sharedResolutions->m_values.cend())
+        {
+        return resolved->second;
+        }
+    const auto value = callResolver();
+    if (std::isfinite(value))
+        {
+        m_sharedResolutions->m_values.emplace(name, value);
+        }
+    return value;
+    }
+
+//--------------------------------------------------
+std::set<std::string, te_string_less>
+te_parser::find_unknown_symbols(const std::string_view* expressions,
+                                const size_t expressionCount) const
+    {
+    // scan the expressions like next_token() does, only looking at the names
+    std::set<std::string, te_string_less> unknownSymbols;
+    for (size_t expressionIndex = 0; expressionIndex < expressionCount; ++expressionIndex)
+        {
+        const std::string_view expression{ expressions[expressionIndex] };
+        size_t i{ 0 };
+        while (i < expression.length())
+            {
+            const char ch{ expression[i] };
+            const char nextCh{ (i + 1 < expression.length()) ? expression[i + 1] : '\0' };
+            // skip comments (if the expression's comments haven't been removed yet)
+            if (ch == '/' && (nextCh == '*' || nextCh == '/'))
+                {
+                i = (nextCh == '*') ? expression.find("*/", i + 2) :
+                                      expression.find_first_of("\n\r", i + 2);
+                if (i == std::string_view::npos)
+                    {
+                    break;
+                    }
+                continue;
+                }
+            if (is_letter(ch) || ch == '_')
+                {
+                const size_t start{ i };
+                while (i < expression.length() && is_name_char_valid(expression[i]))
+                    {
+                    ++i;
+                    }
+                const std::string_view name{ expression.substr(start, i - start) };
+                if (find_variable_or_function(name) == m_customFuncsAndVars.cend() &&
+                    (m_sharedSymbols == nullptr ||
+                     find_shared_lookup(name) == m_sharedSymbols->cend()) &&
+                    find_builtin(name) == m_functions.cend())
+                    {
+                    unknownSymbols.emplace(name);
+                    }
+                continue;
+                }
+            // skip numbers, so that exponents (e.g., 1e5) aren't read as names
+            if ((ch >= '0' && ch <= '9') || ch == get_decimal_separator())
+                {
+                ++i;
+                while (i < expression.length() &&
+                       (is_name_char_valid(expression[i]) ||
+                        expression[i] == get_decimal_separator() ||
+                        ((expression[i] == '+' || expression[i] == '-') &&
+                         (expression[i - 1] == 'e' || expression[i - 1] == 'E'))))
+                    {
+                    ++i;
+                    }
+                continue;
+                }
+            ++i;
+            }
+        }
+
+    return unknownSymbols;
+    }
+
+//--------------------------------------------------
+void te_parser::resolve_unknown_symbols(const std::string_view* expressions,
+                                        const size_t expressionCount)
+    {
+    if (m_unknownSymbolResolve.index() != 3)
+        {
+        return;
+        }
+
+    auto unknownSymbols = find_unknown_symbols(expressions, expressionCount);
+    if (unknownSymbols.empty())
+        {
+        return;
+        }
+    const std::vector<std::string_view> names(unknownSymbols.cbegin(), unknownSymbols.cend());
+    const auto values = std::get<3>(m_unknownSymbolResolve)(names);
+    if (values.size() != names.size())
+        {
+        throw std::runtime_error(
+            "The unknown-symbol resolver did not return a value for each symbol.");
+        }
+    for (size_t i = 0; i < names.size(); ++i)
+        {
+        if (std::isfinite(values[i]))
+            {
+            add_variable_or_function({ te_variable::name_type{ names[i] }, values[i] });
+            m_resolvedVariables.insert(te_variable::name_type{ names[i] });
+            }
+        }
+    m_batchRequestedSymbols.merge(unknownSymbols);
+    }
+
 //--------------------------------------------------
 void te_parser::next_token(te_parser::state* theState)
     {
@@ -1299,6 +1871,7 @@ void te_parser::next_token(te_parser::state* theState)
 
     do // NOLINT
         {
+        theState->m_tokenStart = theState->m_next;
         if (*theState->m_next == 0)
             {
             theState->m_type = te_parser::state::token_type::TOK_END;
@@ -1334,8 +1907,22 @@ void te_parser::next_token(te_parser::state* theState)
                 m_varFound = false;
                 const std::string_view currentVarToken{ start, static_cast<std::string::size_type>(
                                                                    theState->m_next - start) };
-                m_currentVar = find_lookup(theState, currentVarToken);
-                if (m_currentVar != theState->m_lookup.cend())
+                const auto cachedLookup =
+                    m_cacheSymbolLookups ? m_symbolLookups.find(std::string{ currentVarToken }) :
+                                           m_symbolLookups.end();
+                if (cachedLookup != m_symbolLookups.end())
+                    {
+                    m_currentVar = cachedLookup->second;
+                    m_varFound = true;
+                    }
+                else if (m_currentVar = find_lookup(theState, currentVarToken);
+                         m_currentVar != theState->m_lookup.cend())
+                    {
+                    m_varFound = true;
+                    }
+                else if (m_sharedSymbols != nullptr &&
+                         (m_currentVar = find_shared_lookup(currentVarToken)) !=
+                             m_sharedSymbols->cend())
                     {
                     m_varFound = true;
                     }
@@ -1352,46 +1939,19 @@ void te_parser::next_token(te_parser::state* theState)
                         {
                         try
                             {
-                            // "te_type usr(string_view)" resolver
-                            if (m_unknownSymbolResolve.index() == 1)
-                                {
-                                const auto retUsrVal =
-                                    std::get<1>(m_unknownSymbolResolve)(currentVarToken);
-                                if (std::isfinite(retUsrVal))
-                                    {
-                                    add_variable_or_function(
-                                        { te_variable::name_type{ currentVarToken }, retUsrVal });
-                                    m_currentVar = find_lookup(theState, currentVarToken);
-                                    assert(
-                                        m_currentVar != theState->m_lookup.cend() &&
-                                        "Internal error in parser using unknown symbol resolver.");
-                                    if (m_currentVar != theState->m_lookup.cend())
-                                        {
-                                        m_resolvedVariables.insert(
-                                            te_variable::name_type{ currentVarToken });
-                                        m_varFound = true;
-                                        }
-                                    }
-                                }
-                            // "te_type usr(string_view, string&)" resolver
-                            else if (m_unknownSymbolResolve.index() == 2)
+                            const auto retUsrVal = resolve_unknown_symbol(currentVarToken);
+                            if (std::isfinite(retUsrVal))
                                 {
-                                const auto retUsrVal = std::get<2>(m_unknownSymbolResolve)(
-                                    currentVarToken, m_lastErrorMessage);
-                                if (std::isfinite(retUsrVal))
+                                add_variable_or_function(
+                                    { te_variable::name_type{ currentVarToken }, retUsrVal });
+                                m_currentVar = find_lookup(theState, currentVarToken);
+                                assert(m_currentVar != theState->m_lookup.cend() &&
+                                       "Internal error in parser using unknown symbol resolver.");
+                                if (m_currentVar != theState->m_lookup.cend())
                                     {
-                                    add_variable_or_function(
-                                        { te_variable::name_type{ currentVarToken }, retUsrVal });
-                                    m_currentVar = find_lookup(theState, currentVarToken);
-                                    assert(
-                                        m_currentVar != theState->m_lookup.cend() &&
-                                        "Internal error in parser using unknown symbol resolver.");
-                                    if (m_currentVar != theState->m_lookup.cend())
-                                        {
-                                        m_resolvedVariables.insert(
-                                            te_variable::name_type{ currentVarToken });
-                                        m_varFound = true;
-                                        }
+                                    m_resolvedVariables.insert(
+                                        te_variable::name_type{ currentVarToken });
+                                    m_varFound = true;
                                     }
                                 }
                             }
@@ -1408,9 +1968,15 @@ void te_parser::next_token(te_parser::state* theState)
                     }
                 else
                     {
+                    if (m_cacheSymbolLookups && cachedLookup == m_symbolLookups.end())
+                        {
+                        m_symbolLookups.emplace(currentVarToken, m_currentVar);
+                        }
 #ifndef TE_NO_BOOKKEEPING
                     // keep track of what's been used in the formula
-                    if (is_function(m_currentVar->m_value) || is_closure(m_currentVar->m_value))
+                    const bool isFunction{ is_function(m_currentVar->m_value) ||
+                                           is_closure(m_currentVar->m_value) };
+                    if (isFunction)
                         {
                         m_usedFunctions.insert(m_currentVar->m_name);
                         }
@@ -1418,6 +1984,12 @@ void te_parser::next_token(te_parser::state* theState)
                         {
                         m_usedVars.insert(m_currentVar->m_name);
                         }
+                    if (theState->m_symbolReferences != nullptr)
+                        {
+                        theState->m_symbolReferences->push_back(
+                            { static_cast<size_t>(start - theState->m_start), m_currentVar->m_name,
+                              isFunction });
+                        }
 #endif
 
                     if (is_constant(m_currentVar->m_value))
@@ -1679,6 +2251,7 @@ te_expr* te_parser::base(te_parser::state* theState)
 
     if (theState->m_type == te_parser::state::token_type::TOK_OPEN)
         {
+        const auto unitBegin = static_cast<size_t>(theState->m_next - theState->m_start);
         next_token(theState);
         ret = list(theState);
         if (theState->m_type != te_parser::state::token_type::TOK_CLOSE)
@@ -1687,17 +2260,27 @@ te_expr* te_parser::base(te_parser::state* theState)
             }
         else
             {
+            if (theState->m_reparseUnits != nullptr)
+                {
+                theState->m_reparseUnits->push_back(
+                    { unitBegin, static_cast<size_t>(theState->m_tokenStart - theState->m_start),
+                      ret, true });
+                }
             next_token(theState);
             }
         }
     else if (theState->m_type == te_parser::state::token_type::TOK_NUMBER)
         {
-        ret = new_expr(TE_DEFAULT, theState->m_value);
+        ret = new_expr(theState, TE_DEFAULT, theState->m_value);
         next_token(theState);
         }
     else if (theState->m_type == te_parser::state::token_type::TOK_VARIABLE)
         {
-        ret = new_expr(TE_DEFAULT, theState->m_value);
+        ret = new_expr(theState, TE_DEFAULT, theState->m_value);
+        if (ret != nullptr && theState->m_variableSlots != nullptr)
+            {
+            add_variable_slot(*theState->m_variableSlots, m_currentVar->m_name, ret);
+            }
         next_token(theState);
         }
     else if (theState->m_type == te_parser::state::token_type::TOK_NULL ||
@@ -1707,13 +2290,13 @@ te_expr* te_parser::base(te_parser::state* theState)
              theState->m_type == te_parser::state::token_type::TOK_CLOSE ||
              theState->m_type == te_parser::state::token_type::TOK_INFIX)
         {
-        ret = new_expr(TE_DEFAULT, te_variant_type{ te_nan });
+        ret = new_expr(theState, TE_DEFAULT, te_variant_type{ te_nan });
         theState->m_type = te_parser::state::token_type::TOK_ERROR;
         }
     else if (is_function0(theState->m_value) || is_closure0(theState->m_value))
         {
-        ret = new_expr(theState->m_varType, theState->m_value, {});
-        if (is_closure(theState->m_value))
+        ret = new_expr(theState, theState->m_varType, theState->m_value, {});
+        if (ret != nullptr && is_closure(theState->m_value))
             {
             ret->m_parameters[0] = theState->context;
             }
@@ -1733,13 +2316,17 @@ te_expr* te_parser::base(te_parser::state* theState)
         }
     else if (is_function1(theState->m_value) || is_closure1(theState->m_value))
         {
-        ret = new_expr(theState->m_varType, theState->m_value);
-        if (is_closure(theState->m_value))
+        ret = new_expr(theState, theState->m_varType, theState->m_value);
+        if (ret != nullptr && is_closure(theState->m_value))
             {
             ret->m_parameters[1] = theState->context;
             }
         next_token(theState);
-        ret->m_parameters[0] = power(theState);
+        te_expr* param = power(theState);
+        if (ret != nullptr)
+            {
+            ret->m_parameters[0] = param;
+            }
         }
     else if (is_function2(theState->m_value) || is_closure2(theState->m_value) ||
              is_function3(theState->m_value) || is_closure3(theState->m_value) ||
@@ -1750,8 +2337,8 @@ te_expr* te_parser::base(te_parser::state* theState)
         {
         const int arity = get_arity(theState->m_value);
 
-        ret = new_expr(theState->m_varType, theState->m_value);
-        if (is_closure(theState->m_value))
+        ret = new_expr(theState, theState->m_varType, theState->m_value);
+        if (ret != nullptr && is_closure(theState->m_value))
             {
             ret->m_parameters[arity] = theState->context;
             }
@@ -1771,8 +2358,22 @@ te_expr* te_parser::base(te_parser::state* theState)
             int i{ 0 }; // NOLINT
             for (i = 0; i < arity; i++)
                 {
+                const auto unitBegin = static_cast<size_t>(theState->m_next - theState->m_start);
                 next_token(theState);
-                ret->m_parameters[i] = expr_level1(theState);
+                te_expr* param = expr_level1(theState);
+                if (ret != nullptr)
+                    {
+                    ret->m_parameters[i] = param;
+                    }
+                if (theState->m_reparseUnits != nullptr &&
+                    (theState->m_type == te_parser::state::token_type::TOK_SEP ||
+                     theState->m_type == te_parser::state::token_type::TOK_CLOSE))
+                    {
+                    theState->m_reparseUnits->push_back(
+                        { unitBegin,
+                          static_cast<size_t>(theState->m_tokenStart - theState->m_start),
+                          param, false });
+                    }
                 if (theState->m_type != te_parser::state::token_type::TOK_SEP)
                     {
                     break;
@@ -1781,6 +2382,7 @@ te_expr* te_parser::base(te_parser::state* theState)
             if (theState->m_type == te_parser::state::token_type::TOK_CLOSE && (i != arity - 1) &&
                 varValid && is_variadic(openingVar->m_type))
                 {
+                specialize_variadic(ret, static_cast<size_t>(i) + 1);
                 next_token(theState);
                 }
             else if (theState->m_type != te_parser::state::token_type::TOK_CLOSE ||
@@ -1798,6 +2400,40 @@ te_expr* te_parser::base(te_parser::state* theState)
     return ret;
     }
 
+//--------------------------------------------------
+void te_parser::specialize_variadic(te_expr* texp, const size_t argumentCount)
+    {
+    // a closure's context has to stay after its last parameter
+    if (texp == nullptr || is_closure(texp->m_value))
+        {
+        return;
+        }
+    // the missing arguments are passed to the function as NaN without being evaluated
+    texp->m_parameters.resize(argumentCount);
+
+    if (!is_function7(texp->m_value))
+        {
+        return;
+        }
+    const auto function = get_function7(texp->m_value);
+    if (function == te_builtins::te_sum)
+        {
+        texp->m_value = te_builtins::te_specialized<te_builtins::te_sum_of>(argumentCount);
+        }
+    else if (function == te_builtins::te_average)
+        {
+        texp->m_value = te_builtins::te_specialized<te_builtins::te_average_of>(argumentCount);
+        }
+    else if (function == te_builtins::te_max)
+        {
+        texp->m_value = te_builtins::te_specialized<te_builtins::te_max_of>(argumentCount);
+        }
+    else if (function == te_builtins::te_min)
+        {
+        texp->m_value = te_builtins::te_specialized<te_builtins::te_min_of>(argumentCount);
+        }
+    }
+
 //--------------------------------------------------
 te_expr* te_parser::list(te_parser::state* theState)
     {
@@ -1807,7 +2443,7 @@ te_expr* te_parser::list(te_parser::state* theState)
     while (theState->m_type == te_parser::state::token_type::TOK_SEP)
         {
         next_token(theState);
-        ret = new_expr(TE_PURE, te_variant_type(te_builtins::te_comma),
+        ret = new_expr(theState, TE_PURE, te_variant_type(te_builtins::te_comma),
                        { ret, expr_level1(theState) });
         }
 
@@ -1829,7 +2465,7 @@ te_expr* te_parser::expr_level1(te_parser::state* theState)
         {
         const te_fun2 func = get_function2(theState->m_value);
         next_token(theState);
-        ret = new_expr(TE_PURE, func, { ret, expr_level2(theState) });
+        ret = new_expr(theState, TE_PURE, func, { ret, expr_level2(theState) });
         }
 
     return ret;
@@ -1848,7 +2484,7 @@ te_expr* te_parser::expr_level2(te_parser::state* theState)
         {
         const te_fun2 func = get_function2(theState->m_value);
         next_token(theState);
-        ret = new_expr(TE_PURE, func, { ret, expr_level3(theState) });
+        ret = new_expr(theState, TE_PURE, func, { ret, expr_level3(theState) });
         }
 
     return ret;
@@ -1867,7 +2503,7 @@ te_expr* te_parser::expr_level3(te_parser::state* theState)
         {
         const te_fun2 func = get_function2(theState->m_value);
         next_token(theState);
-        ret = new_expr(TE_PURE, func, { ret, expr_level4(theState) });
+        ret = new_expr(theState, TE_PURE, func, { ret, expr_level4(theState) });
         }
 
     return ret;
@@ -1886,7 +2522,7 @@ te_expr* te_parser::expr_level4(te_parser::state* theState)
         {
         const te_fun2 func = get_function2(theState->m_value);
         next_token(theState);
-        ret = new_expr(TE_PURE, func, { ret, expr_level5(theState) });
+        ret = new_expr(theState, TE_PURE, func, { ret, expr_level5(theState) });
         }
 
     return ret;
@@ -1905,7 +2541,7 @@ te_expr* te_parser::expr_level5(te_parser::state* theState)
         {
         const te_fun2 func = get_function2(theState->m_value);
         next_token(theState);
-        ret = new_expr(TE_PURE, func, { ret, expr_level6(theState) });
+        ret = new_expr(theState, TE_PURE, func, { ret, expr_level6(theState) });
         }
 
     return ret;
@@ -1925,7 +2561,7 @@ te_expr* te_parser::expr_level6(te_parser::state* theState)
         {
         const te_fun2 func = get_function2(theState->m_value);
         next_token(theState);
-        ret = new_expr(TE_PURE, func, { ret, expr_level7(theState) });
+        ret = new_expr(theState, TE_PURE, func, { ret, expr_level7(theState) });
         }
 
     return ret;
@@ -1946,7 +2582,7 @@ te_expr* te_parser::expr_level7(te_parser::state* theState)
         {
         const te_fun2 func = get_function2(theState->m_value);
         next_token(theState);
-        ret = new_expr(TE_PURE, func, { ret, expr_level8(theState) });
+        ret = new_expr(theState, TE_PURE, func, { ret, expr_level8(theState) });
         }
 
     return ret;
@@ -1976,7 +2612,7 @@ te_expr* te_parser::expr_level8(te_parser::state* theState)
         {
         const te_fun2 func = get_function2(theState->m_value);
         next_token(theState);
-        ret = new_expr(TE_PURE, func, { ret, expr_level9(theState) });
+        ret = new_expr(theState, TE_PURE, func, { ret, expr_level9(theState) });
         }
 
     return ret;
@@ -1995,7 +2631,7 @@ te_expr* te_parser::expr_level9(te_parser::state* theState)
         {
         const te_fun2 func = get_function2(theState->m_value);
         next_token(theState);
-        ret = new_expr(TE_PURE, func, { ret, term(theState) });
+        ret = new_expr(theState, TE_PURE, func, { ret, term(theState) });
         }
 
     return ret;
@@ -2017,7 +2653,7 @@ te_expr* te_parser::term(te_parser::state* theState)
         {
         const te_fun2 func = get_function2(theState->m_value);
         next_token(theState);
-        ret = new_expr(TE_PURE, func, { ret, factor(theState) });
+        ret = new_expr(theState, TE_PURE, func, { ret, factor(theState) });
         }
 
     return ret;
@@ -2033,7 +2669,7 @@ te_expr* te_parser::factor(te_parser::state* theState)
 
     int neg{ 0 };
 
-    if (ret->m_type == TE_PURE && is_function1(ret->m_value) &&
+    if (ret != nullptr && ret->m_type == TE_PURE && is_function1(ret->m_value) &&
         get_function1(ret->m_value) == te_builtins::te_negate)
         {
         te_expr* se = ret->m_parameters[0];
@@ -2053,20 +2689,21 @@ te_expr* te_parser::factor(te_parser::state* theState)
         if (insertion)
             {
             /* Make exponentiation go right-to-left. */
-            te_expr* insert = new_expr(TE_PURE, t, { insertion->m_parameters[1], power(theState) });
+            te_expr* insert = new_expr(theState, TE_PURE, t,
+                                       { insertion->m_parameters[1], power(theState) });
             insertion->m_parameters[1] = insert;
             insertion = insert;
             }
         else
             {
-            ret = new_expr(TE_PURE, t, { ret, power(theState) });
+            ret = new_expr(theState, TE_PURE, t, { ret, power(theState) });
             insertion = ret;
             }
         }
 
     if (neg)
         {
-        ret = new_expr(TE_PURE, te_variant_type(te_builtins::te_negate), { ret });
+        ret = new_expr(theState, TE_PURE, te_variant_type(te_builtins::te_negate), { ret });
         }
 
     return ret;
@@ -2084,7 +2721,7 @@ te_expr* te_parser::factor(te_parser::state* theState)
         {
         const te_fun2 func = get_function2(theState->m_value);
         next_token(theState);
-        ret = new_expr(TE_PURE, func, { ret, power(theState) });
+        ret = new_expr(theState, TE_PURE, func, { ret, power(theState) });
         }
 
     return ret;
@@ -2125,11 +2762,13 @@ te_expr* te_parser::power(te_parser::state* theState)
 
     if (bitwiseNot)
         {
-        ret = new_expr(TE_PURE, te_variant_type(te_builtins::te_bitwise_not), { base(theState) });
+        ret = new_expr(theState, TE_PURE, te_variant_type(te_builtins::te_bitwise_not),
+                       { base(theState) });
         }
     else if (theSign == -1)
         {
-        ret = new_expr(TE_PURE, te_variant_type(te_builtins::te_negate), { base(theState) });
+        ret = new_expr(theState, TE_PURE, te_variant_type(te_builtins::te_negate),
+                       { base(theState) });
         }
     else
         {
@@ -2147,11 +2786,20 @@ te_type te_parser::te_eval(const te_expr* texp)
         return te_nan;
         }
 
-    // NOLINTBEGIN
-    // cppcheck-suppress unreadVariable
-    const auto M = [&texp = std::as_const(texp)](const size_t e)
-    { return (e < texp->m_parameters.size()) ? te_eval(texp->m_parameters[e]) : te_nan; };
+    return te_eval_node(texp,
+                        [&texp = std::as_const(texp)](const size_t e)
+                        {
+                            return (e < texp->m_parameters.size()) ?
+                                       te_eval(texp->m_parameters[e]) :
+                                       te_nan;
+                        });
+    }
 
+//--------------------------------------------------
+template<typename Evaluate>
+te_type te_parser::te_eval_node(const te_expr* texp, const Evaluate& M)
+    {
+    // NOLINTBEGIN
     switch (texp->m_value.index())
         {
     case 0:
@@ -2161,18 +2809,52 @@ te_type te_parser::te_eval(const te_expr* texp)
     case 2:
         return get_function0(texp->m_value)();
     case 3:
+        if (get_function1(texp->m_value) == te_builtins::te_integer_subtree)
+            {
+            if (const auto operation = get_integer_operation(texp->m_parameters[0]);
+                operation != integer_operation::none)
+                {
+                return static_cast<te_type>(te_eval_integer(texp->m_parameters[0], operation));
+                }
+            }
         return get_function1(texp->m_value)(M(0));
     case 4:
+        if (const auto function = get_function2(texp->m_value);
+            function == te_builtins::te_and || function == te_builtins::te_or)
+            {
+            return te_eval_short_circuit(texp, M);
+            }
         return get_function2(texp->m_value)(M(0), M(1));
     case 5:
+        if (get_function3(texp->m_value) == te_builtins::te_if)
+            {
+            return double_to_bool(M(0)) ? M(1) : M(2);
+            }
         return get_function3(texp->m_value)(M(0), M(1), M(2));
     case 6:
         return get_function4(texp->m_value)(M(0), M(1), M(2), M(3));
     case 7:
         return get_function5(texp->m_value)(M(0), M(1), M(2), M(3), M(4));
     case 8:
+        if (get_function6(texp->m_value) == te_builtins::te_ifs)
+            {
+            // the missing conditions are NaN, which are false
+            for (size_t i = 0; i < texp->m_parameters.size(); i += 2)
+                {
+                if (double_to_bool(M(i)))
+                    {
+                    return M(i + 1);
+                    }
+                }
+            return te_nan;
+            }
         return get_function6(texp->m_value)(M(0), M(1), M(2), M(3), M(4), M(5));
     case 9:
+        if (const auto function = get_function7(texp->m_value);
+            function == te_builtins::te_and_variadic || function == te_builtins::te_or_variadic)
+            {
+            return te_eval_short_circuit(texp, M);
+            }
         return get_function7(texp->m_value)(M(0), M(1), M(2), M(3), M(4), M(5), M(6));
     case 10:
         return get_closure0(texp->m_value)(texp->m_parameters[0]);
@@ -2199,49 +2881,314 @@ te_type te_parser::te_eval(const te_expr* texp)
     }
 
 //--------------------------------------------------
-void te_parser::optimize(te_expr* texp)
+bool te_parser::is_short_circuit(const te_variant_type& value)
     {
-    if (texp == nullptr)
+    return (is_function2(value) && (get_function2(value) == te_builtins::te_and ||
+                                    get_function2(value) == te_builtins::te_or)) ||
+           (is_function3(value) && get_function3(value) == te_builtins::te_if) ||
+           (is_function6(value) && get_function6(value) == te_builtins::te_ifs) ||
+           (is_function7(value) && (get_function7(value) == te_builtins::te_and_variadic ||
+                                    get_function7(value) == te_builtins::te_or_variadic));
+    }
+
+//--------------------------------------------------
+template<typename Evaluate>
+te_type te_parser::te_eval_short_circuit(const te_expr* texp, const Evaluate& M)
+    {
+    const bool isAnd = is_function2(texp->m_value) ?
+                           (get_function2(texp->m_value) == te_builtins::te_and) :
+                           (get_function7(texp->m_value) == te_builtins::te_and_variadic);
+    const te_type first = M(0);
+    if (is_function2(texp->m_value))
+        {
+        // Same as te_and() and te_or(): the result is decided by a valid first
+        // value that is false (for AND) or true (for OR). Otherwise, NaN is only
+        // returned if both values are invalid.
+        if (std::isfinite(first) && double_to_bool(first) != isAnd)
+            {
+            return isAnd ? 0 : 1;
+            }
+        const te_type second = M(1);
+        if (!std::isfinite(first) && !std::isfinite(second))
+            {
+            return te_nan;
+            }
+        return isAnd ? static_cast<te_type>(double_to_bool(first) && double_to_bool(second)) :
+                       static_cast<te_type>(double_to_bool(first) || double_to_bool(second));
+        }
+
+    // Same as te_and_variadic() and te_or_variadic(): the first value must be valid
+    // and invalid values after that (including missing arguments) are ignored.
+    if (!std::isfinite(first))
         {
-        return;
+        return te_nan;
         }
-    /* Evaluates as much as possible. */
-    if (is_constant(texp->m_value) || is_variable(texp->m_value))
+    bool result{ double_to_bool(first) };
+    for (size_t i = 1; i < texp->m_parameters.size() && result == isAnd; ++i)
         {
-        return;
+        if (const te_type value = M(i); std::isfinite(value))
+            {
+            result = double_to_bool(value);
+            }
         }
+    return static_cast<te_type>(result);
+    }
 
-    /* Only optimize out functions flagged as pure. */
-    if (is_pure(texp->m_type))
+//--------------------------------------------------
+te_parser::integer_operation te_parser::get_integer_operation(const te_expr* texp)
+    {
+    if (texp == nullptr)
         {
-        const int arity = get_arity(texp->m_value);
-        bool known{ true };
-        for (int i = 0; i < arity; ++i)
+        return integer_operation::none;
+        }
+    if (is_function2(texp->m_value))
+        {
+        static constexpr std::pair<te_fun2, integer_operation> operations[]{
+            { te_builtins::te_bitwise_and, integer_operation::bitwise_and },
+            { te_builtins::te_bitwise_or, integer_operation::bitwise_or },
+            { te_builtins::te_bitwise_xor, integer_operation::bitwise_xor },
+            { te_builtins::te_left_shift, integer_operation::left_shift },
+            { te_builtins::te_right_shift, integer_operation::right_shift },
+            { te_builtins::te_left_shift_or_right, integer_operation::left_shift_or_right },
+            { te_builtins::te_right_shift_or_left, integer_operation::right_shift_or_left },
+#if __cplusplus >= 202002L && !defined(TE_FLOAT)
+            { te_builtins::te_left_rotate, integer_operation::left_rotate },
+            { te_builtins::te_right_rotate, integer_operation::right_rotate },
+            { te_builtins::te_left_rotate8, integer_operation::left_rotate8 },
+            { te_builtins::te_right_rotate8, integer_operation::right_rotate8 },
+            { te_builtins::te_left_rotate16, integer_operation::left_rotate16 },
+            { te_builtins::te_right_rotate16, integer_operation::right_rotate16 },
+            { te_builtins::te_left_rotate32, integer_operation::left_rotate32 },
+            { te_builtins::te_right_rotate32, integer_operation::right_rotate32 },
+            { te_builtins::te_left_rotate64, integer_operation::left_rotate64 },
+            { te_builtins::te_right_rotate64, integer_operation::right_rotate64 },
+#endif
+        };
+        const auto function = get_function2(texp->m_value);
+        for (const auto& [operationFunction, operation] : operations)
             {
-            if (texp->m_parameters[i] == nullptr)
+            if (function == operationFunction)
                 {
-                break;
+                return operation;
                 }
-            optimize(texp->m_parameters[i]);
-            if (!is_constant(texp->m_parameters[i]->m_value))
+            }
+        }
+    else if (is_function1(texp->m_value))
+        {
+        static constexpr std::pair<te_fun1, integer_operation> operations[]{
+            { te_builtins::te_bitwise_not, integer_operation::bitwise_not },
+            { te_builtins::te_bitwise_not8, integer_operation::bitwise_not8 },
+            { te_builtins::te_bitwise_not16, integer_operation::bitwise_not16 },
+            { te_builtins::te_bitwise_not32, integer_operation::bitwise_not32 },
+            { te_builtins::te_bitwise_not64, integer_operation::bitwise_not64 }
+        };
+        const auto function = get_function1(texp->m_value);
+        for (const auto& [operationFunction, operation] : operations)
+            {
+            if (function == operationFunction)
                 {
-                known = false;
+                return operation;
                 }
             }
-        if (known)
-            {
-            const auto value = te_eval(texp);
+        }
+    return integer_operation::none;
+    }
+
+//--------------------------------------------------
+uint64_t te_parser::te_eval_integer(const te_expr* texp, const integer_operation operation)
+    {
+    // the operands that are bitwise operations are evaluated as integers,
+    // and the others are evaluated normally (and checked by the operation)
+    const auto evaluate = [](const te_expr* operand)
+        {
+        if (operand != nullptr && is_constant(operand->m_value))
+            {
+            return get_constant(operand->m_value);
+            }
+        if (operand != nullptr && is_variable(operand->m_value))
+            {
+            return *(get_variable(operand->m_value));
+            }
+        return te_eval(operand);
+        };
+    const te_expr* first = texp->m_parameters[0];
+    const auto firstOperation = get_integer_operation(first);
+    if (is_function1(texp->m_value))
+        {
+        return (firstOperation != integer_operation::none) ?
+                   te_eval_integer_operation(operation, te_eval_integer(first, firstOperation)) :
+                   te_eval_integer_operation(operation, evaluate(first));
+        }
+
+    // the operands are evaluated as the arguments of one call,
+    // like te_eval_node() does (so that errors are thrown in the same order)
+    const te_expr* second = texp->m_parameters[1];
+    const auto secondOperation = get_integer_operation(second);
+    if (firstOperation != integer_operation::none)
+        {
+        return (secondOperation != integer_operation::none) ?
+                   te_eval_integer_operation(operation, te_eval_integer(first, firstOperation),
+                                             te_eval_integer(second, secondOperation)) :
+                   te_eval_integer_operation(operation, te_eval_integer(first, firstOperation),
+                                             evaluate(second));
+        }
+    return (secondOperation != integer_operation::none) ?
+               te_eval_integer_operation(operation, evaluate(first),
+                                         te_eval_integer(second, secondOperation)) :
+               te_eval_integer_operation(operation, evaluate(first), evaluate(second));
+    }
+
+//--------------------------------------------------
+template<typename T>
+uint64_t te_parser::te_eval_integer_operation(const integer_operation operation, const T val)
+    {
+    switch (operation)
+        {
+    case integer_operation::bitwise_not8:
+        return te_builtins::te_bitwise_not8_integer(val);
+    case integer_operation::bitwise_not16:
+        return te_builtins::te_bitwise_not16_integer(val);
+    case integer_operation::bitwise_not32:
+        return te_builtins::te_bitwise_not32_integer(val);
+    case integer_operation::bitwise_not64:
+        return te_builtins::te_bitwise_not64_integer(val);
+    default:
+        return te_builtins::te_bitwise_not_integer(val);
+        };
+    }
+
+//--------------------------------------------------
+template<typename T1, typename T2>
+uint64_t te_parser::te_eval_integer_operation(const integer_operation operation, const T1 val1,
+                                              const T2 val2)
+    {
+    switch (operation)
+        {
+    case integer_operation::bitwise_or:
+        return te_builtins::te_bitwise_or_integer(val1, val2);
+    case integer_operation::bitwise_xor:
+        return te_builtins::te_bitwise_xor_integer(val1, val2);
+    case integer_operation::left_shift:
+        return te_builtins::te_left_shift_integer(val1, val2);
+    case integer_operation::right_shift:
+        return te_builtins::te_right_shift_integer(val1, val2);
+    case integer_operation::left_shift_or_right:
+        return te_builtins::te_left_shift_or_right_integer(val1, val2);
+    case integer_operation::right_shift_or_left:
+        return te_builtins::te_right_shift_or_left_integer(val1, val2);
+#if __cplusplus >= 202002L && !defined(TE_FLOAT)
+    case integer_operation::left_rotate:
+        return te_builtins::te_left_rotate_integer(val1, val2);
+    case integer_operation::right_rotate:
+        return te_builtins::te_right_rotate_integer(val1, val2);
+    case integer_operation::left_rotate8:
+        return te_builtins::te_left_rotate8_integer(val1, val2);
+    case integer_operation::right_rotate8:
+        return te_builtins::te_right_rotate8_integer(val1, val2);
+    case integer_operation::left_rotate16:
+        return te_builtins::te_left_rotate16_integer(val1, val2);
+    case integer_operation::right_rotate16:
+        return te_builtins::te_right_rotate16_integer(val1, val2);
+    case integer_operation::left_rotate32:
+        return te_builtins::te_left_rotate32_integer(val1, val2);
+    case integer_operation::right_rotate32:
+        return te_builtins::te_right_rotate32_integer(val1, val2);
+    case integer_operation::left_rotate64:
+        return te_builtins::te_left_rotate64_integer(val1, val2);
+    case integer_operation::right_rotate64:
+        return te_builtins::te_right_rotate64_integer(val1, val2);
+#endif
+    default:
+        return te_builtins::te_bitwise_and_integer(val1, val2);
+        };
+    }
+
+//--------------------------------------------------
+bool te_parser::evaluate_integer_subtrees(te_expr* texp, const bool inSubtree)
+    {
+    if (texp == nullptr)
+        {
+        return false;
+        }
+
+    bool changed{ false };
+    const bool isOperation = (get_integer_operation(texp) != integer_operation::none);
+    te_expr* node = texp;
+    // only the top of a subtree is marked, and only if it has more than one operation
+    // (there is nothing to gain from a single one)
+    if (isOperation && !inSubtree &&
+        std::any_of(texp->m_parameters.cbegin(), texp->m_parameters.cend(),
+                    [](const auto* parameter)
+                    { return get_integer_operation(parameter) != integer_operation::none; }))
+        {
+        node = new te_expr(texp->m_type, texp->m_value);
+        node->m_parameters = std::move(texp->m_parameters);
+        texp->m_type = TE_PURE;
+        texp->m_value = static_cast<te_fun1>(te_builtins::te_integer_subtree);
+        texp->m_parameters = { node };
+        changed = true;
+        }
+    for (size_t i = 0; i < get_owned_parameter_count(node); ++i)
+        {
+        changed = evaluate_integer_subtrees(node->m_parameters[i], isOperation) || changed;
+        }
+    return changed;
+    }
+
+//--------------------------------------------------
+bool te_parser::optimize(te_expr* texp)
+    {
+    if (texp == nullptr)
+        {
+        return false;
+        }
+    /* Evaluates as much as possible. */
+    if (is_constant(texp->m_value) || is_variable(texp->m_value))
+        {
+        return false;
+        }
+
+    /* Only optimize out functions flagged as pure. */
+    bool folded{ false };
+    if (is_pure(texp->m_type))
+        {
+        bool known{ true };
+        for (size_t i = 0; i < get_owned_parameter_count(texp); ++i)
+            {
+            if (texp->m_parameters[i] == nullptr)
+                {
+                break;
+                }
+            folded = optimize(texp->m_parameters[i]) || folded;
+            if (!is_constant(texp->m_parameters[i]->m_value))
+                {
+                known = false;
+                }
+            }
+        if (known)
+            {
+            const auto value = te_eval(texp);
             te_free_parameters(texp);
             texp->m_type = TE_DEFAULT;
             texp->m_value = value;
+            folded = true;
             }
         }
+    return folded;
     }
 
 //--------------------------------------------------
 te_expr* te_parser::te_compile(const std::string_view expression, std::set<te_variable>& variables)
     {
     state theState(expression.data(), TE_DEFAULT, variables);
+    theState.m_variableSlots = &m_variableSlots;
+    if (is_incremental_compilation_enabled())
+        {
+        theState.m_reparseUnits = &m_reparseUnits;
+#ifndef TE_NO_BOOKKEEPING
+        theState.m_symbolReferences = &m_symbolReferences;
+#endif
+        }
 
     next_token(&theState);
     te_expr* root = list(&theState);
@@ -2257,21 +3204,86 @@ te_expr* te_parser::te_compile(const std::string_view expression, std::set<te_va
         return nullptr;
         }
 
-    optimize(root);
+    // folding can throw (e.g., division by zero), and the tree isn't returned to be freed then
+    try
+        {
+        if (m_constantFolding)
+            {
+            run_optimization_pass("constant folding", [&root]() { return optimize(root); });
+            }
+        if (m_reassociation != reassociation::none && !is_incremental_compilation_enabled())
+            {
+            run_optimization_pass("reassociation",
+                                  [this, &root]()
+                                  {
+                                      const size_t changeCount{ get_simplification_count() };
+                                      root = reassociate(root);
+                                      return get_simplification_count() != changeCount;
+                                  });
+            }
+        if (m_simplification != simplification::none)
+            {
+            run_optimization_pass("simplification",
+                                  [this, &root]()
+                                  {
+                                      const size_t changeCount{ get_simplification_count() };
+                                      root = simplify(root, m_variableSlots);
+                                      return get_simplification_count() != changeCount;
+                                  });
+            }
+        if (m_integerEvaluation && !is_incremental_compilation_enabled())
+            {
+            run_optimization_pass("integer evaluation",
+                                  [&root]() { return evaluate_integer_subtrees(root); });
+            }
+        }
+    catch (...)
+        {
+        te_free(root);
+        throw;
+        }
     m_errorPos = te_parser::npos;
     return root;
     }
 
 //--------------------------------------------------
-bool te_parser::compile(const std::string_view expression)
+bool te_parser::te_validate(const std::string_view expression, std::set<te_variable>& variables)
+    {
+    state theState(expression.data(), TE_DEFAULT, variables);
+    theState.m_validateOnly = true;
+
+    next_token(&theState);
+    [[maybe_unused]] const te_expr* root = list(&theState);
+    assert(root == nullptr && "Node was created while validating expression.");
+
+    if (theState.m_type != te_parser::state::token_type::TOK_END)
+        {
+        m_errorPos = (theState.m_next - theState.m_start);
+        if (m_errorPos > 0)
+            {
+            --m_errorPos;
+            }
+        return false;
+        }
+
+    m_errorPos = te_parser::npos;
+    return true;
+    }
+
+//--------------------------------------------------
+bool te_parser::prepare_expression(const std::string_view expression)
     {
     // reset everything from previous call
     m_errorPos = te_parser::npos;
     m_lastErrorMessage.clear();
     m_result = te_nan;
     m_parseSuccess = false;
-    te_free(m_compiledExpression);
-    m_compiledExpression = nullptr;
+    m_compiledExpression.reset();
+    m_commonSubexpressions.reset();
+    m_variableSlots.clear();
+    m_dirtyTracking = dirty_tracking{};
+    m_optimizationReport.clear();
+    m_variablesRebound = false;
     m_currentVar = m_functions.cend();
     m_varFound = false;
 #ifndef TE_NO_BOOKKEEPING
@@ -2279,6 +3291,8 @@ bool te_parser::compile(const std::string_view expression)
     m_usedVars.clear();
 #endif
     m_resolvedVariables.clear();
+    m_batchRequestedSymbols.clear();
+    reset_incremental_state();
     if (get_list_separator() == get_decimal_separator())
         {
         throw std::runtime_error("List and decimal separators cannot be the same");
@@ -2313,8 +3327,6 @@ bool te_parser::compile(const std::string_view expression)
             if (commentEnd == std::string::npos)
                 {
                 m_errorPos = static_cast<decltype(m_errorPos)>(commentStart);
-                m_parseSuccess = false;
-                m_result = te_nan;
                 return false;
                 }
             m_expression.erase(commentStart, (commentEnd + 2) - commentStart);
@@ -2336,68 +3348,2809 @@ bool te_parser::compile(const std::string_view expression)
             }
         }
 
+    return true;
+    }
+
+//--------------------------------------------------
+bool te_parser::compile(const std::string_view expression)
+    {
+    // copy this before m_expression is edited below, as expression may be a view of it
+    std::string cacheKey{ (get_expression_cache_size() > 0) ? expression : std::string_view{} };
+    if (!prepare_expression(expression))
+        {
+        return false;
+        }
+
     try
         {
-        m_compiledExpression = te_compile(m_expression, get_variables_and_functions());
+        const std::string_view preparedExpression{ m_expression };
+        resolve_unknown_symbols(&preparedExpression, 1);
+
+        std::string formulaCacheKey;
+        if (is_using_formula_cache() && !is_incremental_compilation_enabled())
+            {
+            formulaCacheKey = make_formula_cache_key(m_expression);
+            if (auto formula = m_formulaCache->find(formulaCacheKey, *get_binding_signature());
+                formula != nullptr)
+                {
+                load_compiled_formula(formula);
+                // evaluating common subexpressions writes to them,
+                // so other parsers can't share them
+                if (m_commonSubexpressions != nullptr)
+                    {
+                    make_compiled_expression_unique();
+                    formula = make_compiled_formula();
+                    }
+                m_parseSuccess = true;
+                cache_compiled_expression(std::move(cacheKey), std::move(formula));
+                return m_parseSuccess;
+                }
+            }
+
+        m_compiledExpression.reset(te_compile(m_expression, m_customFuncsAndVars), te_free);
         m_parseSuccess = (m_compiledExpression != nullptr);
+        if (!m_parseSuccess)
+            {
+            m_variableSlots.clear();
+            reset_incremental_state();
+            }
+        else if (is_incremental_compilation_enabled())
+            {
+            start_incremental_tracking();
+            }
+        else
+            {
+            if (is_common_subexpression_elimination_enabled())
+                {
+                run_optimization_pass("common subexpression elimination",
+                                      [this]()
+                                      {
+                                          eliminate_common_subexpressions();
+                                          return m_commonSubexpressions != nullptr;
+                                      });
+                }
+            if (get_expression_cache_size() > 0 || is_using_formula_cache())
+                {
+                auto formula = make_compiled_formula();
+                if (is_using_formula_cache())
+                    {
+                    m_formulaCache->insert(std::move(formulaCacheKey), get_binding_signature(),
+                                           formula);
+                    }
+                cache_compiled_expression(std::move(cacheKey), std::move(formula));
+                }
+            }
         }
     catch (const std::exception& expt)
         {
         m_parseSuccess = false;
         m_result = te_nan;
         m_lastErrorMessage = expt.what();
+        m_variableSlots.clear();
         }
 
     reset_usr_resolved_if_necessary();
+    m_incrementalVersion = m_symbolTableVersion;
 
     return m_parseSuccess;
     }
 
 //--------------------------------------------------
-te_type te_parser::evaluate()
+bool te_parser::compile_resolved(const std::string_view expression,
+                                 const std::vector<std::string_view>& names,
+                                 const std::vector<te_type>& values,
+                                 const std::string& resolverError)
+    {
+    // compile with a batch resolver that returns what was already resolved
+    // (if the resolver didn't return a value for each symbol, then the values are passed
+    //  along as they are, which fails the compile with the usual error)
+    auto previousResolver = std::exchange(
+        m_unknownSymbolResolve,
+        te_usr_batch{ [&names, &values](const std::vector<std::string_view>& symbols)
+                      {
+                          if (values.size() != names.size())
+                              {
+                              return values;
+                              }
+                          std::vector<te_type> symbolValues;
+                          symbolValues.reserve(symbols.size());
+                          for (const auto& symbol : symbols)
+                              {
+                              const auto name =
+                                  std::find(names.cbegin(), names.cend(), symbol);
+                              symbolValues.push_back(
+                                  (name != names.cend()) ?
+                                      values[static_cast<size_t>(name - names.cbegin())] :
+                                      te_nan);
+                              }
+                          return symbolValues;
+                      } });
+    bool compiled{ false };
+    try
+        {
+        compiled = compile(expression);
+        }
+    catch (...)
+        {
+        m_unknownSymbolResolve = std::move(previousResolver);
+        throw;
+        }
+    m_unknownSymbolResolve = std::move(previousResolver);
+    if (!compiled && !resolverError.empty())
+        {
+        m_lastErrorMessage = resolverError;
+        }
+    return compiled;
+    }
+
+//--------------------------------------------------
+std::shared_ptr<const te_program> te_parser::compile_program(const std::string_view expression)
+    {
+    if (!compile(expression) || m_compiledExpression == nullptr)
+        {
+        return nullptr;
+        }
+    return make_program(false);
+    }
+
+//--------------------------------------------------
+std::shared_ptr<te_program> te_parser::make_program(const bool takeCompiledExpression)
+    {
+    // an expression that is shared with a cache has to be copied
+    const bool takeExpression{ takeCompiledExpression && m_compiledExpression.use_count() == 1 &&
+                               (m_commonSubexpressions == nullptr ||
+                                m_commonSubexpressions.use_count() == 1) };
+
+    std::shared_ptr<te_program> program{ new te_program };
+    program->m_expression = m_expression;
+    program->m_variableNames = get_bound_variable_names();
+    program->m_estimatedCost = estimate_cost(m_compiledExpression.get());
+    std::unordered_map<const te_expr*, te_expr*> copiedNodes;
+    if (takeExpression)
+        {
+        program->m_compiledExpression = std::move(m_compiledExpression);
+        }
+    else
+        {
+        program->m_compiledExpression.reset(te_copy(m_compiledExpression.get(), copiedNodes),
+                                            te_free);
+        }
+    if (m_commonSubexpressions != nullptr)
+        {
+        for (auto* subexpression : m_commonSubexpressions->m_expressions)
+            {
+            program->m_estimatedCost += estimate_cost(subexpression);
+            program->m_subexpressions.emplace_back(
+                takeExpression ? subexpression : te_copy(subexpression, copiedNodes), te_free);
+            }
+        if (takeExpression)
+            {
+            m_commonSubexpressions->m_expressions.clear();
+            }
+        }
+    // the program's node for a node in the parser's expression
+    const auto programNode = [takeExpression, &copiedNodes](const te_expr* node) -> te_expr*
+    {
+        if (takeExpression)
+            {
+            return const_cast<te_expr*>(node);
+            }
+        const auto copiedNode = copiedNodes.find(node);
+        return (copiedNode == copiedNodes.cend()) ? nullptr : copiedNode->second;
+    };
+
+    // The variables' nodes read from the evaluation's values if it has any,
+    // and from the addresses that they are bound to otherwise.
+    for (size_t i = 0; i < m_variableSlots.size(); ++i)
+        {
+        for (const auto* node : m_variableSlots[i].m_nodes)
+            {
+            auto* copy = programNode(node);
+            if (copy == nullptr || !is_variable(copy->m_value))
+                {
+                continue;
+                }
+            program->m_variableReferences.push_back(
+                std::make_unique<te_program::variable_reference>(i, get_variable(copy->m_value)));
+            copy->m_value = static_cast<te_confun0>(te_program::read_variable);
+            copy->m_parameters = { program->m_variableReferences.back().get() };
+            }
+        }
+
+    if (m_commonSubexpressions != nullptr)
+        {
+        const size_t subexpressionCount{ program->m_subexpressions.size() };
+        for (size_t i = 0; i < subexpressionCount; ++i)
+            {
+            program->m_subexpressionReferences.push_back(
+                std::make_unique<te_program::subexpression_reference>(i));
+            }
+        // The nodes that read the subexpressions' results are bound to the parser's results,
+        // so they are changed to read the results of the evaluation that is running instead.
+        const te_type* const values{ m_commonSubexpressions->m_values.get() };
+        const auto bindSubexpressions = [&program, values, subexpressionCount](
+                                            const auto& self, te_expr* node) -> void
+        {
+            if (node == nullptr)
+                {
+                return;
+                }
+            const auto* const* value = std::get_if<const te_type*>(&node->m_value);
+            if (value != nullptr && std::less_equal<>{}(values, *value) &&
+                std::less<>{}(*value, values + subexpressionCount))
+                {
+                const auto index = static_cast<size_t>(*value - values);
+                node->m_value = static_cast<te_confun0>(te_program::read_subexpression);
+                node->m_parameters = { program->m_subexpressionReferences[index].get() };
+                return;
+                }
+            for (size_t i = 0; i < get_owned_parameter_count(node); ++i)
+                {
+                self(self, node->m_parameters[i]);
+                }
+        };
+        bindSubexpressions(bindSubexpressions, program->m_compiledExpression.get());
+        for (const auto& subexpression : program->m_subexpressions)
+            {
+            bindSubexpressions(bindSubexpressions, subexpression.get());
+            }
+        }
+
+    if (takeExpression)
+        {
+        // the parser's nodes now belong to the program
+        m_commonSubexpressions.reset();
+        m_variableSlots.clear();
+        }
+    return program;
+    }
+
+//--------------------------------------------------
+bool te_parser::validate(const std::string_view expression)
     {
+    if (!prepare_expression(expression))
+        {
+        return false;
+        }
+
     try
         {
-        m_result = (m_compiledExpression != nullptr) ? te_eval(m_compiledExpression) : te_nan;
+        const std::string_view preparedExpression{ m_expression };
+        resolve_unknown_symbols(&preparedExpression, 1);
+        m_parseSuccess = te_validate(m_expression, m_customFuncsAndVars);
         }
     catch (const std::exception& expt)
         {
         m_parseSuccess = false;
-        m_result = te_nan;
         m_lastErrorMessage = expt.what();
         }
 
     reset_usr_resolved_if_necessary();
 
-    return m_result;
+    return m_parseSuccess;
     }
 
 //--------------------------------------------------
-te_type
-te_parser::evaluate(const std::string_view expression) // NOLINT(-readability-identifier-naming)
+std::vector<te_parser::compile_result> te_parser::compile_many(const std::string_view* expressions,
+                                                               const size_t expressionCount,
+                                                               size_t threadCount,
+                                                               te_program_registry* registry)
     {
-    if (compile(expression))
+    if (get_list_separator() == get_decimal_separator())
         {
-        return evaluate();
+        throw std::runtime_error("List and decimal separators cannot be the same");
         }
-    return te_nan;
-    }
 
-//--------------------------------------------------
-// cppcheck-suppress unusedFunction
-std::string te_parser::list_available_functions_and_variables()
+    std::vector<compile_result> results(expressionCount);
+    if (expressionCount == 0)
+        {
+        return results;
+        }
+
+    threadCount = std::clamp<size_t>(threadCount, 1, expressionCount);
+
+    // each thread gets its own parser, all set up like this one and sharing its symbols
+    // (the resolver may not be thread safe, so the workers take turns calling it)
+    shared_resolutions resolutions;
+    // a batch resolver is called once for all of the expressions, before the workers start
+    // (if it throws, then the workers ask it about each symbol instead)
+    m_resolvedVariables.clear();
+    m_batchRequestedSymbols.clear();
+    try
+        {
+        resolve_unknown_symbols(expressions, expressionCount);
+        resolutions.m_batchRequestedSymbols = std::move(m_batchRequestedSymbols);
+        }
+    catch (const std::exception& expt)
+        {
+        m_lastErrorMessage = expt.what();
+        }
+    std::vector<std::unique_ptr<te_parser>> workers(threadCount);
+    for (auto& worker : workers)
+        {
+        worker = std::make_unique<te_parser>();
+        worker->m_sharedSymbols = &m_customFuncsAndVars;
+        worker->m_sharedResolutions = &resolutions;
+        worker->m_decimalSeparator = m_decimalSeparator;
+        worker->m_listSeparator = m_listSeparator;
+        worker->m_unknownSymbolResolve = m_unknownSymbolResolve;
+        // only resolve each unknown symbol once
+        worker->m_keepResolvedVarialbes = true;
+        worker->m_formulaCache = m_formulaCache;
+        worker->m_expressionCacheSize = 0;
+        worker->m_commonSubexpressionElimination = m_commonSubexpressionElimination;
+        worker->m_simplification = m_simplification;
+        worker->m_reassociation = m_reassociation;
+        worker->m_constantFolding = m_constantFolding;
+        worker->m_integerEvaluation = m_integerEvaluation;
+        worker->m_cacheSymbolLookups = true;
+        }
+
+    std::atomic<size_t> nextExpression{ 0 };
+    const auto compileExpressions = [&results, &nextExpression, expressions, expressionCount,
+                                     registry](te_parser& worker)
     {
-    std::string report = "Built-in Functions:\n";
-    for (const auto& func : m_functions)
+        for (size_t i = nextExpression++; i < expressionCount; i = nextExpression++)
+            {
+            if (registry == nullptr)
+                {
+                worker.compile(expressions[i]);
+                }
+            else if (registry->find(expressions[i]) != nullptr)
+                {
+                results[i] = compile_result{ true, npos, std::string{} };
+                continue;
+                }
+            else if (worker.compile(expressions[i]) && worker.m_compiledExpression != nullptr)
+                {
+                // the worker doesn't need its compiled expression afterwards,
+                // so the program takes it (instead of copying it)
+                registry->insert(expressions[i], worker.make_program(true));
+                results[i] = compile_result{ true, npos, std::string{} };
+                continue;
+                }
+            results[i] = compile_result{ worker.success(), worker.get_last_error_position(),
+                                         worker.get_last_error_message() };
+            }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (size_t i = 1; i < threadCount; ++i)
         {
-        report.append(func.m_name).append("\n");
+        threads.emplace_back(compileExpressions, std::ref(*workers[i]));
         }
-    report.append("\nCustom Functions & Variables:\n");
-    for (const auto& func : get_variables_and_functions())
+    compileExpressions(*workers.front());
+    for (auto& thread : threads)
         {
-        report.append(func.m_name).append("\n");
+        thread.join();
         }
-    return report;
+
+    for (const auto& worker : workers)
+        {
+        for (const auto& [rule, count] : worker->m_simplificationCounts)
+            {
+            m_simplificationCounts[rule] += count;
+            }
+        }
+
+    // add any variables that the resolver created
+    if (m_unknownSymbolResolve.index() != 0 && m_keepResolvedVarialbes &&
+        !resolutions.m_values.empty())
+        {
+        for (auto& worker : workers)
+            {
+            m_customFuncsAndVars.merge(worker->m_customFuncsAndVars);
+            }
+        invalidate_expression_cache();
+        }
+    // remove what the batch resolver resolved, if the resolved symbols aren't being kept
+    reset_usr_resolved_if_necessary();
+
+    return results;
+    }
+
+//--------------------------------------------------
+te_type te_parser::evaluate()
+    {
+    const te_variable_store::evaluation_scope scope;
+    try
+        {
+        m_result = (m_compiledExpression != nullptr) ? evaluate_compiled_expression() : te_nan;
+        }
+    catch (const std::exception& expt)
+        {
+        m_parseSuccess = false;
+        m_result = te_nan;
+        m_lastErrorMessage = expt.what();
+        }
+
+    reset_usr_resolved_if_necessary();
+
+    return m_result;
+    }
+
+//--------------------------------------------------
+te_type
+te_parser::evaluate(const std::string_view expression) // NOLINT(-readability-identifier-naming)
+    {
+    if (load_cached_expression(expression) || compile(expression))
+        {
+        return evaluate();
+        }
+    return te_nan;
+    }
+
+//--------------------------------------------------
+bool te_parser::recompile(const size_t offset, const size_t length,
+                          const std::string_view replacement)
+    {
+    if (offset > m_expression.length())
+        {
+        throw std::runtime_error("Edit position is past the end of the expression.");
+        }
+    const auto replacedLength = std::min(length, m_expression.length() - offset);
+    std::string expression{ m_expression };
+    expression.replace(offset, replacedLength, replacement);
+
+    if (is_incremental_compilation_enabled() &&
+        recompile_incrementally(offset, replacedLength, replacement.length(), expression))
+        {
+        m_dirtyTracking = dirty_tracking{};
+        return true;
+        }
+    return compile(expression);
+    }
+
+//--------------------------------------------------
+bool te_parser::recompile_incrementally(const size_t offset, const size_t length,
+                                        const size_t replacementLength, std::string& expression)
+    {
+    // (if any variables were rebound, then compile everything
+    //  so that they are all bound from the parser's variables again)
+    if (!m_parseSuccess || m_compiledExpression == nullptr ||
+        m_incrementalVersion != m_symbolTableVersion || m_variablesRebound ||
+        m_commonSubexpressions != nullptr)
+        {
+        return false;
+        }
+
+    // if the edit starts a comment, then it will need to be stripped
+    const size_t windowStart = (offset > 0) ? offset - 1 : 0;
+    const auto editWindow =
+        std::string_view{ expression }.substr(windowStart,
+                                              offset + replacementLength + 1 - windowStart);
+    if (editWindow.find("//") != std::string_view::npos ||
+        editWindow.find("/*") != std::string_view::npos)
+        {
+        return false;
+        }
+
+    // find the smallest argument or group that contains the edit
+    // (if none do, then the edit is at the top level of the expression)
+    auto unit = m_reparseUnits.cend();
+    for (auto currentUnit = m_reparseUnits.cbegin(); currentUnit != m_reparseUnits.cend();
+         ++currentUnit)
+        {
+        if (currentUnit->m_begin <= offset && offset + length <= currentUnit->m_end &&
+            (unit == m_reparseUnits.cend() ||
+             (currentUnit->m_end - currentUnit->m_begin) < (unit->m_end - unit->m_begin)))
+            {
+            unit = currentUnit;
+            }
+        }
+    if (unit == m_reparseUnits.cend())
+        {
+        return false;
+        }
+    const reparse_unit editedUnit{ *unit };
+    const size_t newUnitEnd = editedUnit.m_end + replacementLength - length;
+
+    // parse the unit by itself
+    const std::string unitText{ expression.substr(editedUnit.m_begin,
+                                                  newUnitEnd - editedUnit.m_begin) };
+    std::vector<reparse_unit> newUnits;
+    std::vector<symbol_reference> newSymbols;
+    std::vector<variable_slot> newVariableSlots;
+    state theState(unitText.c_str(), TE_DEFAULT, m_customFuncsAndVars);
+    theState.m_reparseUnits = &newUnits;
+    theState.m_variableSlots = &newVariableSlots;
+#ifndef TE_NO_BOOKKEEPING
+    theState.m_symbolReferences = &newSymbols;
+#endif
+    m_lastErrorMessage.clear();
+    te_expr* node{ nullptr };
+    bool swappedIn{ false };
+    // the node being replaced and where it is
+    te_expr* const oldNode{ editedUnit.m_node };
+    const node_link slot{ m_nodeLinks.at(oldNode) };
+    try
+        {
+        next_token(&theState);
+        node = editedUnit.m_isList ? list(&theState) : expr_level1(&theState);
+        if (theState.m_type != te_parser::state::token_type::TOK_END)
+            {
+            te_free(node);
+            return false;
+            }
+
+        // optimize() only goes into functions that are pure, so if any function
+        // that this is inside of isn't pure, then this wouldn't have been optimized
+        bool optimizable{ true };
+        for (const auto* parent = slot.m_parent; parent != nullptr;
+             parent = m_nodeLinks.at(parent).m_parent)
+            {
+            if (!is_pure(parent->m_type))
+                {
+                optimizable = false;
+                break;
+                }
+            }
+        if (optimizable)
+            {
+            if (m_constantFolding)
+                {
+                optimize(node);
+                }
+            if (m_simplification != simplification::none)
+                {
+                node = simplify(node, newVariableSlots);
+                }
+            }
+
+        // swap the new node in
+        swappedIn = true;
+        untrack_subtree(oldNode);
+        if (slot.m_parent == nullptr)
+            {
+            m_compiledExpression.reset(node, te_free);
+            }
+        else
+            {
+            te_free(oldNode);
+            slot.m_parent->m_parameters[slot.m_index] = node;
+            }
+        track_subtree(node, slot.m_parent, slot.m_index);
+
+        // if it is now a constant, then the functions that it is inside of may be as well
+        if (optimizable && m_constantFolding && is_constant(node->m_value))
+            {
+            for (auto* parent = slot.m_parent; parent != nullptr;
+                 parent = m_nodeLinks.at(parent).m_parent)
+                {
+                bool known{ true };
+                for (size_t i = 0; i < get_owned_parameter_count(parent) &&
+                                   parent->m_parameters[i] != nullptr;
+                     ++i)
+                    {
+                    if (!is_constant(parent->m_parameters[i]->m_value))
+                        {
+                        known = false;
+                        break;
+                        }
+                    }
+                if (!known)
+                    {
+                    break;
+                    }
+                // evaluate it before anything is changed, so that if it throws
+                // (e.g., division by zero), then the tree and its tracking are left intact
+                const auto value = te_eval(parent);
+                for (size_t i = 0; i < get_owned_parameter_count(parent); ++i)
+                    {
+                    if (parent->m_parameters[i] != nullptr)
+                        {
+                        untrack_subtree(parent->m_parameters[i]);
+                        }
+                    }
+                te_free_parameters(parent);
+                parent->m_type = TE_DEFAULT;
+                parent->m_value = value;
+                }
+            }
+        }
+    catch (const std::exception&)
+        {
+        // if the node was swapped in, then the compiled expression owns it now
+        // (and compiling the whole expression again reports the error)
+        if (!swappedIn)
+            {
+            te_free(node);
+            }
+        return false;
+        }
+
+    // update the arguments and groups
+    std::vector<reparse_unit> units;
+    units.reserve(m_reparseUnits.size() + newUnits.size());
+    for (auto currentUnit : m_reparseUnits)
+        {
+        // the units inside of the edited one were replaced
+        if (currentUnit.m_begin >= editedUnit.m_begin && currentUnit.m_end <= editedUnit.m_end &&
+            (currentUnit.m_end - currentUnit.m_begin) < (editedUnit.m_end - editedUnit.m_begin))
+            {
+            continue;
+            }
+        // the edited unit itself, or ones that enclose it and compiled into the same node
+        if (currentUnit.m_node == oldNode)
+            {
+            currentUnit.m_node = node;
+            }
+        if (currentUnit.m_begin >= editedUnit.m_end)
+            {
+            currentUnit.m_begin = currentUnit.m_begin + replacementLength - length;
+            currentUnit.m_end = currentUnit.m_end + replacementLength - length;
+            }
+        else if (currentUnit.m_end >= editedUnit.m_end)
+            {
+            currentUnit.m_end = currentUnit.m_end + replacementLength - length;
+            }
+        units.push_back(currentUnit);
+        }
+    for (auto newUnit : newUnits)
+        {
+        newUnit.m_begin += editedUnit.m_begin;
+        newUnit.m_end += editedUnit.m_begin;
+        units.push_back(newUnit);
+        }
+    // remove any that were optimized away
+    units.erase(std::remove_if(units.begin(), units.end(),
+                               [this](const auto& currentUnit)
+                               {
+                                   return m_nodeLinks.find(currentUnit.m_node) ==
+                                          m_nodeLinks.cend();
+                               }),
+                units.end());
+    m_reparseUnits = std::move(units);
+
+    // update the variables' nodes
+    for (auto& variableSlot : m_variableSlots)
+        {
+        variableSlot.m_nodes.erase(
+            std::remove_if(variableSlot.m_nodes.begin(), variableSlot.m_nodes.end(),
+                           [this](const auto* variableNode)
+                           { return m_nodeLinks.find(variableNode) == m_nodeLinks.cend(); }),
+            variableSlot.m_nodes.end());
+        }
+    m_variableSlots.erase(std::remove_if(m_variableSlots.begin(), m_variableSlots.end(),
+                                         [](const auto& variableSlot)
+                                         { return variableSlot.m_nodes.empty(); }),
+                          m_variableSlots.end());
+    for (const auto& variableSlot : newVariableSlots)
+        {
+        for (auto* variableNode : variableSlot.m_nodes)
+            {
+            add_variable_slot(m_variableSlots, variableSlot.m_name, variableNode);
+            }
+        }
+
+#ifndef TE_NO_BOOKKEEPING
+    // update the variables and functions used (the new symbols were already added
+    // to the used lists while parsing, so only the removed ones need to be handled)
+    const auto symbolPositionLess = [](const symbol_reference& symbol, const size_t position)
+    { return symbol.m_position < position; };
+    const auto firstRemoved =
+        std::lower_bound(m_symbolReferences.begin(), m_symbolReferences.end(),
+                         editedUnit.m_begin, symbolPositionLess);
+    const auto lastRemoved = std::lower_bound(firstRemoved, m_symbolReferences.end(),
+                                              editedUnit.m_end, symbolPositionLess);
+    for (auto& symbol : newSymbols)
+        {
+        symbol.m_position += editedUnit.m_begin;
+        ++m_symbolUseCounts[symbol.m_name];
+        }
+    for (auto symbol = firstRemoved; symbol != lastRemoved; ++symbol)
+        {
+        auto useCount = m_symbolUseCounts.find(symbol->m_name);
+        if (useCount != m_symbolUseCounts.end() && --useCount->second == 0)
+            {
+            m_symbolUseCounts.erase(useCount);
+            if (symbol->m_isFunction)
+                {
+                m_usedFunctions.erase(symbol->m_name);
+                }
+            else
+                {
+                m_usedVars.erase(symbol->m_name);
+                }
+            }
+        }
+    for (auto symbol = lastRemoved; symbol != m_symbolReferences.end(); ++symbol)
+        {
+        symbol->m_position = symbol->m_position + replacementLength - length;
+        }
+    const auto insertionPoint = m_symbolReferences.erase(firstRemoved, lastRemoved);
+    m_symbolReferences.insert(insertionPoint, std::make_move_iterator(newSymbols.begin()),
+                              std::make_move_iterator(newSymbols.end()));
+#endif
+
+    m_expression = std::move(expression);
+    m_errorPos = te_parser::npos;
+    m_result = te_nan;
+    m_parseSuccess = true;
+
+    reset_usr_resolved_if_necessary();
+    m_incrementalVersion = m_symbolTableVersion;
+
+    return true;
+    }
+
+//--------------------------------------------------
+size_t te_parser::find_variable_slot(const std::string_view name) const
+    {
+    const auto variableSlot =
+        std::find_if(m_variableSlots.cbegin(), m_variableSlots.cend(),
+                     [name](const auto& currentSlot)
+                     {
+                         return std::equal(currentSlot.m_name.cbegin(), currentSlot.m_name.cend(),
+                                           name.cbegin(), name.cend(),
+                                           [](const char lhv, const char rhv) noexcept {
+                                               return te_string_less::tolower(lhv) ==
+                                                      te_string_less::tolower(rhv);
+                                           });
+                     });
+    return (variableSlot == m_variableSlots.cend()) ?
+               no_index :
+               static_cast<size_t>(variableSlot - m_variableSlots.cbegin());
+    }
+
+//--------------------------------------------------
+bool te_parser::rebind(const std::string_view name, const te_type* address)
+    {
+    // copying the expression will change the slots, so get its index first
+    const size_t slotIndex = find_variable_slot(name);
+    if (slotIndex == no_index)
+        {
+        return false;
+        }
+    const te_expr* const originalExpression{ m_compiledExpression.get() };
+    make_compiled_expression_unique();
+    for (auto* node : m_variableSlots[slotIndex].m_nodes)
+        {
+        node->m_value = address;
+        }
+    m_variablesRebound = true;
+    if (m_compiledExpression.get() != originalExpression)
+        {
+        m_dirtyTracking = dirty_tracking{};
+        }
+    else if (!m_dirtyTracking.m_nodes.empty())
+        {
+        for (const size_t index : m_dirtyTracking.m_variableNodes[slotIndex])
+            {
+            mark_tracked_node_dirty(index);
+            }
+        }
+    return true;
+    }
+
+//--------------------------------------------------
+bool te_parser::mark_variable_dirty(const std::string_view name)
+    {
+    const size_t slotIndex = find_variable_slot(name);
+    if (slotIndex == no_index)
+        {
+        return false;
+        }
+    if (!m_dirtyTracking.m_nodes.empty())
+        {
+        for (const size_t index : m_dirtyTracking.m_variableNodes[slotIndex])
+            {
+            mark_tracked_node_dirty(index);
+            }
+        }
+    return true;
+    }
+
+//--------------------------------------------------
+void te_parser::rebind_all(const te_type* const* addresses, const size_t addressCount)
+    {
+    if (addressCount != m_variableSlots.size())
+        {
+        throw std::runtime_error(
+            "The number of addresses does not match the number of variables in the expression.");
+        }
+    if (addressCount == 0)
+        {
+        return;
+        }
+    const te_expr* const originalExpression{ m_compiledExpression.get() };
+    make_compiled_expression_unique();
+    for (size_t i = 0; i < addressCount; ++i)
+        {
+        for (auto* node : m_variableSlots[i].m_nodes)
+            {
+            node->m_value = addresses[i];
+            }
+        }
+    m_variablesRebound = true;
+    if (m_compiledExpression.get() != originalExpression)
+        {
+        m_dirtyTracking = dirty_tracking{};
+        }
+    else
+        {
+        for (const auto& variableNodes : m_dirtyTracking.m_variableNodes)
+            {
+            for (const size_t index : variableNodes)
+                {
+                mark_tracked_node_dirty(index);
+                }
+            }
+        }
+    }
+
+//--------------------------------------------------
+void te_parser::make_compiled_expression_unique()
+    {
+    if (m_compiledExpression == nullptr ||
+        (m_compiledExpression.use_count() == 1 &&
+         (m_commonSubexpressions == nullptr || m_commonSubexpressions.use_count() == 1)))
+        {
+        return;
+        }
+    std::unordered_map<const te_expr*, te_expr*> copiedNodes;
+    m_compiledExpression.reset(te_copy(m_compiledExpression.get(), copiedNodes), te_free);
+    if (m_commonSubexpressions != nullptr)
+        {
+        const size_t subexpressionCount{ m_commonSubexpressions->m_expressions.size() };
+        auto subexpressions = std::make_shared<common_subexpressions>();
+        subexpressions->m_values = std::make_unique<te_type[]>(subexpressionCount);
+        for (const auto* subexpression : m_commonSubexpressions->m_expressions)
+            {
+            subexpressions->m_expressions.push_back(te_copy(subexpression, copiedNodes));
+            }
+        // point the nodes that read the subexpressions' results to the new results
+        const te_type* const oldValues{ m_commonSubexpressions->m_values.get() };
+        for (auto& [original, copy] : copiedNodes)
+            {
+            const auto* const* value = std::get_if<const te_type*>(&copy->m_value);
+            if (value != nullptr && std::less_equal<>{}(oldValues, *value) &&
+                std::less<>{}(*value, oldValues + subexpressionCount))
+                {
+                copy->m_value = static_cast<const te_type*>(subexpressions->m_values.get() +
+                                                            (*value - oldValues));
+                }
+            }
+        m_commonSubexpressions = std::move(subexpressions);
+        }
+    for (auto& variableSlot : m_variableSlots)
+        {
+        for (auto& node : variableSlot.m_nodes)
+            {
+            node = copiedNodes.at(node);
+            }
+        }
+    }
+
+//--------------------------------------------------
+te_expr* te_parser::reassociate(te_expr* texp)
+    {
+    const bool relaxed{ m_reassociation == reassociation::relaxed };
+    // integers larger than this may not be exact
+    const auto maxExactInteger =
+        static_cast<te_type>(std::ldexp(1.0, std::numeric_limits<te_type>::digits));
+    const auto isExactInteger = [maxExactInteger](const te_type value)
+    { return std::fabs(value) <= maxExactInteger && std::trunc(value) == value; };
+    const auto isFunction = [](const te_expr* node, const te_fun2 function)
+    {
+        return node != nullptr && is_function2(node->m_value) &&
+               get_function2(node->m_value) == function;
+    };
+
+    // a term in a chain (and where it is in the chain), and whether it is subtracted
+    struct term
+        {
+        te_expr** m_slot{ nullptr };
+        bool m_negated{ false };
+        };
+
+    // Collects the terms of a chain of additions and subtractions (or multiplications).
+    // In strict mode, only the left side of the chain is followed, so that the other
+    // terms stay grouped the same way.
+    const auto collectTerms = [relaxed, &isFunction](const auto& self, te_expr** slot,
+                                                     const bool negated, const bool additive,
+                                                     std::vector<term>& terms,
+                                                     std::vector<te_expr*>& operations) -> void
+    {
+        te_expr* node = *slot;
+        const bool isAddition{ additive && isFunction(node, te_builtins::te_add) };
+        const bool isSubtraction{ additive && isFunction(node, te_builtins::te_sub) };
+        const bool isMultiplication{ !additive && isFunction(node, te_builtins::te_mul) };
+        if (isAddition || isSubtraction || isMultiplication)
+            {
+            operations.push_back(node);
+            self(self, &node->m_parameters[0], negated, additive, terms, operations);
+            if (relaxed)
+                {
+                self(self, &node->m_parameters[1], (negated != isSubtraction), additive, terms,
+                     operations);
+                }
+            else
+                {
+                terms.push_back({ &node->m_parameters[1], (negated != isSubtraction) });
+                }
+            }
+        else if (relaxed && additive && node != nullptr && is_function1(node->m_value) &&
+                 get_function1(node->m_value) == te_builtins::te_negate)
+            {
+            operations.push_back(node);
+            self(self, &node->m_parameters[0], !negated, additive, terms, operations);
+            }
+        else
+            {
+            terms.push_back({ slot, negated });
+            }
+    };
+
+    // builds a balanced chain from the terms (which are all added or all multiplied)
+    const auto buildChain = [](const auto& self, const te_fun2 function,
+                               const std::vector<te_expr*>& nodes, const size_t first,
+                               const size_t last) -> te_expr*
+    {
+        if (first + 1 == last)
+            {
+            return nodes[first];
+            }
+        const size_t middle = first + ((last - first) / 2);
+        return new_expr(TE_PURE, function,
+                        { self(self, function, nodes, first, middle),
+                          self(self, function, nodes, middle, last) });
+    };
+
+    const auto reassociateNode = [&](const auto& self, te_expr* node) -> te_expr*
+    {
+        // like optimize(), only go into pure functions
+        if (node == nullptr || !is_function(node->m_value) || !is_pure(node->m_type))
+            {
+            return node;
+            }
+        const bool additive{ isFunction(node, te_builtins::te_add) ||
+                             isFunction(node, te_builtins::te_sub) };
+        if (!additive && !isFunction(node, te_builtins::te_mul))
+            {
+            for (auto& parameter : node->m_parameters)
+                {
+                parameter = self(self, parameter);
+                }
+            return node;
+            }
+
+        std::vector<term> terms;
+        std::vector<te_expr*> operations;
+        collectTerms(collectTerms, &node, false, additive, terms, operations);
+
+        // find the constants that can be combined
+        // (-0 is the identity for addition, as -0 + 0 is 0)
+        te_type combined{ additive ? static_cast<te_type>(-0.0) : static_cast<te_type>(1) };
+        std::vector<te_expr*> combinedNodes;
+        std::vector<bool> isCombined(terms.size(), false);
+        for (size_t i = 0; i < terms.size(); ++i)
+            {
+            const te_expr* termNode = *terms[i].m_slot;
+            if (termNode != nullptr && is_constant(termNode->m_value))
+                {
+                const te_type value{ terms[i].m_negated ? -get_constant(termNode->m_value) :
+                                                          get_constant(termNode->m_value) };
+                const te_type result{ additive ? combined + value : combined * value };
+                if (relaxed || (isExactInteger(value) && isExactInteger(result)))
+                    {
+                    combined = result;
+                    combinedNodes.push_back(*terms[i].m_slot);
+                    isCombined[i] = true;
+                    }
+                }
+            }
+
+        // regroup the terms themselves
+        for (auto& currentTerm : terms)
+            {
+            *currentTerm.m_slot = self(self, *currentTerm.m_slot);
+            }
+        // nothing to combine (or rebalance)
+        if (combinedNodes.size() < 2 && (!relaxed || terms.size() < 4))
+            {
+            return node;
+            }
+        std::vector<std::pair<te_expr*, bool>> otherTerms;
+        for (size_t i = 0; i < terms.size(); ++i)
+            {
+            if (!isCombined[i])
+                {
+                otherTerms.emplace_back(*terms[i].m_slot, terms[i].m_negated);
+                }
+            }
+
+        // free the old chain, keeping its terms
+        size_t removedCount{ operations.size() + combinedNodes.size() };
+        for (auto* operation : operations)
+            {
+            operation->m_parameters.clear();
+            te_free(operation);
+            }
+        for (auto* combinedNode : combinedNodes)
+            {
+            te_free(combinedNode);
+            }
+
+        // rebuild the chain, with the combined constant at the end
+        // (adding 0 can change the sign of -0, so that is only left out when relaxed)
+        const bool needsConstant{ otherTerms.empty() ||
+                                  !(additive ? (relaxed && combined == 0) : combined == 1) };
+        te_expr* chain{ nullptr };
+        if (relaxed)
+            {
+            std::vector<te_expr*> added;
+            std::vector<te_expr*> subtracted;
+            for (const auto& [termNode, negated] : otherTerms)
+                {
+                (negated ? subtracted : added).push_back(termNode);
+                }
+            const te_fun2 function{ additive ? te_builtins::te_add : te_builtins::te_mul };
+            if (!added.empty())
+                {
+                chain = buildChain(buildChain, function, added, 0, added.size());
+                }
+            if (!subtracted.empty())
+                {
+                te_expr* subtractedChain =
+                    buildChain(buildChain, function, subtracted, 0, subtracted.size());
+                chain = (chain == nullptr) ?
+                            new_expr(TE_PURE, te_builtins::te_negate, { subtractedChain }) :
+                            new_expr(TE_PURE, te_builtins::te_sub, { chain, subtractedChain });
+                }
+            }
+        else
+            {
+            for (const auto& [termNode, negated] : otherTerms)
+                {
+                if (chain == nullptr)
+                    {
+                    chain = negated ? new_expr(TE_PURE, te_builtins::te_negate, { termNode }) :
+                                      termNode;
+                    }
+                else
+                    {
+                    chain = new_expr(TE_PURE,
+                                     !additive ? te_builtins::te_mul :
+                                     negated   ? te_builtins::te_sub :
+                                                 te_builtins::te_add,
+                                     { chain, termNode });
+                    }
+                }
+            }
+        if (needsConstant)
+            {
+            te_expr* constant = new_expr(TE_DEFAULT, combined);
+            chain = (chain == nullptr) ?
+                        constant :
+                        new_expr(TE_PURE, additive ? te_builtins::te_add : te_builtins::te_mul,
+                                 { chain, constant });
+            }
+
+        // count the new nodes
+        const auto countNodes = [&otherTerms](const auto& countSelf,
+                                              const te_expr* countedNode) -> size_t
+        {
+            if (std::find_if(otherTerms.cbegin(), otherTerms.cend(),
+                             [countedNode](const auto& otherTerm)
+                             { return otherTerm.first == countedNode; }) != otherTerms.cend())
+                {
+                return 0;
+                }
+            size_t nodeCount{ 1 };
+            for (size_t i = 0; i < get_owned_parameter_count(countedNode); ++i)
+                {
+                nodeCount += countSelf(countSelf, countedNode->m_parameters[i]);
+                }
+            return nodeCount;
+        };
+        const size_t addedCount{ countNodes(countNodes, chain) };
+        m_simplificationCounts["reassociation"] +=
+            (removedCount > addedCount) ? removedCount - addedCount : 0;
+        return chain;
+    };
+
+    return reassociateNode(reassociateNode, texp);
+    }
+
+//--------------------------------------------------
+te_expr* te_parser::simplify(te_expr* texp, std::vector<variable_slot>& variableSlots)
+    {
+    const bool fastMath{ m_simplification == simplification::fast_math };
+    std::set<const te_expr*> removedNodes;
+
+    const auto isConstant = [](const te_expr* node, const te_type value)
+    {
+        return node != nullptr && is_constant(node->m_value) &&
+               get_constant(node->m_value) == value;
+    };
+    // whether removing a subexpression won't skip any side effects
+    const auto isPure = [](const auto& self, const te_expr* node) -> bool
+    {
+        if (node == nullptr || is_constant(node->m_value) || is_variable(node->m_value))
+            {
+            return true;
+            }
+        if (is_closure(node->m_value) || !is_pure(node->m_type))
+            {
+            return false;
+            }
+        for (const auto* parameter : node->m_parameters)
+            {
+            if (!self(self, parameter))
+                {
+                return false;
+                }
+            }
+        return true;
+    };
+    // records the nodes in a subexpression that is being removed
+    // and returns how many there are
+    const auto removeNodes = [&removedNodes](const auto& self, const te_expr* node) -> size_t
+    {
+        if (node == nullptr)
+            {
+            return 0;
+            }
+        removedNodes.insert(node);
+        size_t removedCount{ 1 };
+        for (size_t i = 0; i < get_owned_parameter_count(node); ++i)
+            {
+            removedCount += self(self, node->m_parameters[i]);
+            }
+        return removedCount;
+    };
+    // replaces a node with one of its parameters
+    const auto keepParameter =
+        [this, &removeNodes](te_expr* node, const size_t index, const std::string_view rule)
+    {
+        te_expr* kept = node->m_parameters[index];
+        node->m_parameters[index] = nullptr;
+        m_simplificationCounts[std::string{ rule }] += removeNodes(removeNodes, node);
+        te_free(node);
+        return kept;
+    };
+    // replaces a node's function and its last parameter with a single-parameter function
+    const auto replaceWithFunction =
+        [this, &removeNodes](te_expr* node, const te_fun1 function, const std::string_view rule)
+    {
+        m_simplificationCounts[std::string{ rule }] +=
+            removeNodes(removeNodes, node->m_parameters[1]);
+        te_free(node->m_parameters[1]);
+        node->m_value = function;
+        node->m_parameters.resize(1);
+        return node;
+    };
+    // replaces a node with a constant
+    const auto replaceWithConstant =
+        [this, &removeNodes](te_expr* node, const te_type value, const std::string_view rule)
+    {
+        size_t removedCount{ 0 };
+        for (size_t i = 0; i < get_owned_parameter_count(node); ++i)
+            {
+            removedCount += removeNodes(removeNodes, node->m_parameters[i]);
+            }
+        m_simplificationCounts[std::string{ rule }] += removedCount;
+        te_free_parameters(node);
+        node->m_type = TE_DEFAULT;
+        node->m_value = value;
+        node->m_parameters.clear();
+        return node;
+    };
+
+    const auto simplifyNode = [&](const auto& self, te_expr* node) -> te_expr*
+    {
+        // like optimize(), only go into pure functions
+        if (node == nullptr || !is_function(node->m_value) || !is_pure(node->m_type))
+            {
+            return node;
+            }
+        bool known{ true };
+        for (auto& parameter : node->m_parameters)
+            {
+            parameter = self(self, parameter);
+            known = known && (parameter == nullptr || is_constant(parameter->m_value));
+            }
+        // a parameter may have been simplified into a constant
+        if (known && m_constantFolding)
+            {
+            optimize(node);
+            return node;
+            }
+
+        if (is_function2(node->m_value))
+            {
+            const auto function = get_function2(node->m_value);
+            te_expr* const left = node->m_parameters[0];
+            te_expr* const right = node->m_parameters[1];
+            if (function == te_builtins::te_mul)
+                {
+                if (isConstant(right, 1))
+                    {
+                    return keepParameter(node, 0, "x*1");
+                    }
+                if (isConstant(left, 1))
+                    {
+                    return keepParameter(node, 1, "x*1");
+                    }
+                if (fastMath && ((isConstant(right, 0) && isPure(isPure, left)) ||
+                                 (isConstant(left, 0) && isPure(isPure, right))))
+                    {
+                    return replaceWithConstant(node, 0, "x*0");
+                    }
+                }
+            else if (function == te_builtins::te_divide && isConstant(right, 1))
+                {
+                return keepParameter(node, 0, "x/1");
+                }
+            // multiplying by the reciprocal of a power of two (that is not too small or large)
+            // gives the same result, otherwise it may be off by a rounding
+            else if (function == te_builtins::te_divide && right != nullptr &&
+                     is_constant(right->m_value) && get_constant(right->m_value) != 0 &&
+                     std::isnormal(1 / get_constant(right->m_value)))
+                {
+                int exponent{ 0 };
+                const te_type divisor{ get_constant(right->m_value) };
+                if (fastMath ||
+                    std::fabs(std::frexp(divisor, &exponent)) == static_cast<te_type>(0.5))
+                    {
+                    node->m_value = te_builtins::te_mul;
+                    right->m_value = 1 / divisor;
+                    ++m_simplificationCounts["x/c"];
+                    return node;
+                    }
+                }
+            // -0 + 0 is 0, so this isn't safe for x-(-0)
+            else if (function == te_builtins::te_sub && isConstant(right, 0) &&
+                     !std::signbit(get_constant(right->m_value)))
+                {
+                return keepParameter(node, 0, "x-0");
+                }
+            else if (function == te_builtins::te_add && fastMath)
+                {
+                if (isConstant(right, 0))
+                    {
+                    return keepParameter(node, 0, "x+0");
+                    }
+                if (isConstant(left, 0))
+                    {
+                    return keepParameter(node, 1, "x+0");
+                    }
+                }
+            else if (function == static_cast<te_fun2>(te_builtins::te_pow) && right != nullptr &&
+                     is_constant(right->m_value))
+                {
+                const te_type exponent{ get_constant(right->m_value) };
+                if (exponent == 1)
+                    {
+                    return keepParameter(node, 0, "x^1");
+                    }
+                // pow(x, 0) is 1, even for NaN; however, pure functions can still throw
+                // (e.g., division by zero), so unless errors can be hidden by fast math,
+                // the base can't call anything
+                if (exponent == 0 &&
+                    (fastMath ? isPure(isPure, left) :
+                                (is_constant(left->m_value) || is_variable(left->m_value))))
+                    {
+                    return replaceWithConstant(node, 1, "x^0");
+                    }
+                if (exponent == 2)
+                    {
+                    return replaceWithFunction(node, te_builtins::te_square, "x^2");
+                    }
+                if (exponent == -1)
+                    {
+                    return replaceWithFunction(node, te_builtins::te_reciprocal, "x^-1");
+                    }
+                if (exponent == static_cast<te_type>(0.5))
+                    {
+                    return replaceWithFunction(node, te_builtins::te_pow_half, "x^0.5");
+                    }
+                if (fastMath)
+                    {
+                    if (exponent == 3)
+                        {
+                        return replaceWithFunction(node, te_builtins::te_cube, "x^3");
+                        }
+                    if (exponent == 4)
+                        {
+                        return replaceWithFunction(node, te_builtins::te_fourth_power, "x^4");
+                        }
+                    if (exponent == static_cast<te_type>(1.5))
+                        {
+                        return replaceWithFunction(node, te_builtins::te_pow_one_and_half,
+                                                   "x^1.5");
+                        }
+                    if (exponent == static_cast<te_type>(2.5))
+                        {
+                        return replaceWithFunction(node, te_builtins::te_pow_two_and_half,
+                                                   "x^2.5");
+                        }
+                    }
+                }
+            }
+        else if (is_function1(node->m_value))
+            {
+            const auto function = get_function1(node->m_value);
+            te_expr* const parameter = node->m_parameters[0];
+            if (parameter != nullptr && is_function1(parameter->m_value) &&
+                get_function1(parameter->m_value) == function)
+                {
+                if (function == te_builtins::te_negate)
+                    {
+                    return keepParameter(keepParameter(node, 0, "--x"), 0, "--x");
+                    }
+                if (function == te_builtins::te_absolute_value)
+                    {
+                    return keepParameter(node, 0, "abs(abs(x))");
+                    }
+                }
+            }
+        else if (is_function3(node->m_value) &&
+                 get_function3(node->m_value) == te_builtins::te_if &&
+                 node->m_parameters[0] != nullptr && is_constant(node->m_parameters[0]->m_value))
+            {
+            const size_t branch =
+                double_to_bool(get_constant(node->m_parameters[0]->m_value)) ? 1 : 2;
+            // the other branch is never evaluated, so it doesn't matter whether it is pure
+            return keepParameter(node, branch, "if(constant)");
+            }
+        return node;
+    };
+    texp = simplifyNode(simplifyNode, texp);
+
+    if (!removedNodes.empty())
+        {
+        for (auto& variableSlot : variableSlots)
+            {
+            variableSlot.m_nodes.erase(
+                std::remove_if(variableSlot.m_nodes.begin(), variableSlot.m_nodes.end(),
+                               [&removedNodes](const auto* node)
+                               { return removedNodes.find(node) != removedNodes.cend(); }),
+                variableSlot.m_nodes.end());
+            }
+        variableSlots.erase(std::remove_if(variableSlots.begin(), variableSlots.end(),
+                                           [](const auto& variableSlot)
+                                           { return variableSlot.m_nodes.empty(); }),
+                            variableSlots.end());
+        }
+    return texp;
+    }
+
+//--------------------------------------------------
+void te_parser::eliminate_common_subexpressions()
+    {
+    // Give each subexpression an ID, where identical ones get the same ID.
+    // Subexpressions that can't be shared (i.e., ones with an impure function or
+    // a function with a context) are given notShareable, and missing parameters
+    // are given the ID before that.
+    constexpr static size_t notShareable{ std::numeric_limits<size_t>::max() };
+    std::map<std::string, size_t, std::less<>> subexpressionIds;
+    std::unordered_map<const te_expr*, size_t> nodeIds;
+    // Subexpressions inside of the arguments that if(), ifs(), and(), or(), &&, and || only
+    // evaluate when needed are not shared, as the shared subexpressions are always evaluated.
+    const auto assignIds = [&subexpressionIds, &nodeIds](const auto& self, const te_expr* texp,
+                                                          const bool conditional) -> size_t
+    {
+        // the type of node and the raw bytes of its value (or function)
+        std::string key(1, static_cast<char>(texp->m_value.index()));
+        std::visit([&key](const auto& value)
+                   { key.append(reinterpret_cast<const char*>(&value), sizeof(value)); },
+                   texp->m_value);
+        bool shareable{ is_constant(texp->m_value) || is_variable(texp->m_value) ||
+                        (is_function(texp->m_value) && is_pure(texp->m_type)) };
+        key.append(reinterpret_cast<const char*>(&texp->m_type), sizeof(texp->m_type));
+        for (size_t i = 0; i < get_owned_parameter_count(texp); ++i)
+            {
+            const size_t parameterId =
+                (texp->m_parameters[i] != nullptr) ?
+                    self(self, texp->m_parameters[i],
+                         conditional || (i > 0 && is_short_circuit(texp->m_value))) :
+                    (notShareable - 1);
+            shareable = shareable && (parameterId != notShareable);
+            key.append(reinterpret_cast<const char*>(&parameterId), sizeof(parameterId));
+            }
+        if (!shareable)
+            {
+            return notShareable;
+            }
+        const size_t id =
+            subexpressionIds.try_emplace(std::move(key), subexpressionIds.size()).first->second;
+        if (is_function(texp->m_value) && !conditional)
+            {
+            nodeIds.emplace(texp, id);
+            }
+        return id;
+    };
+    assignIds(assignIds, m_compiledExpression.get(), false);
+
+    // count how many times each one is used (not counting the subexpressions inside of
+    // the repeats, as those will be removed)
+    std::vector<size_t> useCounts(subexpressionIds.size(), 0);
+    bool hasRepeats{ false };
+    const auto countUses = [&nodeIds, &useCounts, &hasRepeats](const auto& self,
+                                                               const te_expr* texp)
+    {
+        if (const auto nodeId = nodeIds.find(texp); nodeId != nodeIds.cend() &&
+                                                    ++useCounts[nodeId->second] > 1)
+            {
+            hasRepeats = true;
+            return;
+            }
+        for (size_t i = 0; i < get_owned_parameter_count(texp); ++i)
+            {
+            if (texp->m_parameters[i] != nullptr)
+                {
+                self(self, texp->m_parameters[i]);
+                }
+            }
+    };
+    countUses(countUses, m_compiledExpression.get());
+    if (!hasRepeats)
+        {
+        return;
+        }
+
+    // Move the first copy of each repeated subexpression into the list of common
+    // subexpressions and free the others. Each place where one was is changed to a variable
+    // bound to its result.
+    auto subexpressions = std::make_shared<common_subexpressions>();
+    std::vector<size_t> subexpressionIndices(subexpressionIds.size(), notShareable);
+    std::vector<std::pair<te_expr*, size_t>> references;
+    std::set<const te_expr*> removedNodes;
+    const auto removeNodes = [&removedNodes](const auto& self, const te_expr* texp) -> void
+    {
+        removedNodes.insert(texp);
+        for (size_t i = 0; i < get_owned_parameter_count(texp); ++i)
+            {
+            if (texp->m_parameters[i] != nullptr)
+                {
+                self(self, texp->m_parameters[i]);
+                }
+            }
+    };
+    const auto share = [&](const auto& self, te_expr* texp) -> void
+    {
+        for (size_t i = 0; i < get_owned_parameter_count(texp); ++i)
+            {
+            te_expr* parameter = texp->m_parameters[i];
+            if (parameter == nullptr)
+                {
+                continue;
+                }
+            const auto nodeId = nodeIds.find(parameter);
+            if (nodeId == nodeIds.cend() || useCounts[nodeId->second] < 2)
+                {
+                self(self, parameter);
+                continue;
+                }
+            if (subexpressionIndices[nodeId->second] != notShareable)
+                {
+                removeNodes(removeNodes, parameter);
+                te_free_parameters(parameter);
+                parameter->m_type = TE_DEFAULT;
+                parameter->m_parameters = { nullptr };
+                }
+            else
+                {
+                self(self, parameter);
+                auto* subexpression = new_expr(parameter->m_type, parameter->m_value);
+                subexpression->m_parameters = std::move(parameter->m_parameters);
+                parameter->m_type = TE_DEFAULT;
+                parameter->m_parameters = { nullptr };
+                subexpressionIndices[nodeId->second] = subexpressions->m_expressions.size();
+                subexpressions->m_expressions.push_back(subexpression);
+                }
+            references.emplace_back(parameter, subexpressionIndices[nodeId->second]);
+            }
+    };
+    share(share, m_compiledExpression.get());
+
+    subexpressions->m_values = std::make_unique<te_type[]>(subexpressions->m_expressions.size());
+    for (auto& [reference, index] : references)
+        {
+        reference->m_value = static_cast<const te_type*>(&subexpressions->m_values[index]);
+        }
+    m_commonSubexpressions = std::move(subexpressions);
+
+    // the variables in the removed copies aren't in the expression anymore
+    for (auto& variableSlot : m_variableSlots)
+        {
+        variableSlot.m_nodes.erase(
+            std::remove_if(variableSlot.m_nodes.begin(), variableSlot.m_nodes.end(),
+                           [&removedNodes](const auto* node)
+                           { return removedNodes.find(node) != removedNodes.cend(); }),
+            variableSlot.m_nodes.end());
+        }
+    }
+
+//--------------------------------------------------
+te_type te_parser::evaluate_compiled_expression()
+    {
+    if (m_incrementalEvaluation)
+        {
+        return evaluate_incrementally();
+        }
+    if (m_commonSubexpressions != nullptr)
+        {
+        for (size_t i = 0; i < m_commonSubexpressions->m_expressions.size(); ++i)
+            {
+            m_commonSubexpressions->m_values[i] =
+                te_eval(m_commonSubexpressions->m_expressions[i]);
+            }
+        }
+    return te_eval(m_compiledExpression.get());
+    }
+
+//--------------------------------------------------
+te_type te_parser::evaluate_incrementally()
+    {
+    if (m_dirtyTracking.m_nodes.empty())
+        {
+        build_dirty_tracking();
+        }
+    // Update the common subexpressions first. If one's result changes, then the nodes
+    // that read it are dirty.
+    for (size_t i = 0; i + 1 < m_dirtyTracking.m_roots.size(); ++i)
+        {
+        const size_t root = m_dirtyTracking.m_roots[i];
+        if (!m_dirtyTracking.m_nodes[root].m_dirty)
+            {
+            continue;
+            }
+        const te_type value = evaluate_tracked(root);
+        if (std::memcmp(&value, &m_commonSubexpressions->m_values[i], sizeof(te_type)) != 0)
+            {
+            m_commonSubexpressions->m_values[i] = value;
+            for (const size_t reader : m_dirtyTracking.m_subexpressionReaders[i])
+                {
+                mark_tracked_node_dirty(reader);
+                }
+            }
+        }
+    return evaluate_tracked(m_dirtyTracking.m_roots.back());
+    }
+
+//--------------------------------------------------
+void te_parser::build_dirty_tracking()
+    {
+    auto& nodes = m_dirtyTracking.m_nodes;
+    const auto addRoot = [this, &nodes](const te_expr* root)
+    {
+        m_dirtyTracking.m_roots.push_back(nodes.size());
+        nodes.push_back(tracked_node{ root });
+        // add each node's parameters together after it (breadth first)
+        for (size_t i = m_dirtyTracking.m_roots.back(); i < nodes.size(); ++i)
+            {
+            const te_expr* node = nodes[i].m_node;
+            nodes[i].m_firstParameter = nodes.size();
+            if (node == nullptr)
+                {
+                continue;
+                }
+            for (size_t j = 0; j < get_owned_parameter_count(node); ++j)
+                {
+                nodes.push_back(tracked_node{ node->m_parameters[j], i });
+                }
+            }
+    };
+    if (m_commonSubexpressions != nullptr)
+        {
+        for (const auto* subexpression : m_commonSubexpressions->m_expressions)
+            {
+            addRoot(subexpression);
+            }
+        }
+    addRoot(m_compiledExpression.get());
+
+    // parameters are after the nodes that they are in, so going backwards
+    // marks a node as volatile before its parent is checked
+    for (size_t i = nodes.size(); i-- > 0;)
+        {
+        const te_expr* node = nodes[i].m_node;
+        if (node != nullptr && (is_function(node->m_value) || is_closure(node->m_value)) &&
+            !is_pure(node->m_type))
+            {
+            nodes[i].m_volatile = true;
+            }
+        if (nodes[i].m_volatile && nodes[i].m_parent != no_index)
+            {
+            nodes[nodes[i].m_parent].m_volatile = true;
+            }
+        }
+
+    // find the nodes of each variable and the ones that read the common subexpressions
+    std::unordered_map<const te_expr*, size_t> nodeIndices;
+    std::unordered_map<const te_type*, size_t> subexpressionIndices;
+    if (m_commonSubexpressions != nullptr)
+        {
+        for (size_t i = 0; i < m_commonSubexpressions->m_expressions.size(); ++i)
+            {
+            subexpressionIndices.emplace(&m_commonSubexpressions->m_values[i], i);
+            }
+        m_dirtyTracking.m_subexpressionReaders.resize(
+            m_commonSubexpressions->m_expressions.size());
+        }
+    for (size_t i = 0; i < nodes.size(); ++i)
+        {
+        if (nodes[i].m_node != nullptr && is_variable(nodes[i].m_node->m_value))
+            {
+            nodeIndices.emplace(nodes[i].m_node, i);
+            if (const auto subexpression =
+                    subexpressionIndices.find(get_variable(nodes[i].m_node->m_value));
+                subexpression != subexpressionIndices.cend())
+                {
+                m_dirtyTracking.m_subexpressionReaders[subexpression->second].push_back(i);
+                }
+            }
+        }
+    m_dirtyTracking.m_variableNodes.resize(m_variableSlots.size());
+    for (size_t i = 0; i < m_variableSlots.size(); ++i)
+        {
+        for (const auto* node : m_variableSlots[i].m_nodes)
+            {
+            if (const auto nodeIndex = nodeIndices.find(node); nodeIndex != nodeIndices.cend())
+                {
+                m_dirtyTracking.m_variableNodes[i].push_back(nodeIndex->second);
+                }
+            }
+        }
+    }
+
+//--------------------------------------------------
+te_type te_parser::evaluate_tracked(const size_t index)
+    {
+    auto& tracked = m_dirtyTracking.m_nodes[index];
+    if (!tracked.m_dirty)
+        {
+        return tracked.m_value;
+        }
+    if (tracked.m_node == nullptr)
+        {
+        tracked.m_value = te_nan;
+        }
+    else
+        {
+        const size_t firstParameter = tracked.m_firstParameter;
+        const size_t parameterCount = get_owned_parameter_count(tracked.m_node);
+        tracked.m_value = te_eval_node(tracked.m_node,
+                                       [this, firstParameter, parameterCount](const size_t e)
+                                       {
+                                           return (e < parameterCount) ?
+                                                      evaluate_tracked(firstParameter + e) :
+                                                      te_nan;
+                                       });
+        }
+    tracked.m_dirty = tracked.m_volatile;
+    return tracked.m_value;
+    }
+
+//--------------------------------------------------
+void te_parser::mark_tracked_node_dirty(size_t index) noexcept
+    {
+    // A parent that was evaluated may have a parameter that still is dirty (e.g., an if()
+    // branch that wasn't taken), so the whole path up to the root is marked.
+    while (index != no_index)
+        {
+        m_dirtyTracking.m_nodes[index].m_dirty = true;
+        index = m_dirtyTracking.m_nodes[index].m_parent;
+        }
+    }
+
+//--------------------------------------------------
+void te_parser::add_variable_slot(std::vector<variable_slot>& slots,
+                                  const te_variable::name_type& name, te_expr* node)
+    {
+    // expressions only use a handful of variables, so a linear search is fine here
+    auto variableSlot = std::find_if(slots.begin(), slots.end(), [&name](const auto& currentSlot)
+                                     { return currentSlot.m_name == name; });
+    if (variableSlot == slots.end())
+        {
+        slots.push_back(variable_slot{ name, { node } });
+        }
+    else
+        {
+        variableSlot->m_nodes.push_back(node);
+        }
+    }
+
+//--------------------------------------------------
+size_t te_parser::estimate_cost(const te_expr* texp)
+    {
+    if (texp == nullptr)
+        {
+        return 0;
+        }
+    // a call (and reading its arguments) costs more than reading a value
+    constexpr size_t callCost{ 4 };
+    size_t cost{ (is_function(texp->m_value) || is_closure(texp->m_value)) ? callCost : 1 };
+    for (size_t i = 0; i < get_owned_parameter_count(texp); ++i)
+        {
+        cost += estimate_cost(texp->m_parameters[i]);
+        }
+    return cost;
+    }
+
+//--------------------------------------------------
+te_expr* te_parser::te_copy(const te_expr* texp,
+                            std::unordered_map<const te_expr*, te_expr*>& copiedNodes)
+    {
+    if (texp == nullptr)
+        {
+        return nullptr;
+        }
+    auto* copy = new te_expr(texp->m_type, texp->m_value);
+    copy->m_parameters = texp->m_parameters;
+    // a closure's context isn't owned by the expression, so that is shared
+    for (size_t i = 0; i < get_owned_parameter_count(texp); ++i)
+        {
+        copy->m_parameters[i] = te_copy(texp->m_parameters[i], copiedNodes);
+        }
+    copiedNodes.emplace(texp, copy);
+    return copy;
+    }
+
+//--------------------------------------------------
+void te_parser::start_incremental_tracking()
+    {
+    track_subtree(m_compiledExpression.get(), nullptr, 0);
+    // remove any arguments or groups that were optimized away
+    m_reparseUnits.erase(std::remove_if(m_reparseUnits.begin(), m_reparseUnits.end(),
+                                        [this](const auto& unit)
+                                        {
+                                            return m_nodeLinks.find(unit.m_node) ==
+                                                   m_nodeLinks.cend();
+                                        }),
+                         m_reparseUnits.end());
+#ifndef TE_NO_BOOKKEEPING
+    for (const auto& symbol : m_symbolReferences)
+        {
+        ++m_symbolUseCounts[symbol.m_name];
+        }
+#endif
+    }
+
+//--------------------------------------------------
+void te_parser::track_subtree(te_expr* texp, te_expr* parent, const size_t index)
+    {
+    if (texp == nullptr)
+        {
+        return;
+        }
+    m_nodeLinks[texp] = node_link{ parent, index };
+    for (size_t i = 0; i < get_owned_parameter_count(texp); ++i)
+        {
+        track_subtree(texp->m_parameters[i], texp, i);
+        }
+    }
+
+//--------------------------------------------------
+void te_parser::untrack_subtree(const te_expr* texp)
+    {
+    if (texp == nullptr)
+        {
+        return;
+        }
+    m_nodeLinks.erase(texp);
+    for (size_t i = 0; i < get_owned_parameter_count(texp); ++i)
+        {
+        untrack_subtree(texp->m_parameters[i]);
+        }
+    }
+
+//--------------------------------------------------
+std::shared_ptr<const te_parser::compiled_formula> te_parser::make_compiled_formula() const
+    {
+    auto formula = std::make_shared<compiled_formula>();
+    formula->m_compiledExpression = m_compiledExpression;
+    formula->m_commonSubexpressions = m_commonSubexpressions;
+    formula->m_variableSlots = m_variableSlots;
+#ifndef TE_NO_BOOKKEEPING
+    formula->m_usedFunctions = m_usedFunctions;
+    formula->m_usedVars = m_usedVars;
+#endif
+    return formula;
+    }
+
+//--------------------------------------------------
+void te_parser::load_compiled_formula(const std::shared_ptr<const compiled_formula>& formula)
+    {
+    m_compiledExpression = formula->m_compiledExpression;
+    m_commonSubexpressions = formula->m_commonSubexpressions;
+    m_variableSlots = formula->m_variableSlots;
+    m_dirtyTracking = dirty_tracking{};
+    m_optimizationReport.clear();
+    m_variablesRebound = false;
+#ifndef TE_NO_BOOKKEEPING
+    m_usedFunctions = formula->m_usedFunctions;
+    m_usedVars = formula->m_usedVars;
+#endif
+    }
+
+//--------------------------------------------------
+void te_parser::cache_compiled_expression(std::string expression,
+                                          std::shared_ptr<const compiled_formula> formula)
+    {
+    if (get_expression_cache_size() == 0 || expression.empty())
+        {
+        return;
+        }
+    if (m_expressionCacheVersion != m_symbolTableVersion)
+        {
+        trim_expression_cache(0);
+        m_expressionCacheVersion = m_symbolTableVersion;
+        }
+
+    if (const auto cachedExpr = m_expressionCache.find(expression);
+        cachedExpr != m_expressionCache.end())
+        {
+        cachedExpr->second.m_formula = std::move(formula);
+        cachedExpr->second.m_expression = m_expression;
+        m_expressionCacheOrder.splice(m_expressionCacheOrder.begin(), m_expressionCacheOrder,
+                                      cachedExpr->second.m_recentPosition);
+        return;
+        }
+    trim_expression_cache(get_expression_cache_size() - 1);
+    m_expressionCacheOrder.push_front(expression);
+    m_expressionCache.emplace(std::move(expression),
+                              cached_expression{ std::move(formula), m_expression,
+                                                 m_expressionCacheOrder.begin() });
+    }
+
+//--------------------------------------------------
+void te_parser::trim_expression_cache(const size_t capacity)
+    {
+    while (m_expressionCache.size() > capacity)
+        {
+        m_expressionCache.erase(m_expressionCacheOrder.back());
+        m_expressionCacheOrder.pop_back();
+        }
+    }
+
+//--------------------------------------------------
+bool te_parser::load_cached_expression(const std::string_view expression)
+    {
+    if (m_expressionCacheVersion != m_symbolTableVersion)
+        {
+        // variables, functions, or separators changed since these were compiled
+        trim_expression_cache(0);
+        m_expressionCacheVersion = m_symbolTableVersion;
+        return false;
+        }
+
+    const auto cachedExpr = m_expressionCache.find(expression);
+    if (cachedExpr == m_expressionCache.cend())
+        {
+        return false;
+        }
+    m_expressionCacheOrder.splice(m_expressionCacheOrder.begin(), m_expressionCacheOrder,
+                                  cachedExpr->second.m_recentPosition);
+
+    // if evaluating the same expression repeatedly, then it is already loaded
+    if (m_compiledExpression != cachedExpr->second.m_formula->m_compiledExpression)
+        {
+        load_compiled_formula(cachedExpr->second.m_formula);
+        m_expression = cachedExpr->second.m_expression;
+        }
+    m_errorPos = te_parser::npos;
+    m_lastErrorMessage.clear();
+    m_result = te_nan;
+    m_parseSuccess = true;
+
+    return true;
+    }
+
+//--------------------------------------------------
+std::string te_parser::make_formula_cache_key(const std::string_view expression)
+    {
+    // Whitespace next to a character that is always a token by itself is insignificant.
+    // (A sign after an 'e' or 'p' may be part of a number's exponent, so that is the exception.)
+    const auto isStandaloneToken = [this](const char ch, const char prev) noexcept
+    {
+        if (ch == '+' || ch == '-')
+            {
+            return (te_string_less::tolower(prev) != 'e' && te_string_less::tolower(prev) != 'p');
+            }
+        return (ch != '\0' &&
+                (std::strchr("()^%/~", ch) != nullptr || ch == get_list_separator()));
+    };
+
+    std::string key;
+    key.reserve(expression.length() + sizeof(uint64_t) + 1);
+    bool pendingSpace{ false };
+    for (const auto ch : expression)
+        {
+        if (std::isspace(static_cast<unsigned char>(ch)))
+            {
+            pendingSpace = !key.empty();
+            continue;
+            }
+        // whitespace between other tokens is collapsed to a single space
+        if (pendingSpace && !isStandaloneToken(ch, key.back()) &&
+            !isStandaloneToken(key.back(), (key.length() > 1) ? key[key.length() - 2] : ' '))
+            {
+            key += ' ';
+            }
+        pendingSpace = false;
+        key += te_string_less::tolower(ch);
+        }
+
+    key += '\0';
+    // only the bindings' hash is in the key (the bindings are compared when it is looked up)
+    [[maybe_unused]] const auto& bindings = get_binding_signature();
+    key.append(reinterpret_cast<const char*>(&m_bindingSignatureHash),
+               sizeof(m_bindingSignatureHash));
+    return key;
+    }
+
+//--------------------------------------------------
+const std::shared_ptr<const std::string>& te_parser::get_binding_signature()
+    {
+    if (m_bindingSignature != nullptr && m_bindingSignatureVersion == m_symbolTableVersion)
+        {
+        return m_bindingSignature;
+        }
+
+    std::string signature;
+    // writes out the bytes of a value (or pointer)
+    const auto append = [&signature](const auto& value)
+    { signature.append(reinterpret_cast<const char*>(&value), sizeof(value)); };
+
+    append(get_decimal_separator());
+    append(get_list_separator());
+    append(is_common_subexpression_elimination_enabled());
+    append(get_simplification());
+    append(get_reassociation());
+    append(is_constant_folding_enabled());
+    append(is_integer_evaluation_enabled());
+    const auto combineVariable = [&signature, &append](const te_variable& var)
+    {
+        std::string name{ var.m_name };
+        std::transform(name.begin(), name.end(), name.begin(), te_string_less::tolower);
+        signature += name;
+        signature += '\0';
+        append(var.m_value.index());
+        append(var.m_type);
+        append(var.m_context);
+        // constants get folded into compiled expressions, so their values matter
+        std::visit([&append](const auto& value) { append(value); }, var.m_value);
+    };
+
+    if (m_sharedSymbols == nullptr)
+        {
+        std::for_each(m_customFuncsAndVars.cbegin(), m_customFuncsAndVars.cend(),
+                      combineVariable);
+        }
+    else
+        {
+        // a worker in compile_many() writes out the parser's symbols and the ones that it
+        // resolved in order, the same as the parser will have them after merging
+        auto sharedVar = m_sharedSymbols->cbegin();
+        auto ownVar = m_customFuncsAndVars.cbegin();
+        const auto lessThan = m_customFuncsAndVars.value_comp();
+        while (sharedVar != m_sharedSymbols->cend() || ownVar != m_customFuncsAndVars.cend())
+            {
+            if (ownVar == m_customFuncsAndVars.cend() ||
+                (sharedVar != m_sharedSymbols->cend() && lessThan(*sharedVar, *ownVar)))
+                {
+                combineVariable(*sharedVar++);
+                }
+            else
+                {
+                combineVariable(*ownVar++);
+                }
+            }
+        }
+
+    m_bindingSignatureHash = std::hash<std::string>{}(signature);
+    m_bindingSignature = std::make_shared<const std::string>(std::move(signature));
+    m_bindingSignatureVersion = m_symbolTableVersion;
+    return m_bindingSignature;
+    }
+
+//--------------------------------------------------
+std::atomic<uint64_t> te_variable_store::m_nextId{ 1 };
+thread_local uint64_t te_variable_store::m_evaluationId{ 0 };
+thread_local size_t te_variable_store::m_evaluationDepth{ 0 };
+
+//--------------------------------------------------
+te_variable_store::te_variable_store(std::vector<std::string> names)
+    : m_names(std::move(names)), m_id(m_nextId++)
+    {
+    std::set<te_variable::name_type, te_string_less> uniqueNames;
+    for (const auto& name : m_names)
+        {
+        if (!uniqueNames.insert(name).second)
+            {
+            throw std::runtime_error("Variable names in a store must be unique: " + name);
+            }
+        }
+    m_words = std::make_unique<std::atomic<word_type>[]>(m_names.size() * words_per_value);
+    for (size_t i = 0; i < m_names.size(); ++i)
+        {
+        store_value(i, 0);
+        m_references.push_back(std::make_unique<slot_reference>(this, i));
+        }
+    }
+
+//--------------------------------------------------
+te_variable_store::update::update(te_variable_store& store)
+    : m_store(store), m_lock(store.m_updateMutex)
+    {
+    // an odd sequence tells readers that the values are changing
+    m_store.m_sequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    }
+
+//--------------------------------------------------
+te_variable_store::update::~update()
+    {
+    m_store.m_sequence.fetch_add(1, std::memory_order_release);
+    }
+
+//--------------------------------------------------
+void te_variable_store::update::set(const std::string_view name, const te_type value)
+    {
+    const size_t slot = m_store.get_slot(name);
+    if (slot == npos)
+        {
+        throw std::runtime_error("Variable not found in store: " + std::string{ name });
+        }
+    set(slot, value);
+    }
+
+//--------------------------------------------------
+size_t te_variable_store::get_slot(const std::string_view name) const noexcept
+    {
+    const auto variableName =
+        std::find_if(m_names.cbegin(), m_names.cend(),
+                     [name](const auto& currentName)
+                     {
+                         return std::equal(currentName.cbegin(), currentName.cend(),
+                                           name.cbegin(), name.cend(),
+                                           [](const char lhv, const char rhv) noexcept {
+                                               return te_string_less::tolower(lhv) ==
+                                                      te_string_less::tolower(rhv);
+                                           });
+                     });
+    return (variableName == m_names.cend()) ?
+               npos :
+               static_cast<size_t>(variableName - m_names.cbegin());
+    }
+
+//--------------------------------------------------
+std::set<te_variable> te_variable_store::get_variables() const
+    {
+    std::set<te_variable> variables;
+    for (size_t i = 0; i < m_names.size(); ++i)
+        {
+        // not pure, so that the variables aren't folded into constants
+        variables.insert(te_variable{ m_names[i], static_cast<te_confun0>(read_variable),
+                                      TE_DEFAULT, m_references[i].get() });
+        }
+    return variables;
+    }
+
+//--------------------------------------------------
+void te_variable_store::store_value(const size_t slot, const te_type value) noexcept
+    {
+    std::array<word_type, words_per_value> words{};
+    std::memcpy(words.data(), &value, sizeof(te_type));
+    for (size_t i = 0; i < words_per_value; ++i)
+        {
+        m_words[(slot * words_per_value) + i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+
+//--------------------------------------------------
+te_type te_variable_store::load_value(const size_t slot) const noexcept
+    {
+    std::array<word_type, words_per_value> words{};
+    for (size_t i = 0; i < words_per_value; ++i)
+        {
+        words[i] = m_words[(slot * words_per_value) + i].load(std::memory_order_relaxed);
+        }
+    te_type value{ 0 };
+    std::memcpy(&value, words.data(), sizeof(te_type));
+    return value;
+    }
+
+//--------------------------------------------------
+void te_variable_store::read_snapshot(te_type* values) const noexcept
+    {
+    for (;;)
+        {
+        const uint64_t sequence = m_sequence.load(std::memory_order_acquire);
+        if (sequence % 2 != 0)
+            {
+            std::this_thread::yield();
+            continue;
+            }
+        for (size_t i = 0; i < m_names.size(); ++i)
+            {
+            values[i] = load_value(i);
+            }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_sequence.load(std::memory_order_relaxed) == sequence)
+            {
+            return;
+            }
+        }
+    }
+
+//--------------------------------------------------
+te_type te_variable_store::read_variable(const te_expr* context)
+    {
+    const auto* reference = static_cast<const slot_reference*>(context);
+    const te_variable_store* store{ reference->m_store };
+    if (m_evaluationDepth == 0)
+        {
+        te_type value{ 0 };
+        // a consistent read of the one value
+        for (;;)
+            {
+            const uint64_t sequence = store->m_sequence.load(std::memory_order_acquire);
+            value = store->load_value(reference->m_slot);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence % 2 == 0 &&
+                store->m_sequence.load(std::memory_order_relaxed) == sequence)
+                {
+                return value;
+                }
+            }
+        }
+
+    // The snapshots of the stores that the thread has read from recently.
+    // (An evaluation rarely reads from more than one store.)
+    struct snapshot
+        {
+        uint64_t m_storeId{ 0 };
+        uint64_t m_evaluationId{ 0 };
+        std::vector<te_type> m_values;
+        };
+
+    constexpr size_t maxSnapshots{ 8 };
+    thread_local std::vector<snapshot> snapshots;
+    auto currentSnapshot =
+        std::find_if(snapshots.begin(), snapshots.end(), [store](const auto& storeSnapshot)
+                     { return storeSnapshot.m_storeId == store->m_id; });
+    if (currentSnapshot == snapshots.end())
+        {
+        if (snapshots.size() == maxSnapshots)
+            {
+            snapshots.erase(snapshots.begin());
+            }
+        snapshots.push_back(snapshot{ store->m_id, 0, std::vector<te_type>(store->size()) });
+        currentSnapshot = std::prev(snapshots.end());
+        }
+    if (currentSnapshot->m_evaluationId != m_evaluationId)
+        {
+        store->read_snapshot(currentSnapshot->m_values.data());
+        currentSnapshot->m_evaluationId = m_evaluationId;
+        }
+    return currentSnapshot->m_values[reference->m_slot];
+    }
+
+//--------------------------------------------------
+std::shared_ptr<const te_program> te_program_registry::find(const std::string_view expression) const
+    {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    const auto program = m_programs.find(std::string{ expression });
+    return (program == m_programs.cend()) ? nullptr : program->second;
+    }
+
+//--------------------------------------------------
+bool te_program_registry::insert(const std::string_view expression,
+                                 std::shared_ptr<const te_program> program)
+    {
+    if (program == nullptr)
+        {
+        return false;
+        }
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    return m_programs.emplace(expression, std::move(program)).second;
+    }
+
+//--------------------------------------------------
+size_t te_program_registry::size() const
+    {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    return m_programs.size();
+    }
+
+//--------------------------------------------------
+void te_program_registry::clear()
+    {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    m_programs.clear();
+    }
+
+//--------------------------------------------------
+std::shared_ptr<const te_program> te_program_handle::load() const
+    {
+#ifdef __cpp_lib_atomic_shared_ptr
+    return m_program.load(std::memory_order_acquire);
+#else
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    return m_program;
+#endif
+    }
+
+//--------------------------------------------------
+std::shared_ptr<const te_program>
+te_program_handle::publish(std::shared_ptr<const te_program> program)
+    {
+#ifdef __cpp_lib_atomic_shared_ptr
+    auto previous = m_program.exchange(std::move(program), std::memory_order_acq_rel);
+#else
+    std::shared_ptr<const te_program> previous;
+        {
+        const std::lock_guard<std::mutex> lock(m_mutex);
+        previous = std::exchange(m_program, std::move(program));
+        }
+#endif
+    m_version.fetch_add(1, std::memory_order_release);
+    // the previous program is destroyed by whoever releases it last
+    // (here, if no evaluation is holding it), never while it is being evaluated
+    return previous;
+    }
+
+//--------------------------------------------------
+te_program::evaluation_result te_program_handle::unpublished_result()
+    {
+    te_program::evaluation_result result;
+    result.m_value = te_parser::te_nan;
+    result.m_success = false;
+    result.m_errorMessage = "No program has been published.";
+    return result;
+    }
+
+//--------------------------------------------------
+te_program::evaluation_result te_program_handle::evaluate() const
+    {
+    const auto program = load();
+    if (program == nullptr)
+        {
+        return unpublished_result();
+        }
+    return program->evaluate();
+    }
+
+//--------------------------------------------------
+te_program::evaluation_result te_program_handle::evaluate(const std::vector<te_type>& values) const
+    {
+    const auto program = load();
+    if (program == nullptr)
+        {
+        return unpublished_result();
+        }
+    return program->evaluate(values);
+    }
+
+//--------------------------------------------------
+void te_formula_cache::set_capacity(const size_t capacity)
+    {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    m_capacity = capacity;
+    trim(m_capacity);
+    }
+
+//--------------------------------------------------
+size_t te_formula_cache::get_capacity() const
+    {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    return m_capacity;
+    }
+
+//--------------------------------------------------
+size_t te_formula_cache::size() const
+    {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+    }
+
+//--------------------------------------------------
+void te_formula_cache::clear()
+    {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    m_lookup.clear();
+    m_entries.clear();
+    }
+
+//--------------------------------------------------
+te_formula_cache::formula_type te_formula_cache::find(const std::string& key,
+                                                      const std::string& bindings)
+    {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    const auto foundPos = m_lookup.find(key);
+    // the key only has a hash of the bindings, so a different parser's bindings could
+    // have the same key (and its expression would read the other parser's variables)
+    if (foundPos == m_lookup.cend() || *foundPos->second->m_bindings != bindings)
+        {
+        ++m_misses;
+        return nullptr;
+        }
+    ++m_hits;
+    // move to the front of the list as the most-recently used
+    m_entries.splice(m_entries.begin(), m_entries, foundPos->second);
+    return foundPos->second->m_formula;
+    }
+
+//--------------------------------------------------
+void te_formula_cache::insert(std::string key, bindings_type bindings, formula_type formula)
+    {
+    const std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_capacity == 0)
+        {
+        return;
+        }
+    // another parser may have compiled the same formula at the same time
+    if (const auto foundPos = m_lookup.find(key); foundPos != m_lookup.cend())
+        {
+        foundPos->second->m_bindings = std::move(bindings);
+        foundPos->second->m_formula = std::move(formula);
+        m_entries.splice(m_entries.begin(), m_entries, foundPos->second);
+        return;
+        }
+    trim(m_capacity - 1);
+    m_entries.push_front(entry{ std::move(key), std::move(bindings), std::move(formula) });
+    m_lookup.emplace(m_entries.front().m_key, m_entries.begin());
+    }
+
+//--------------------------------------------------
+void te_formula_cache::trim(const size_t capacity)
+    {
+    while (m_entries.size() > capacity)
+        {
+        m_lookup.erase(m_entries.back().m_key);
+        m_entries.pop_back();
+        ++m_evictions;
+        }
+    }
+
+//--------------------------------------------------
+thread_local const te_type* te_program::m_currentSubexpressionValues{ nullptr };
+
+//--------------------------------------------------
+te_type te_program::read_subexpression(const te_expr* context)
+    {
+    return m_currentSubexpressionValues[static_cast<const subexpression_reference*>(context)
+                                            ->m_index];
+    }
+
+//--------------------------------------------------
+thread_local const te_type* te_program::m_currentVariableValues{ nullptr };
+
+//--------------------------------------------------
+te_type te_program::read_variable(const te_expr* context)
+    {
+    const auto* variable = static_cast<const variable_reference*>(context);
+    return (m_currentVariableValues != nullptr) ? m_currentVariableValues[variable->m_slot] :
+                                                  *variable->m_address;
+    }
+
+//--------------------------------------------------
+size_t te_program::get_variable_slot(const std::string_view name) const noexcept
+    {
+    const auto variableName =
+        std::find_if(m_variableNames.cbegin(), m_variableNames.cend(),
+                     [name](const auto& currentName)
+                     {
+                         return std::equal(currentName.cbegin(), currentName.cend(),
+                                           name.cbegin(), name.cend(),
+                                           [](const char lhv, const char rhv) noexcept {
+                                               return te_string_less::tolower(lhv) ==
+                                                      te_string_less::tolower(rhv);
+                                           });
+                     });
+    return (variableName == m_variableNames.cend()) ?
+               npos :
+               static_cast<size_t>(variableName - m_variableNames.cbegin());
+    }
+
+//--------------------------------------------------
+te_program::evaluation_result te_program::evaluate(const te_type* values,
+                                                   const size_t valueCount) const
+    {
+    if (valueCount != m_variableNames.size())
+        {
+        evaluation_result result;
+        result.m_value = te_parser::te_nan;
+        result.m_success = false;
+        result.m_errorMessage =
+            "The number of values does not match the number of variables in the expression.";
+        return result;
+        }
+    // a program without variables still needs a non-null pointer to not read bound addresses
+    static constexpr te_type noValues{ 0 };
+    return evaluate_with((values != nullptr) ? values : &noValues);
+    }
+
+//--------------------------------------------------
+// Pins the current thread to a core while it is in scope
+// (and restores the cores that it could run on before).
+class te_program::thread_pinning
+    {
+  public:
+    thread_pinning(const bool pin, const size_t worker)
+        {
+#if defined(__linux__) && defined(__GLIBC__)
+        if (!pin)
+            {
+            return;
+            }
+        const size_t coreCount{ std::max<size_t>(std::thread::hardware_concurrency(), 1) };
+        cpu_set_t cores;
+        CPU_ZERO(&cores);
+        CPU_SET(worker % coreCount, &cores);
+        m_pinned =
+            (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &m_previousCores) == 0 &&
+             pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cores) == 0);
+#else
+        static_cast<void>(pin);
+        static_cast<void>(worker);
+#endif
+        }
+
+    thread_pinning(const thread_pinning&) = delete;
+    thread_pinning& operator=(const thread_pinning&) = delete;
+
+    ~thread_pinning()
+        {
+#if defined(__linux__) && defined(__GLIBC__)
+        if (m_pinned)
+            {
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &m_previousCores);
+            }
+#endif
+        }
+
+  private:
+#if defined(__linux__) && defined(__GLIBC__)
+    cpu_set_t m_previousCores{};
+    bool m_pinned{ false };
+#endif
+    };
+
+//--------------------------------------------------
+// A custom function may evaluate another program, so the values of the program
+// that called it are restored afterwards.
+class te_program::values_scope
+    {
+  public:
+    values_scope(const te_type* values, const te_type* variableValues) noexcept
+        : m_previousValues(m_currentSubexpressionValues),
+          m_previousVariableValues(m_currentVariableValues)
+        {
+        m_currentSubexpressionValues = values;
+        m_currentVariableValues = variableValues;
+        }
+
+    values_scope(const values_scope&) = delete;
+    values_scope& operator=(const values_scope&) = delete;
+
+    ~values_scope()
+        {
+        m_currentSubexpressionValues = m_previousValues;
+        m_currentVariableValues = m_previousVariableValues;
+        }
+
+  private:
+    const te_type* m_previousValues{ nullptr };
+    const te_type* m_previousVariableValues{ nullptr };
+    };
+
+//--------------------------------------------------
+te_type te_program::evaluate_current(te_type* subexpressionValues) const
+    {
+    for (size_t i = 0; i < m_subexpressions.size(); ++i)
+        {
+        subexpressionValues[i] = te_parser::te_eval(m_subexpressions[i].get());
+        }
+    return te_parser::te_eval(m_compiledExpression.get());
+    }
+
+//--------------------------------------------------
+te_program::evaluation_result te_program::evaluate_with(const te_type* variableValues) const
+    {
+    // Each evaluation has its own results for the common subexpressions. (Most programs
+    // have only a few, so they are kept on the stack.)
+    constexpr size_t maxStackValues{ 16 };
+    std::array<te_type, maxStackValues> stackValues{};
+    std::vector<te_type> heapValues;
+    te_type* values{ stackValues.data() };
+    if (m_subexpressions.size() > maxStackValues)
+        {
+        heapValues.resize(m_subexpressions.size());
+        values = heapValues.data();
+        }
+
+    const values_scope scope{ values, variableValues };
+    const te_variable_store::evaluation_scope storeScope;
+    evaluation_result result;
+    try
+        {
+        result.m_value = evaluate_current(values);
+        }
+    catch (const std::exception& expt)
+        {
+        result.m_value = te_parser::te_nan;
+        result.m_success = false;
+        result.m_errorMessage = expt.what();
+        }
+    return result;
+    }
+
+//--------------------------------------------------
+te_program::batch_result te_program::evaluate_rows(const te_type* rows, const size_t valueCount,
+                                                   te_type* results, const size_t resultCount,
+                                                   const batch_options& options) const
+    {
+    const size_t variableCount{ m_variableNames.size() };
+    if (variableCount > 0 && valueCount % variableCount != 0)
+        {
+        throw std::runtime_error(
+            "The number of values is not a multiple of the number of variables in the expression.");
+        }
+    const size_t rowCount{ (variableCount > 0) ? valueCount / variableCount : resultCount };
+    if (resultCount != rowCount)
+        {
+        throw std::runtime_error("The number of results does not match the number of rows.");
+        }
+    if (rowCount == 0)
+        {
+        return batch_result{};
+        }
+
+    constexpr size_t chunkBytes{ 64 * 1024 };
+    const size_t rowsPerChunk{ (options.m_rowsPerChunk > 0) ?
+                                   options.m_rowsPerChunk :
+                                   std::max<size_t>(chunkBytes / ((variableCount + 1) *
+                                                                  sizeof(te_type)),
+                                                    1) };
+    const size_t chunkCount{ (rowCount + rowsPerChunk - 1) / rowsPerChunk };
+    const size_t threadCount{ std::clamp<size_t>(options.m_threadCount, 1, chunkCount) };
+
+    // Each thread starts with an even share of the chunks, taking them from the front.
+    // When it runs out, it takes chunks from the back of the other threads' shares.
+    struct chunk_queue
+        {
+        std::mutex m_mutex;
+        size_t m_front{ 0 };
+        size_t m_back{ 0 };
+        };
+
+    std::vector<chunk_queue> queues(threadCount);
+    for (size_t i = 0; i < threadCount; ++i)
+        {
+        queues[i].m_front = (chunkCount * i) / threadCount;
+        queues[i].m_back = (chunkCount * (i + 1)) / threadCount;
+        }
+    const auto nextChunk = [&queues, threadCount](const size_t worker)
+    {
+        {
+        const std::lock_guard<std::mutex> lock(queues[worker].m_mutex);
+        if (queues[worker].m_front < queues[worker].m_back)
+            {
+            return queues[worker].m_front++;
+            }
+        }
+        for (size_t i = 1; i < threadCount; ++i)
+            {
+            auto& victim = queues[(worker + i) % threadCount];
+            const std::lock_guard<std::mutex> lock(victim.m_mutex);
+            if (victim.m_front < victim.m_back)
+                {
+                return --victim.m_back;
+                }
+            }
+        return npos;
+    };
+
+    // each thread's failures are merged in row order afterwards
+    std::vector<batch_result> workerResults(threadCount);
+    const auto evaluateChunks = [&, this](const size_t worker)
+    {
+        [[maybe_unused]] const thread_pinning pinning{ options.m_pinThreads, worker };
+        std::vector<te_type> subexpressionValues(m_subexpressions.size());
+        const values_scope scope{ subexpressionValues.data(), nullptr };
+        auto& workerResult = workerResults[worker];
+        // a program without variables still needs a non-null pointer to not read bound addresses
+        static constexpr te_type noValues{ 0 };
+        for (size_t chunk = nextChunk(worker); chunk != npos; chunk = nextChunk(worker))
+            {
+            const size_t lastRow{ std::min((chunk + 1) * rowsPerChunk, rowCount) };
+            for (size_t row = chunk * rowsPerChunk; row < lastRow; ++row)
+                {
+                m_currentVariableValues =
+                    (variableCount > 0) ? rows + (row * variableCount) : &noValues;
+                const te_variable_store::evaluation_scope storeScope;
+                try
+                    {
+                    results[row] = evaluate_current(subexpressionValues.data());
+                    }
+                catch (const std::exception& expt)
+                    {
+                    results[row] = te_parser::te_nan;
+                    ++workerResult.m_failedRows;
+                    if (row < workerResult.m_firstFailedRow)
+                        {
+                        workerResult.m_firstFailedRow = row;
+                        workerResult.m_errorMessage = expt.what();
+                        }
+                    }
+                }
+            }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (size_t i = 1; i < threadCount; ++i)
+        {
+        threads.emplace_back(evaluateChunks, i);
+        }
+    evaluateChunks(0);
+    for (auto& thread : threads)
+        {
+        thread.join();
+        }
+
+    batch_result result;
+    for (auto& workerResult : workerResults)
+        {
+        result.m_failedRows += workerResult.m_failedRows;
+        if (workerResult.m_firstFailedRow < result.m_firstFailedRow)
+            {
+            result.m_firstFailedRow = workerResult.m_firstFailedRow;
+            result.m_errorMessage = std::move(workerResult.m_errorMessage);
+            }
+        }
+    return result;
+    }
+
+//--------------------------------------------------
+size_t te_formula_set::add(std::shared_ptr<const te_program> program)
+    {
+    if (program == nullptr)
+        {
+        throw std::runtime_error("A program that failed to compile cannot be added.");
+        }
+    m_programs.push_back(std::move(program));
+    m_scheduled = false;
+    return m_programs.size() - 1;
+    }
+
+//--------------------------------------------------
+void te_formula_set::schedule()
+    {
+    m_order.resize(m_programs.size());
+    std::iota(m_order.begin(), m_order.end(), 0);
+    std::stable_sort(m_order.begin(), m_order.end(),
+                     [this](const size_t lhv, const size_t rhv)
+                     {
+                         return m_programs[lhv]->get_estimated_cost() >
+                                m_programs[rhv]->get_estimated_cost();
+                     });
+
+    // Each thread gets about 16 blocks, so that the last ones are small enough
+    // to even out the threads' finishing times. A program that costs more than
+    // a block gets a block of its own.
+    constexpr size_t blocksPerThread{ 16 };
+    size_t totalCost{ 0 };
+    for (const auto& program : m_programs)
+        {
+        totalCost += std::max<size_t>(program->get_estimated_cost(), 1);
+        }
+    const size_t blockCost{ std::max<size_t>(
+        totalCost / (std::max<size_t>(m_threadCount, 1) * blocksPerThread), 1) };
+    m_blockEnds.clear();
+    size_t currentCost{ 0 };
+    for (size_t i = 0; i < m_order.size(); ++i)
+        {
+        currentCost += std::max<size_t>(m_programs[m_order[i]]->get_estimated_cost(), 1);
+        if (currentCost >= blockCost)
+            {
+            m_blockEnds.push_back(i + 1);
+            currentCost = 0;
+            }
+        }
+    if (m_blockEnds.empty() || m_blockEnds.back() != m_order.size())
+        {
+        m_blockEnds.push_back(m_order.size());
+        }
+    m_results.resize(m_programs.size(), te_parser::te_nan);
+    m_scheduled = true;
+    }
+
+//--------------------------------------------------
+const te_formula_set::tick_report& te_formula_set::evaluate()
+    {
+    const auto start = std::chrono::steady_clock::now();
+    if (!m_scheduled)
+        {
+        schedule();
+        }
+    const size_t threadCount{ std::clamp<size_t>(m_threadCount, 1,
+                                                 std::max<size_t>(m_blockEnds.size(), 1)) };
+
+    std::atomic<size_t> nextBlock{ 0 };
+    std::vector<std::vector<size_t>> workerFailures(threadCount);
+    const auto evaluateBlocks = [this, &nextBlock, &workerFailures](const size_t worker)
+    {
+        for (size_t block = nextBlock++; block < m_blockEnds.size(); block = nextBlock++)
+            {
+            const size_t blockStart{ (block == 0) ? 0 : m_blockEnds[block - 1] };
+            for (size_t i = blockStart; i < m_blockEnds[block]; ++i)
+                {
+                const size_t programIndex{ m_order[i] };
+                const auto result = m_programs[programIndex]->evaluate();
+                m_results[programIndex] = result.m_value;
+                if (!result.m_success)
+                    {
+                    workerFailures[worker].push_back(programIndex);
+                    }
+                }
+            }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (size_t i = 1; i < threadCount; ++i)
+        {
+        threads.emplace_back(evaluateBlocks, i);
+        }
+    evaluateBlocks(0);
+    for (auto& thread : threads)
+        {
+        thread.join();
+        }
+
+    m_failedPrograms.clear();
+    for (const auto& failures : workerFailures)
+        {
+        m_failedPrograms.insert(m_failedPrograms.end(), failures.cbegin(), failures.cend());
+        }
+    std::sort(m_failedPrograms.begin(), m_failedPrograms.end());
+
+    m_lastTick.m_latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start);
+    m_lastTick.m_failedPrograms = m_failedPrograms.size();
+    m_lastTick.m_threadCount = threadCount;
+    ++m_tickCount;
+    m_maxLatency = std::max(m_maxLatency, m_lastTick.m_latency);
+    m_totalLatency += m_lastTick.m_latency;
+    return m_lastTick;
+    }
+
+//--------------------------------------------------
+// cppcheck-suppress unusedFunction
+std::string te_parser::list_available_functions_and_variables()
+    {
+    std::string report = "Built-in Functions:\n";
+    for (const auto& func : m_functions)
+        {
+        report.append(func.m_name).append("\n");
+        }
+    report.append("\nCustom Functions & Variables:\n");
+    for (const auto& func : m_customFuncsAndVars)
+        {
+        report.append(func.m_name).append("\n");
+        }
+    return report;
+    }
+
+//--------------------------------------------------
+void te_parser::set_random_seed(const uint64_t seed)
+    {
+    te_builtins::te_thread_random_generator().seed(seed);
+    }
+
+//--------------------------------------------------
+void te_parser::fill_random(te_type* values, const size_t valueCount)
+    {
+    auto& generator = te_builtins::te_thread_random_generator();
+    std::generate_n(values, valueCount, [&generator]() { return generator.next(); });
     }
 
 //--------------------------------------------------
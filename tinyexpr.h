@@ -51,9 +51,12 @@
 #define __TINYEXPR_PLUS_PLUS_H__
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <cctype>
 #include <cfloat>
+#include <chrono>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
@@ -61,19 +64,36 @@
 #include <functional>
 #include <initializer_list>
 #include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <random>
 #include <set>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <variant>
 #include <vector>
 #if __has_include(<bit>)
 #include <bit>
 #endif
+#if __has_include(<span>)
+#include <span>
+#endif
+#if __has_include(<coroutine>)
+#include <coroutine>
+#include <exception>
+#endif
 
 class te_parser;
+class te_formula_cache;
+class te_program;
+class te_program_registry;
 
 #if defined(TE_FLOAT) && defined(TE_LONG_DOUBLE)
 #error TE_FLOAT and TE_LONG_DOUBLE compile options cannot be combined. Only one data type can be specified.
@@ -121,8 +141,11 @@ using te_confun7 = te_type (*)(const te_expr*, te_type, te_type, te_type, te_typ
 using te_usr_noop = std::function<void()>;
 using te_usr_fun0 = std::function<te_type(std::string_view)>;
 using te_usr_fun1 = std::function<te_type(std::string_view, std::string&)>;
+// resolves all of an expression's unknown symbols at once
+// (returns a value for each symbol, or NaN for the ones that it can't resolve)
+using te_usr_batch = std::function<std::vector<te_type>(const std::vector<std::string_view>&)>;
 
-using te_usr_variant_type = std::variant<te_usr_noop, te_usr_fun0, te_usr_fun1>;
+using te_usr_variant_type = std::variant<te_usr_noop, te_usr_fun0, te_usr_fun1, te_usr_batch>;
 
 // do not change the ordering of these, the indices are used to determine
 // the value type of a te_variable
@@ -238,6 +261,360 @@ class te_variable
     te_expr* m_context{ nullptr };
     };
 
+/** @brief Variables that can be updated by one thread while other threads evaluate
+        expressions that use them, without the evaluations seeing a half-finished update.
+    @details The values are published with a sequence lock: an update (refer to
+        te_variable_store::update) changes any number of values, and an evaluation
+        (te_parser::evaluate() or te_program::evaluate()) reads a consistent snapshot of
+        all of them the first time that it reads one. Evaluations never lock; if an update
+        is published while a snapshot is being read, then the snapshot is read again.\n
+        Bind the variables to a parser with get_variables().
+    @note The store must outlive the expressions that are bound to it. Its variables are
+        never folded into constants, and are re-evaluated by incremental evaluation.
+    @par Example:
+    @code
+    te_variable_store prices({ "bid", "ask" });
+    te_parser tep;
+    tep.set_variables_and_functions(prices.get_variables());
+    tep.compile("ask - bid");
+
+    // feed thread
+        {
+        te_variable_store::update update(prices);
+        update.set("bid", 99.5);
+        update.set("ask", 100.5);
+        }
+
+    // evaluator thread (sees both new prices or both old ones, never one of each)
+    const auto spread = tep.evaluate();
+    @endcode*/
+class te_variable_store
+    {
+  public:
+    /// @brief An invalid slot.
+    constexpr static size_t npos = std::numeric_limits<size_t>::max();
+
+    /// @brief Constructor.
+    /// @param names The names of the variables (which all start at zero).
+    /// @throws std::runtime_error Throws an exception if a name is used more than once.
+    explicit te_variable_store(std::vector<std::string> names);
+
+    /// @private
+    te_variable_store(const te_variable_store&) = delete;
+    /// @private
+    te_variable_store& operator=(const te_variable_store&) = delete;
+
+    /// @brief Changes any number of values, which are published together when this
+    ///     is destroyed.
+    /// @details Updates are serialized, so multiple threads can update the store.
+    class update
+        {
+      public:
+        /// @brief Starts an update.
+        /// @param store The store to update.
+        explicit update(te_variable_store& store);
+        /// @private
+        update(const update&) = delete;
+        /// @private
+        update& operator=(const update&) = delete;
+        /// @brief Publishes the update.
+        ~update();
+
+        /// @brief Sets a value.
+        /// @param slot The variable's slot (refer to get_slot()).
+        /// @param value The value.
+        /// @throws std::runtime_error Throws an exception if @c slot is out of range.
+        void set(const size_t slot, const te_type value)
+            {
+            if (slot >= m_store.size())
+                {
+                throw std::runtime_error("Variable store slot is out of range.");
+                }
+            m_store.store_value(slot, value);
+            }
+
+        /// @brief Sets a value.
+        /// @param name The variable's name.
+        /// @param value The value.
+        /// @throws std::runtime_error Throws an exception if the store doesn't have
+        ///     the variable.
+        void set(const std::string_view name, const te_type value);
+
+      private:
+        te_variable_store& m_store;
+        std::lock_guard<std::mutex> m_lock;
+        };
+
+    /// @brief Sets and publishes one value.
+    /// @param slot The variable's slot (refer to get_slot()).
+    /// @param value The value.
+    /// @throws std::runtime_error Throws an exception if @c slot is out of range.
+    void set(const size_t slot, const te_type value)
+        {
+        update oneValue(*this);
+        oneValue.set(slot, value);
+        }
+
+    /// @returns The number of variables.
+    [[nodiscard]]
+    size_t size() const noexcept
+        {
+        return m_names.size();
+        }
+
+    /// @returns The names of the variables, in slot order.
+    [[nodiscard]]
+    const std::vector<std::string>& get_names() const noexcept
+        {
+        return m_names;
+        }
+
+    /// @returns The slot of a variable, or @c npos if the store doesn't have it.
+    /// @param name The variable's name (not case sensitive).
+    [[nodiscard]]
+    size_t get_slot(const std::string_view name) const noexcept;
+
+    /// @returns The variables, to pass to te_parser::set_variables_and_functions()
+    ///     (or to add to the other variables and functions passed to it).
+    [[nodiscard]]
+    std::set<te_variable> get_variables() const;
+
+    /// @returns A consistent snapshot of all of the values, in slot order.
+    [[nodiscard]]
+    std::vector<te_type> get_values() const
+        {
+        std::vector<te_type> values(size());
+        read_snapshot(values.data());
+        return values;
+        }
+
+    /// @returns The number of updates that have been published.
+    [[nodiscard]]
+    uint64_t get_version() const noexcept
+        {
+        return m_sequence.load(std::memory_order_acquire) / 2;
+        }
+
+    /// @private
+    /// @brief Marks the start and end of an evaluation on the current thread,
+    ///     which reads each store's snapshot at most once.
+    class evaluation_scope
+        {
+      public:
+        evaluation_scope() noexcept
+            {
+            if (m_evaluationDepth++ == 0)
+                {
+                ++m_evaluationId;
+                }
+            }
+
+        evaluation_scope(const evaluation_scope&) = delete;
+        evaluation_scope& operator=(const evaluation_scope&) = delete;
+
+        ~evaluation_scope() { --m_evaluationDepth; }
+        };
+
+  private:
+    // the values are stored as atomic words, so that reading them while they are
+    // being written (which the sequence lock then retries) isn't a data race
+    using word_type =
+        std::conditional_t<sizeof(te_type) % sizeof(uint64_t) == 0, uint64_t, uint32_t>;
+    constexpr static size_t words_per_value = sizeof(te_type) / sizeof(word_type);
+
+    /// @brief The context of a variable's function.
+    class slot_reference : public te_expr
+        {
+      public:
+        slot_reference(const te_variable_store* store, const size_t slot) noexcept
+            : m_store(store), m_slot(slot)
+            {
+            }
+
+        const te_variable_store* m_store{ nullptr };
+        size_t m_slot{ 0 };
+        };
+
+    /// @returns The value of a variable, from the current evaluation's snapshot.
+    [[nodiscard]]
+    static te_type read_variable(const te_expr* context);
+
+    void store_value(const size_t slot, const te_type value) noexcept;
+    /// @returns The current value of one variable.
+    [[nodiscard]]
+    te_type load_value(const size_t slot) const noexcept;
+    /// @brief Copies a consistent snapshot of the values into @c values.
+    void read_snapshot(te_type* values) const noexcept;
+
+    std::vector<std::string> m_names;
+    std::unique_ptr<std::atomic<word_type>[]> m_words;
+    std::vector<std::unique_ptr<slot_reference>> m_references;
+    // odd while an update is being written
+    std::atomic<uint64_t> m_sequence{ 0 };
+    std::mutex m_updateMutex;
+    // identifies the store in the threads' snapshots
+    uint64_t m_id{ 0 };
+
+    static std::atomic<uint64_t> m_nextId;
+    static thread_local uint64_t m_evaluationId;
+    static thread_local size_t m_evaluationDepth;
+    };
+
+#ifdef __cpp_lib_coroutine
+/** @brief The coroutine returned by te_parser::compile_async().
+    @details The compile doesn't start until the task is awaited (or start() is called),
+        and its result is whether the expression compiled (the same as te_parser::compile()).
+    @par Example:
+    @code
+    te_compile_task compile_formula(te_parser& tep, key_value_client& client)
+        {
+        const bool compiled = co_await tep.compile_async("TAG1 + TAG2", client.look_up_async());
+        co_return compiled && tep.evaluate() > 0;
+        }
+    @endcode*/
+class te_compile_task
+    {
+  public:
+    /// @private
+    struct promise_type
+        {
+        bool m_result{ false };
+        std::exception_ptr m_exception;
+        // the coroutine awaiting this one, which is resumed when it finishes
+        std::coroutine_handle<> m_continuation;
+
+        te_compile_task get_return_object() noexcept
+            {
+            return te_compile_task{ std::coroutine_handle<promise_type>::from_promise(*this) };
+            }
+
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+
+        auto final_suspend() const noexcept
+            {
+            struct continuation_awaiter
+                {
+                bool await_ready() const noexcept { return false; }
+
+                std::coroutine_handle<>
+                await_suspend(std::coroutine_handle<promise_type> finished) const noexcept
+                    {
+                    const auto continuation = finished.promise().m_continuation;
+                    return continuation ? continuation : std::noop_coroutine();
+                    }
+
+                void await_resume() const noexcept {}
+                };
+            return continuation_awaiter{};
+            }
+
+        void return_value(const bool result) noexcept { m_result = result; }
+
+        void unhandled_exception() noexcept { m_exception = std::current_exception(); }
+        };
+
+    /// @private
+    te_compile_task(const te_compile_task&) = delete;
+    /// @private
+    te_compile_task& operator=(const te_compile_task&) = delete;
+
+    /// @private
+    te_compile_task(te_compile_task&& that) noexcept
+        : m_coroutine(std::exchange(that.m_coroutine, nullptr)),
+          m_started(std::exchange(that.m_started, false))
+        {
+        }
+
+    /// @private
+    te_compile_task& operator=(te_compile_task&& that) noexcept
+        {
+        if (this != &that)
+            {
+            if (m_coroutine)
+                {
+                m_coroutine.destroy();
+                }
+            m_coroutine = std::exchange(that.m_coroutine, nullptr);
+            m_started = std::exchange(that.m_started, false);
+            }
+        return *this;
+        }
+
+    /// @private
+    ~te_compile_task()
+        {
+        if (m_coroutine)
+            {
+            m_coroutine.destroy();
+            }
+        }
+
+    /// @brief Starts the compile, if it hasn't started yet, without awaiting it.
+    /// @details This runs until the compile finishes or waits for the resolver
+    ///     (the resolver resumes it once the symbols are resolved).
+    void start()
+        {
+        if (m_coroutine && !m_started)
+            {
+            m_started = true;
+            m_coroutine.resume();
+            }
+        }
+
+    /// @returns @c true if the compile has finished.
+    [[nodiscard]]
+    bool is_done() const noexcept
+        {
+        return (m_coroutine && m_coroutine.done());
+        }
+
+    /// @returns Whether the expression compiled.
+    /// @throws std::runtime_error If the compile hasn't finished yet.
+    /// @throws Rethrows anything that the compile threw.
+    [[nodiscard]]
+    bool get_result() const
+        {
+        if (!is_done())
+            {
+            throw std::runtime_error("The compile has not finished.");
+            }
+        if (m_coroutine.promise().m_exception)
+            {
+            std::rethrow_exception(m_coroutine.promise().m_exception);
+            }
+        return m_coroutine.promise().m_result;
+        }
+
+    /// @private
+    bool await_ready() const noexcept { return (!m_coroutine || m_coroutine.done()); }
+
+    /// @private
+    std::coroutine_handle<> await_suspend(const std::coroutine_handle<> awaiting) noexcept
+        {
+        m_coroutine.promise().m_continuation = awaiting;
+        // if it was already started, then it is waiting for the resolver (which resumes it)
+        if (m_started)
+            {
+            return std::noop_coroutine();
+            }
+        m_started = true;
+        return m_coroutine;
+        }
+
+    /// @private
+    bool await_resume() const { return get_result(); }
+
+  private:
+    explicit te_compile_task(const std::coroutine_handle<promise_type> coroutine) noexcept
+        : m_coroutine(coroutine)
+        {
+        }
+
+    std::coroutine_handle<promise_type> m_coroutine;
+    bool m_started{ false };
+    };
+#endif
+
 /// @brief Math formula parser.
 class te_parser
     {
@@ -250,7 +627,62 @@ class te_parser
     te_parser& operator=(const te_parser&) = delete;
 
     /// @private
-    ~te_parser() { te_free(m_compiledExpression); }
+    ~te_parser() = default;
+
+    /// @brief Which algebraic simplifications compile() makes.
+    enum class simplification
+        {
+        /// @brief No simplifications.
+        none,
+        /// @brief Only rewrites that give the same results under IEEE 754 rules
+        ///     (e.g., `x*1` to `x`).
+        ieee_safe,
+        /// @brief Also rewrites that may change results for NaN, infinity, or signed zero
+        ///     (e.g., `x*0` to `0`).
+        fast_math
+        };
+
+    /// @brief How compile() may regroup chains of additions and multiplications
+    ///     to combine their constants (e.g., `5+a+5` to `a+10`).
+    enum class reassociation
+        {
+        /// @brief Keep the order that the expression was written in.
+        none,
+        /// @brief Only move integer constants whose sum (or product) is exact,
+        ///     keeping the other terms in the same order.
+        strict,
+        /// @brief Combine all constants and rebalance the chains.
+        relaxed
+        };
+
+    /// @brief Presets of the optimization passes that compile() runs, trading compilation
+    ///     time for evaluation speed (similar to a compiler's `-O0` through `-O3`).
+    enum class optimization_level
+        {
+        /// @brief (O0) No optimizations, for formulas that are only evaluated once.
+        none,
+        /// @brief (O1) Constant folding, IEEE-safe simplifications, and integer evaluation
+        ///     of bitwise operations (the default).
+        basic,
+        /// @brief (O2) Also shares repeated subexpressions.
+        ///     Results are the same as with optimization_level::basic.
+        standard,
+        /// @brief (O3) Also the fast-math simplifications and combining all constants in
+        ///     chains, which may change results by a rounding (or for NaN, infinity,
+        ///     and signed zero).
+        aggressive
+        };
+
+    /// @brief An optimization pass that the last call to compile() ran.
+    struct optimization_pass
+        {
+        /// @brief The name of the pass (e.g., "constant folding").
+        std::string m_name;
+        /// @brief Whether the pass changed the compiled expression.
+        bool m_changed{ false };
+        /// @brief How long the pass took.
+        std::chrono::nanoseconds m_duration{ 0 };
+        };
 
     /// @brief NaN (not-a-number) constant to indicate an invalid value.
     constexpr static auto te_nan = std::numeric_limits<te_type>::quiet_NaN();
@@ -306,6 +738,158 @@ class te_parser
         @throws std::runtime_error Throws an exception in the case of arithmetic overflows
             (e.g., `1 << 64` would cause an overflow).*/
     bool compile(const std::string_view expression);
+
+    /** @brief Checks whether @c expression is valid, without compiling it.
+        @details This reads the expression and checks its syntax the same way that compile() does,
+            but does not build or optimize a compiled expression from it (nor call any of
+            its functions). This is much faster than compile() when an expression only needs
+            to be checked, and not evaluated.\n
+            As with compile(), call get_last_error_position() afterwards to
+            see where the expression failed.
+        @param expression The formula to check.
+        @returns Whether the expression is valid or not. (This can be checked
+            by calling success() afterwards as well.)
+        @note Any previously compiled expression is cleared, so evaluate() will return NaN
+            until compile() is called again.\n
+            Also, because nothing is evaluated, errors that only occur while evaluating
+            (e.g., `1 << 64` overflowing) are not detected.\n
+            Finally, the unknown-symbol resolver (if one is connected) is still called
+            to check unknown symbols.*/
+    bool validate(const std::string_view expression);
+
+    /** @brief Compiles an expression into a program, which can be evaluated from any number
+            of threads at once.
+        @details The program is a copy of the compiled expression (bound to the same
+            variables), which is never modified after it is created. Evaluating it
+            returns its result (and error, if there was one) without changing the parser
+            or the program.
+        @param expression The formula to compile.
+        @returns The program, or @c nullptr if the expression could not be compiled
+            (call get_last_error_message() and get_last_error_position() to see why).
+        @note This also compiles the expression in the parser (the same as compile()).
+        @sa te_program::evaluate(), te_program_handle.*/
+    [[nodiscard]]
+    std::shared_ptr<const te_program> compile_program(const std::string_view expression);
+
+    /// @brief The result of compiling an expression with compile_many().
+    struct compile_result
+        {
+        /// @brief Whether the expression compiled.
+        bool m_success{ false };
+        /// @brief Where the expression failed to compile, or te_parser::npos if it didn't.
+        int64_t m_errorPosition{ npos };
+        /// @brief Any error message from compiling the expression.
+        std::string m_errorMessage;
+        };
+
+    /** @brief Compiles a batch of expressions, using the parser's current variables,
+            functions, and settings.
+        @details This is meant for loading a large number of expressions up front
+            (e.g., all of the formulas in a spreadsheet). The successfully compiled expressions
+            are stored in the parser's formula cache (refer to set_formula_cache()), so that
+            calling compile() or evaluate() with them later will not need to parse them again.\n
+            Setup costs (e.g., checking the separators and looking up each variable and function's
+            name) are only paid once for the batch, and the expressions can be compiled
+            across multiple threads.
+        @param expressions The expressions to compile.
+        @param threadCount The number of threads to compile the expressions with.
+        @returns The results of compiling each expression (in the same order as @c expressions).
+        @note The expression currently compiled in the parser is not affected.\n
+            The threads share the parser's variables and functions (which must not be changed
+            while the expressions are compiled). If an unknown-symbol resolver is connected,
+            then it is only called by one thread at a time (as it may not be thread safe).
+            Each unknown symbol is only resolved once for the entire batch, and the resolved
+            variables are added to the parser afterwards if the resolver is set to keep them.
+        @throws std::runtime_error Throws an exception if the list and
+            decimal separators are the same.*/
+    std::vector<compile_result> compile_many(const std::vector<std::string_view>& expressions,
+                                             const size_t threadCount = 1)
+        {
+        return compile_many(expressions.data(), expressions.size(), threadCount);
+        }
+
+#ifdef __cpp_lib_span
+    /// @copydoc compile_many(const std::vector<std::string_view>&, const size_t)
+    std::vector<compile_result> compile_many(const std::span<const std::string_view> expressions,
+                                             const size_t threadCount = 1)
+        {
+        return compile_many(expressions.data(), expressions.size(), threadCount);
+        }
+#endif
+
+    /** @brief Compiles a batch of expressions into programs (refer to compile_program()),
+            and adds them to a registry.
+        @details This is meant for loading all of the formulas in a workbook across
+            multiple threads. The expressions are compiled the same way as compile_many(),
+            and the expressions that are already in the registry are not compiled again.
+        @param expressions The expressions to compile.
+        @param[in,out] registry The registry to add the programs to (with the expressions
+            as their keys).
+        @param threadCount The number of threads to compile the expressions with.
+        @returns The results of compiling each expression (in the same order as @c expressions).
+        @note The expression currently compiled in the parser is not affected.
+        @throws std::runtime_error Throws an exception if the list and
+            decimal separators are the same.*/
+    std::vector<compile_result> compile_programs(const std::vector<std::string_view>& expressions,
+                                                 te_program_registry& registry,
+                                                 const size_t threadCount = 1)
+        {
+        return compile_many(expressions.data(), expressions.size(), threadCount, &registry);
+        }
+
+#ifdef __cpp_lib_span
+    /// @copydoc compile_programs(const std::vector<std::string_view>&, te_program_registry&,
+    ///     const size_t)
+    std::vector<compile_result>
+    compile_programs(const std::span<const std::string_view> expressions,
+                     te_program_registry& registry, const size_t threadCount = 1)
+        {
+        return compile_many(expressions.data(), expressions.size(), threadCount, &registry);
+        }
+#endif
+
+#ifdef __cpp_lib_coroutine
+    /** @brief Compiles an expression, resolving its unknown symbols with an asynchronous
+            resolver (e.g., one that reads them from another process over a socket).
+        @details The expression is scanned for unknown symbols (refer to te_usr_batch), and the
+            coroutine suspends while the resolver looks all of them up at once. When the
+            resolver resumes it, the expression is compiled with the resolved values (the same
+            as a batch resolver set with set_unknown_symbol_resolver()), so no thread is blocked
+            while the symbols are being resolved.
+        @param expression The formula to compile.
+        @param resolver A function that is called with the unknown symbols and returns an
+            awaitable, which results in a @c std::vector<te_type> with a value for each symbol
+            (or NaN for the ones that it can't resolve). If awaiting it throws, then the compile
+            fails with the exception's message.
+        @returns A task that compiles the expression when it is awaited (or started), and
+            results in whether the expression compiled.
+        @note The parser must outlive the task, and must not be used by anything else
+            until the task finishes. Whether the resolved symbols are kept in the parser
+            afterwards follows set_unknown_symbol_resolver()'s @c keepResolvedVariables.*/
+    template<typename async_resolver>
+    [[nodiscard]]
+    te_compile_task compile_async(std::string expression, async_resolver resolver)
+        {
+        const std::string_view scannedExpression{ expression };
+        const auto unknownSymbols = find_unknown_symbols(&scannedExpression, 1);
+        const std::vector<std::string_view> names(unknownSymbols.cbegin(), unknownSymbols.cend());
+        std::vector<te_type> values;
+        std::string resolverError;
+        if (!names.empty())
+            {
+            try
+                {
+                values = co_await resolver(names);
+                }
+            catch (const std::exception& expt)
+                {
+                resolverError = expt.what();
+                }
+            }
+        co_return compile_resolved(expression, names, values, resolverError);
+        }
+#endif
+
     /** @brief Evaluates expression passed to compile() previously and returns its result.
         @returns The result, or NaN on error.
         @throws std::runtime_error Throws an exception in the case of arithmetic overflows
@@ -315,12 +899,336 @@ class te_parser
     /** @brief Compiles and evaluates an expression and returns its result.
         @param expression The formula to compile and evaluate.
         @returns The result, or NaN on error.
+        @note If @c expression was successfully compiled before (and the custom
+            variables, functions, and separators have not changed since), then
+            its cached compiled form is reused and parsing is skipped.
+            Refer to set_expression_cache_size().
         @note Returns NaN if division or modulus by zero occurs.
         @throws std::runtime_error Throws an exception in the case of arithmetic overflows
             (e.g., `1 << 64` would cause an overflow).*/
     [[nodiscard]]
     te_type evaluate(const std::string_view expression);
 
+    /** @brief Edits the current expression and compiles it again.
+        @details Replaces @c length characters starting at @c offset in the current expression
+            (see get_expression()) with @c replacement and then recompiles it.\n
+            If incremental compilation is enabled and the edit is within a function's
+            argument or a parenthesized group, then only that argument or group is parsed again
+            (instead of the entire expression). Otherwise, this is the same as calling compile()
+            with the edited expression.
+        @param offset The position in the current expression where the edit begins.
+        @param length The number of characters being replaced.
+        @param replacement The text to insert.
+        @returns Whether the edited expression compiled or not.
+        @throws std::runtime_error Throws an exception if @c offset is past
+            the end of the expression.
+        @sa set_incremental_compilation().*/
+    bool recompile(const size_t offset, const size_t length, const std::string_view replacement);
+
+    /** @brief Sets whether recompile() should only parse the part of an expression that was edited.
+        @details This requires compile() to keep track of where each function argument and
+            parenthesized group is in the expression (and what it compiled into), which uses
+            more memory. Because of this, it is disabled by default.
+        @param enable @c true to enable incremental compilation.
+        @note Compiled expressions are not cached (neither by evaluate(expression) nor in a
+            formula cache) while this is enabled, because recompile() edits them in place.*/
+    void set_incremental_compilation(const bool enable)
+        {
+        m_incrementalCompilation = enable;
+        trim_expression_cache(0);
+        reset_incremental_state();
+        }
+
+    /// @returns @c true if recompile() only parses the part of an expression that was edited.
+    [[nodiscard]]
+    bool is_incremental_compilation_enabled() const noexcept
+        {
+        return m_incrementalCompilation;
+        }
+
+    /** @brief Points a variable in the compiled expression to a different address,
+            without compiling the expression again.
+        @details This is useful for evaluating the same formula against many objects,
+            where rebinding its variables only costs a few stores instead of a parse.
+        @param name The name of the variable (as it appears in the expression).
+        @param address The new address of the variable's value.
+        @returns @c false if the compiled expression does not use @c name as a variable.
+        @note This only affects the current compiled expression; the parser's variables
+            are not changed, so the next call to compile() (or evaluate(expression))
+            binds the variables from them again.
+        @sa get_bound_variable_names(), rebind_all().*/
+    bool rebind(const std::string_view name, const te_type* address);
+
+    /** @brief Points all the variables in the compiled expression to different addresses,
+            without compiling the expression again.
+        @param addresses The new addresses of the variables' values, in the order that
+            get_bound_variable_names() returns them.
+        @throws std::runtime_error Throws an exception if the number of addresses does not
+            match the number of variables in the compiled expression.
+        @sa rebind().*/
+    void rebind_all(const std::vector<const te_type*>& addresses)
+        {
+        rebind_all(addresses.data(), addresses.size());
+        }
+
+#ifdef __cpp_lib_span
+    /// @private
+    void rebind_all(std::span<const te_type* const> addresses)
+        {
+        rebind_all(addresses.data(), addresses.size());
+        }
+#endif
+
+    /// @returns The variables that the compiled expression is bound to,
+    ///     in the order that they first appear in it.
+    /// @sa rebind_all().
+    [[nodiscard]]
+    std::vector<std::string> get_bound_variable_names() const
+        {
+        std::vector<std::string> names;
+        names.reserve(m_variableSlots.size());
+        for (const auto& slot : m_variableSlots)
+            {
+            names.push_back(slot.m_name);
+            }
+        return names;
+        }
+
+    /** @brief Sets whether evaluate() should only recalculate the parts of the compiled
+            expression that depend on variables that have changed.
+        @details The result of each part of the expression is kept after it is evaluated.
+            After changing the values of some variables, call mark_variable_dirty() for each of
+            them, and the next evaluate() will only recalculate the functions that they are in
+            (and the functions that those are in, up to the whole expression).
+
+            This is useful for large formulas where only a few of their variables change
+            between evaluations.
+        @param enable @c true to enable incremental evaluation.
+        @note Variables whose values are changed without calling mark_variable_dirty() will
+            not be read again until the expression is compiled again.
+
+            Impure functions and closures (and the functions that they are in) are
+            always recalculated.
+
+            The first evaluation after the expression is compiled (or recompiled) evaluates
+            the whole expression. This is disabled by default.*/
+    void set_incremental_evaluation(const bool enable)
+        {
+        m_incrementalEvaluation = enable;
+        m_dirtyTracking = dirty_tracking{};
+        }
+
+    /// @returns @c true if evaluate() only recalculates the parts of the compiled
+    ///     expression that depend on variables that have changed.
+    [[nodiscard]]
+    bool is_incremental_evaluation_enabled() const noexcept
+        {
+        return m_incrementalEvaluation;
+        }
+
+    /** @brief Tells evaluate() that a variable's value has changed, so that the parts of the
+            compiled expression that use it are recalculated.
+        @param name The name of the variable (as it appears in the expression).
+        @returns @c false if the compiled expression does not use @c name as a variable.
+        @note This is only needed when incremental evaluation is enabled.
+        @sa set_incremental_evaluation().*/
+    bool mark_variable_dirty(const std::string_view name);
+
+    /** @brief Sets which optimization passes compile() runs.
+        @details This sets each pass to the level's preset:
+            - optimization_level::none: no constant folding, simplification,
+              reassociation, common subexpression elimination, or integer evaluation.
+            - optimization_level::basic: constant folding, simplification::ieee_safe,
+              and integer evaluation.
+            - optimization_level::standard: constant folding, simplification::ieee_safe,
+              common subexpression elimination, and integer evaluation.
+              No reassociation is done, as regrouping a chain may change its result by a rounding.
+            - optimization_level::aggressive: constant folding, simplification::fast_math,
+              reassociation::relaxed, common subexpression elimination,
+              and integer evaluation.
+
+            The passes can be changed individually afterwards (e.g., with set_simplification()).
+        @param level The optimization level.
+        @sa get_optimization_report().*/
+    void set_optimization_level(const optimization_level level)
+        {
+        m_optimizationLevel = level;
+        m_constantFolding = (level != optimization_level::none);
+        m_simplification = (level == optimization_level::none)       ? simplification::none :
+                           (level == optimization_level::aggressive) ? simplification::fast_math :
+                                                                       simplification::ieee_safe;
+        m_reassociation = (level == optimization_level::aggressive) ? reassociation::relaxed :
+                                                                      reassociation::none;
+        m_commonSubexpressionElimination = (level == optimization_level::standard ||
+                                            level == optimization_level::aggressive);
+        m_integerEvaluation = (level != optimization_level::none);
+        invalidate_expression_cache();
+        }
+
+    /// @returns The optimization level last passed to set_optimization_level().
+    /// @note The passes may have been changed individually since then.
+    [[nodiscard]]
+    optimization_level get_optimization_level() const noexcept
+        {
+        return m_optimizationLevel;
+        }
+
+    /** @brief Sets whether compile() should evaluate the parts of an expression that only
+            use constants and pure functions (e.g., `2*pi` or `sqrt(4)`).
+        @param enable @c true to enable constant folding (the default).*/
+    void set_constant_folding(const bool enable)
+        {
+        m_constantFolding = enable;
+        invalidate_expression_cache();
+        }
+
+    /// @returns @c true if compile() evaluates the parts of an expression that only
+    ///     use constants and pure functions.
+    [[nodiscard]]
+    bool is_constant_folding_enabled() const noexcept
+        {
+        return m_constantFolding;
+        }
+
+    /** @brief Sets whether compile() should find the parts of an expression that are bitwise
+            operations of other bitwise operations (e.g., `bitor(a << 8, b)`) and evaluate them
+            with integers, only converting to and from the parser's floating-point type
+            at their operands and result.
+        @details The results (and the errors for operands that aren't valid for bitwise
+            operations) are the same as evaluating the operations individually.
+        @param enable @c true to enable integer evaluation (the default).
+        @note This is not done when incremental compilation is enabled.*/
+    void set_integer_evaluation(const bool enable)
+        {
+        m_integerEvaluation = enable;
+        invalidate_expression_cache();
+        }
+
+    /// @returns @c true if compile() evaluates nested bitwise operations with integers.
+    [[nodiscard]]
+    bool is_integer_evaluation_enabled() const noexcept
+        {
+        return m_integerEvaluation;
+        }
+
+    /** @returns The optimization passes that the last call to compile() ran (in order),
+            whether each one changed the expression, and how long each one took.
+        @note This is empty if no passes were run or the compiled expression was loaded
+            from a cache.*/
+    [[nodiscard]]
+    const std::vector<optimization_pass>& get_optimization_report() const noexcept
+        {
+        return m_optimizationReport;
+        }
+
+    /** @brief Sets whether compile() should share repeated subexpressions, so that each one is
+            only evaluated once (per call to evaluate()).
+        @details For example, `(a+1)` in `(a+1)*(a+1)/sqrt(a+1)` would be evaluated once and its
+            result reused, rather than being evaluated three times.\n
+            Only subexpressions made up of pure functions, variables, and constants are shared;
+            impure functions and functions that use a context are still called everywhere
+            that they appear.
+        @param enable @c true to enable common subexpression elimination.
+        @note This is disabled by default, and is not performed while incremental
+            compilation is enabled.*/
+    void set_common_subexpression_elimination(const bool enable)
+        {
+        m_commonSubexpressionElimination = enable;
+        invalidate_expression_cache();
+        }
+
+    /// @returns @c true if compile() shares repeated subexpressions.
+    [[nodiscard]]
+    bool is_common_subexpression_elimination_enabled() const noexcept
+        {
+        return m_commonSubexpressionElimination;
+        }
+
+    /** @brief Sets which algebraic simplifications compile() makes after evaluating
+            the constant parts of an expression.
+        @details The IEEE-safe simplifications (the default) are:
+            - `x*1`, `1*x`, `x/1`, `x-0`, and `x^1` to `x`
+            - `-(-x)` to `x`
+            - `abs(abs(x))` to `abs(x)`
+            - `if(constant, a, b)` to `a` or `b`
+            - `x^0` to `1`, where @c x is a variable
+            - `x^2`, `x^-1`, and `x^0.5` to `x*x`, `1/x`, and a square root
+            - `x/c` to `x*(1/c)`, where @c c is a power of two
+
+            Fast-math simplifications also include:
+            - `x+0` and `0+x` to `x` (which changes the sign of `-0+0`)
+            - `x*0` and `0*x` to `0` (which changes the results for NaN and infinity)
+            - `f(x)^0` to `1` (which hides any error that @c f(x) would raise,
+              such as division by zero)
+            - `x^3`, `x^4`, `x^1.5`, and `x^2.5` to multiplications (and a square root)
+            - `x/c` to `x*(1/c)`, for any constant @c c
+
+            The fast-math rewrites of powers and division can be off by a rounding.
+
+            Subexpressions are only removed if they do not call any impure functions.
+        @param mode The simplifications to make.
+        @sa get_simplification_counts().*/
+    void set_simplification(const simplification mode)
+        {
+        m_simplification = mode;
+        invalidate_expression_cache();
+        }
+
+    /// @returns Which algebraic simplifications compile() makes.
+    [[nodiscard]]
+    simplification get_simplification() const noexcept
+        {
+        return m_simplification;
+        }
+
+    /** @brief Sets whether compile() may regroup chains of additions, subtractions, and
+            multiplications so that their constants can be combined.
+        @details For example, `5+a+5` is evaluated as `(5+a)+5`, so its constants can't be
+            combined unless it is regrouped as `a+(5+5)`.\n
+            With reassociation::strict, only integer constants (whose sum or product is exact)
+            are moved and the other terms are kept in the same order.
+            With reassociation::relaxed, all constants are combined and the chains are
+            rebalanced.\n
+            Both modes can change results. Even when the constants' sum is exact, adding it
+            in one step rounds differently than adding each constant to an inexact term
+            (e.g., with @c b set to 3, `b/9+1+-1` is `0.33333333333333326` without reassociation
+            and `0.33333333333333331` with `b/9+0`).\n
+            The number of nodes that this removes is included in get_simplification_counts()
+            (as `reassociation`).
+        @param mode How to regroup the chains.
+        @note Floating-point addition and multiplication are not associative, so any
+            regrouping (including reassociation::strict) may change the result by a rounding.
+            Because of this, it is disabled by default. It is also not performed while
+            incremental compilation is enabled.*/
+    void set_reassociation(const reassociation mode)
+        {
+        m_reassociation = mode;
+        invalidate_expression_cache();
+        }
+
+    /// @returns How compile() may regroup chains of additions and multiplications.
+    [[nodiscard]]
+    reassociation get_reassociation() const noexcept
+        {
+        return m_reassociation;
+        }
+
+    /// @returns The number of nodes that each simplification rule (e.g., `x*1`)
+    ///     has removed from compiled expressions.
+    ///     For rules that change an operation into a cheaper one (e.g., `x/c`),
+    ///     each change is counted.
+    /// @note These are totals since the parser was created or reset_simplification_counts()
+    ///     was called. Expressions loaded from a cache were not simplified again,
+    ///     so they are not counted.
+    [[nodiscard]]
+    const std::map<std::string, size_t, std::less<>>& get_simplification_counts() const noexcept
+        {
+        return m_simplificationCounts;
+        }
+
+    /// @brief Resets the counts returned by get_simplification_counts().
+    void reset_simplification_counts() noexcept { m_simplificationCounts.clear(); }
+
     /// @returns The last call to evaluate()'s result (which will be NaN on error).
     [[nodiscard]]
     te_type get_result() const noexcept
@@ -385,6 +1293,7 @@ class te_parser
             validate_name(var);
             }
         m_customFuncsAndVars = std::move(vars);
+        invalidate_expression_cache();
         }
 
     /// @brief Adds a custom variable or function.
@@ -397,6 +1306,7 @@ class te_parser
         {
         validate_name(var);
         m_customFuncsAndVars.insert(std::move(var));
+        invalidate_expression_cache();
         }
 
     /// @brief Removes a custom variable or function.
@@ -408,6 +1318,7 @@ class te_parser
         if (foundVar != m_customFuncsAndVars.cend())
             {
             m_customFuncsAndVars.erase(foundVar);
+            invalidate_expression_cache();
             }
         }
 
@@ -419,12 +1330,18 @@ class te_parser
             Pass @c false to this if you wish to re-resolve any previously resolved
             variables on later evaluations.
             This can be useful for when a resolved variable's value is
-            volatile and needs to be re-resolved on every use.*/
+            volatile and needs to be re-resolved on every use.
+        @note A @c te_usr_batch resolver is called once per compile (or once per call to
+            compile_many()) with all of the unknown symbols in the expression(s), which are
+            found by scanning them before they are parsed. This is preferable to a resolver
+            that is called for each symbol when every call has a cost of its own
+            (e.g., a query to a database).*/
     void set_unknown_symbol_resolver(te_usr_variant_type usr,
                                      const bool keepResolvedVariables = true)
         {
         m_unknownSymbolResolve = usr;
         m_keepResolvedVarialbes = keepResolvedVariables;
+        invalidate_expression_cache();
         }
 
     /// @private
@@ -435,9 +1352,12 @@ class te_parser
         }
 
     /// @returns The list of custom variables and functions.
+    /// @note Because the returned list can be edited, any cached compiled
+    ///     expressions are discarded when this is called.
     [[nodiscard]]
     std::set<te_variable>& get_variables_and_functions() noexcept
         {
+        invalidate_expression_cache();
         return m_customFuncsAndVars;
         }
 
@@ -465,6 +1385,7 @@ class te_parser
             throw std::runtime_error("Decimal separator must be either a '.' or ','.");
             }
         m_decimalSeparator = sep;
+        invalidate_expression_cache();
         }
 
     /// @private
@@ -475,6 +1396,7 @@ class te_parser
             throw std::runtime_error("Decimal separator must be either a '.' or ','.");
             }
         m_decimalSeparator = sep;
+        invalidate_expression_cache();
         }
 
     /// @brief Sets a constant variable's value.
@@ -487,15 +1409,16 @@ class te_parser
     void set_constant(const std::string_view name, const te_type value)
         {
         auto cvar = find_variable_or_function(name);
-        if (cvar == get_variables_and_functions().end())
+        if (cvar == m_customFuncsAndVars.end())
             {
             add_variable_or_function({ te_variable::name_type{ name }, value });
             }
         else if (is_constant(cvar->m_value))
             {
-            auto nh = get_variables_and_functions().extract(cvar);
+            auto nh = m_customFuncsAndVars.extract(cvar);
             nh.value().m_value = value;
-            get_variables_and_functions().insert(std::move(nh));
+            m_customFuncsAndVars.insert(std::move(nh));
+            invalidate_expression_cache();
             // if previously compiled, then re-compile since this
             // constant would have been optimized
             if (m_expression.length())
@@ -550,6 +1473,7 @@ class te_parser
             throw std::runtime_error("List separator must be either a ',' or ';'.");
             }
         m_listSeparator = sep;
+        invalidate_expression_cache();
         }
 
     /// @private
@@ -560,6 +1484,7 @@ class te_parser
             throw std::runtime_error("List separator must be either a ',' or ';'.");
             }
         m_listSeparator = sep;
+        invalidate_expression_cache();
         }
 #ifndef TE_NO_BOOKKEEPING
     /// @returns @c true if @c name is a function that had been used in the last parsed formula.
@@ -584,6 +1509,51 @@ class te_parser
     [[nodiscard]]
     std::string list_available_functions_and_variables();
 
+    /** @brief Sets the maximum number of compiled expressions that evaluate(expression)
+            keeps for reuse.
+        @details When an expression passed to evaluate(expression) has already been compiled
+            (and the custom variables, functions, unknown-symbol resolver, and separators
+            have not changed since), then its compiled form is reused instead of
+            parsing the expression again.
+        @param cacheSize The number of expressions to cache. Set to @c 0 to disable caching.
+        @note When the cache is full, the least-recently used expression is removed
+            before the next one is added.*/
+    void set_expression_cache_size(const size_t cacheSize)
+        {
+        m_expressionCacheSize = cacheSize;
+        trim_expression_cache(m_expressionCacheSize);
+        }
+
+    /// @returns The maximum number of compiled expressions that evaluate(expression)
+    ///     keeps for reuse.
+    [[nodiscard]]
+    size_t get_expression_cache_size() const noexcept
+        {
+        return m_expressionCacheSize;
+        }
+
+    /** @brief Sets a formula cache to look up compiled expressions in
+            (and store newly compiled ones in).
+        @details A formula cache can be shared between any number of parsers (including ones
+            being used on different threads), so that an expression that one parser
+            has already compiled can be reused by another one.\n
+            The compiled expressions are only reused between parsers that have the same
+            custom variables, functions, and separators.
+        @param cache The cache to use, or @c nullptr to not use one (the default).
+        @note Shared formulas are not used while an unknown-symbol resolver is connected.
+        @sa te_formula_cache.*/
+    void set_formula_cache(std::shared_ptr<te_formula_cache> cache) noexcept
+        {
+        m_formulaCache = std::move(cache);
+        }
+
+    /// @returns The formula cache being used (may be @c nullptr).
+    [[nodiscard]]
+    const std::shared_ptr<te_formula_cache>& get_formula_cache() const noexcept
+        {
+        return m_formulaCache;
+        }
+
     /// @returns The last formula passed to the parser.
     /// @note Comments will be stripped from the original expression.
     [[nodiscard]]
@@ -592,6 +1562,33 @@ class te_parser
         return m_expression;
         }
 
+    /** @brief Sets the seed of the random number generator that `rand()` uses on the
+            calling thread.
+        @details Each thread has its own generator (xoshiro256**), which is seeded from
+            @c std::random_device the first time that it is used. Setting the seed makes the
+            values that `rand()` returns on the thread reproducible (e.g., for tests).
+        @param seed The seed.*/
+    static void set_random_seed(const uint64_t seed);
+
+    /** @brief Fills @c values with random numbers between 0 and 1 (not including 1),
+            the same as calling `rand()` for each one.
+        @details This is faster than evaluating `rand()` for each value, which is useful for
+            generating the inputs of a simulation in one pass.
+        @param values The values to fill.
+        @sa set_random_seed().*/
+    static void fill_random(std::vector<te_type>& values)
+        {
+        fill_random(values.data(), values.size());
+        }
+
+#ifdef __cpp_lib_span
+    /// @copydoc fill_random(std::vector<te_type>&)
+    static void fill_random(const std::span<te_type> values)
+        {
+        fill_random(values.data(), values.size());
+        }
+#endif
+
     /// @brief Helper function to see if a double value is boolean.
     /// @param val The value to examine.
     /// @returns @c if the value is non-zero and also a valid double
@@ -605,9 +1602,379 @@ class te_parser
 
     /// @returns Information about how the parser is configured, its capabilities, etc.
     [[nodiscard]]
-    static std::string info();
+    static std::string info();
+
+  private:
+    friend class te_formula_cache;
+    friend class te_program;
+
+    /// @brief The nodes in a compiled expression that are bound to a variable.
+    struct variable_slot
+        {
+        te_variable::name_type m_name;
+        std::vector<te_expr*> m_nodes;
+        };
+
+    /// @brief Pure subexpressions that appear more than once in a compiled expression.
+    /// @details These are evaluated (in order) before the rest of the expression, which reads
+    ///     their results (its nodes are variables bound to the values here).
+    struct common_subexpressions
+        {
+        common_subexpressions() = default;
+        common_subexpressions(const common_subexpressions&) = delete;
+        common_subexpressions& operator=(const common_subexpressions&) = delete;
+
+        ~common_subexpressions()
+            {
+            for (auto* subexpression : m_expressions)
+                {
+                te_free(subexpression);
+                }
+            }
+
+        /// @brief The subexpressions (a subexpression may use the ones before it).
+        std::vector<te_expr*> m_expressions;
+        /// @brief The subexpressions' results from the last evaluation.
+        std::unique_ptr<te_type[]> m_values;
+        };
+
+    /// @brief An invalid index into a vector.
+    constexpr static size_t no_index = std::numeric_limits<size_t>::max();
+
+    /// @brief A node in the compiled expression (or a common subexpression) and its
+    ///     result from the last evaluation, used for incremental evaluation.
+    struct tracked_node
+        {
+        const te_expr* m_node{ nullptr };
+        // the index of the node that this is a parameter of (or no_index for a root)
+        size_t m_parent{ no_index };
+        // the node's parameters are tracked at this index and the ones after it
+        size_t m_firstParameter{ 0 };
+        te_type m_value{ te_nan };
+        // needs to be evaluated again
+        bool m_dirty{ true };
+        // has an impure function in it, so it is always evaluated again
+        bool m_volatile{ false };
+        };
+
+    /// @brief The last results of the compiled expression's parts, for incremental evaluation.
+    struct dirty_tracking
+        {
+        /// @brief The tracked nodes, where each node's parameters are next to each other.
+        std::vector<tracked_node> m_nodes;
+        /// @brief The common subexpressions' roots (in order), followed by the expression's root.
+        std::vector<size_t> m_roots;
+        /// @brief The nodes of each variable in m_variableSlots.
+        std::vector<std::vector<size_t>> m_variableNodes;
+        /// @brief The nodes that read each common subexpression's result.
+        std::vector<std::vector<size_t>> m_subexpressionReaders;
+        };
+
+    /// @brief A successfully compiled expression (and its bookkeeping).
+    /// @details This is never modified after it is created, so it can be
+    ///     shared between parsers (and threads).
+    struct compiled_formula
+        {
+        std::shared_ptr<te_expr> m_compiledExpression;
+        std::shared_ptr<common_subexpressions> m_commonSubexpressions;
+        std::vector<variable_slot> m_variableSlots;
+#ifndef TE_NO_BOOKKEEPING
+        std::set<te_variable::name_type, te_string_less> m_usedFunctions;
+        std::set<te_variable::name_type, te_string_less> m_usedVars;
+#endif
+        };
+
+    /// @brief A compiled expression stored by evaluate(expression) for reuse.
+    struct cached_expression
+        {
+        std::shared_ptr<const compiled_formula> m_formula;
+        /// @brief The expression, after comments were stripped.
+        std::string m_expression;
+        /// @brief Where the expression is in the most-recently used order.
+        std::list<std::string>::iterator m_recentPosition;
+        };
+
+    /// @brief A function argument or parenthesized group in the current expression,
+    ///     which can be parsed again by itself after it is edited.
+    struct reparse_unit
+        {
+        /// @brief The start of the unit's text (just after the opening '(' or separator).
+        size_t m_begin{ 0 };
+        /// @brief The end of the unit's text (i.e., the position of the closing ')' or separator).
+        size_t m_end{ 0 };
+        /// @brief The node that the text compiled into.
+        te_expr* m_node{ nullptr };
+        /// @brief @c true if this is a parenthesized group (parsed by list()),
+        ///     @c false if a function argument (parsed by expr_level1()).
+        bool m_isList{ false };
+        };
+
+    /// @brief Where a node is in the compiled expression.
+    struct node_link
+        {
+        /// @brief The node's parent (@c nullptr for the root).
+        te_expr* m_parent{ nullptr };
+        /// @brief The node's index in its parent's parameters.
+        size_t m_index{ 0 };
+        };
+
+    /// @brief A variable or function used in the current expression.
+    struct symbol_reference
+        {
+        size_t m_position{ 0 };
+        te_variable::name_type m_name;
+        bool m_isFunction{ false };
+        };
+
+    /// @brief Marks any cached compiled expressions as stale.
+    /// @details This should be called whenever anything that affects how an
+    ///     expression is compiled (e.g., the custom variables) changes.
+    void invalidate_expression_cache() noexcept { ++m_symbolTableVersion; }
+
+    /// @private
+    void invalidate_expression_cache() volatile noexcept
+        {
+        m_symbolTableVersion = m_symbolTableVersion + 1;
+        }
+
+    /// @returns The current compiled expression and its bookkeeping,
+    ///     packaged so that it can be cached.
+    [[nodiscard]]
+    std::shared_ptr<const compiled_formula> make_compiled_formula() const;
+
+    /// @brief Makes a compiled formula (e.g., from a formula cache) the current one.
+    /// @param formula The compiled formula to load.
+    void load_compiled_formula(const std::shared_ptr<const compiled_formula>& formula);
+
+    /// @brief Removes the least-recently used expressions from the expression cache
+    ///     until it has no more than @c capacity of them.
+    void trim_expression_cache(const size_t capacity);
+
+    /// @brief Stores a compiled expression into the expression cache.
+    /// @param expression The (original) expression that was compiled.
+    /// @param formula The compiled expression.
+    void cache_compiled_expression(std::string expression,
+                                   std::shared_ptr<const compiled_formula> formula);
+
+    /// @returns @c true if a shared formula cache is being used.
+    /// @note Formulas are not shared while an unknown-symbol resolver is in use,
+    ///     as what symbols it resolves (and to what) is not known beforehand.
+    [[nodiscard]]
+    bool is_using_formula_cache() const noexcept
+        {
+        return (m_formulaCache != nullptr && m_unknownSymbolResolve.index() == 0);
+        }
+
+    /// @returns The key that @c expression (which should already have its comments
+    ///     stripped) is stored under in a formula cache.
+    /// @details This is the expression with its whitespace collapsed and converted to
+    ///     lowercase, followed by a hash of everything that the compiled form of it
+    ///     depends on (i.e., the custom variables and functions and the separators).
+    ///     The hash only spreads the keys out; the bindings themselves
+    ///     (see get_binding_signature()) are compared when an expression is looked up.
+    /// @param expression The expression.
+    [[nodiscard]]
+    std::string make_formula_cache_key(const std::string_view expression);
+
+    /// @returns Everything that a compiled expression depends on (the custom variables'
+    ///     and functions' names, flags, and addresses, the separators, and the optimization
+    ///     settings), written out as a string.
+    [[nodiscard]]
+    const std::shared_ptr<const std::string>& get_binding_signature();
+
+    /// @brief Loads a previously compiled expression from the expression cache.
+    /// @param expression The expression to look up.
+    /// @returns @c true if the expression was found in the cache and loaded.
+    [[nodiscard]]
+    bool load_cached_expression(const std::string_view expression);
+
+    /** @brief Resets the results from the previous parse and loads @c expression
+            (without its comments) into the parser.
+        @param expression The expression to load.
+        @returns @c false if the expression is empty or has an unterminated comment.
+        @throws std::runtime_error Throws an exception if the list and
+            decimal separators are the same.*/
+    [[nodiscard]]
+    bool prepare_expression(const std::string_view expression);
+
+    /// @brief Compiles a batch of expressions.
+    /// @param expressions The expressions.
+    /// @param expressionCount The number of expressions.
+    /// @param threadCount The number of threads to use.
+    /// @param registry If not null, the expressions are compiled into programs
+    ///     and added to this.
+    /// @returns The results of compiling each expression.
+    std::vector<compile_result> compile_many(const std::string_view* expressions,
+                                             const size_t expressionCount, size_t threadCount,
+                                             te_program_registry* registry = nullptr);
+
+    /// @brief Makes a program from the compiled expression.
+    /// @param takeCompiledExpression Whether the program can take the compiled expression
+    ///     (instead of copying it), leaving the parser without one. (It is still copied
+    ///     if it is shared with a cache.)
+    /// @returns The program.
+    [[nodiscard]]
+    std::shared_ptr<te_program> make_program(const bool takeCompiledExpression);
+
+    /// @brief Calls the unknown-symbol resolver.
+    /// @details If this is a worker in compile_many(), then the calls are serialized
+    ///     and a symbol that another worker resolved is not resolved again.
+    /// @param name The unknown symbol.
+    /// @returns The value that the resolver returned for the symbol.
+    [[nodiscard]]
+    te_type resolve_unknown_symbol(const std::string_view name);
+
+    /// @returns The symbols in @c expressions that aren't variables or functions
+    ///     (without any duplicates).
+    /// @param expressions The expressions to scan (comments are skipped).
+    /// @param expressionCount The number of expressions.
+    [[nodiscard]]
+    std::set<std::string, te_string_less> find_unknown_symbols(const std::string_view* expressions,
+                                                              const size_t expressionCount) const;
+
+    /** @brief Compiles an expression with symbols that compile_async() resolved.
+        @param expression The formula to compile.
+        @param names The symbols that were resolved.
+        @param values The symbols' values.
+        @param resolverError The error from the resolver (if it failed).
+        @returns Whether the expression compiled.*/
+    bool compile_resolved(const std::string_view expression,
+                          const std::vector<std::string_view>& names,
+                          const std::vector<te_type>& values, const std::string& resolverError);
+
+    /** @brief Finds all of the unknown symbols in @c expressions and resolves them with
+            one call to a batch resolver (if one is being used), before they are parsed.
+        @details The symbols that are resolved are added as variables, and all of the
+            symbols are remembered so that the resolver isn't asked about them again
+            while the expressions are parsed.
+        @param expressions The expressions to scan.
+        @param expressionCount The number of expressions.
+        @throws std::runtime_error If the resolver returns the wrong number of values.*/
+    void resolve_unknown_symbols(const std::string_view* expressions,
+                                 const size_t expressionCount);
+
+    /// @brief Fills an array with random numbers between 0 and 1.
+    /// @param values The values to fill.
+    /// @param valueCount The number of values.
+    static void fill_random(te_type* values, const size_t valueCount);
+
+    /// @brief Rebinds all the variables in the compiled expression.
+    /// @param addresses The variables' new addresses.
+    /// @param addressCount The number of addresses.
+    void rebind_all(const te_type* const* addresses, const size_t addressCount);
+
+    /// @brief Copies the compiled expression if it is shared with a cache
+    ///     (or another parser), so that it can be edited.
+    void make_compiled_expression_unique();
+
+    /// @brief Runs an optimization pass and adds it to the optimization report.
+    /// @param name The name of the pass.
+    /// @param pass The pass, which returns whether it changed the expression.
+    template<typename Pass>
+    void run_optimization_pass(std::string name, const Pass& pass)
+        {
+        const auto start = std::chrono::steady_clock::now();
+        const bool changed = pass();
+        m_optimizationReport.push_back(optimization_pass{
+            std::move(name), changed,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                 start) });
+        }
+
+    /// @returns The total of the simplification counts.
+    [[nodiscard]]
+    size_t get_simplification_count() const noexcept
+        {
+        size_t total{ 0 };
+        for (const auto& [rule, count] : m_simplificationCounts)
+            {
+            total += count;
+            }
+        return total;
+        }
+
+    /// @returns The index of the variable in m_variableSlots (or no_index if the compiled
+    ///     expression doesn't use it).
+    [[nodiscard]]
+    size_t find_variable_slot(const std::string_view name) const;
+
+    /// @brief Evaluates the compiled expression, only recalculating the parts of it
+    ///     that have been marked as dirty.
+    [[nodiscard]]
+    te_type evaluate_incrementally();
+    /// @brief Sets up the tracked nodes for the compiled expression.
+    void build_dirty_tracking();
+    /// @returns The tracked node's value, evaluating it again if it is dirty.
+    [[nodiscard]]
+    te_type evaluate_tracked(const size_t index);
+    /// @brief Marks a tracked node (and the nodes that it is in) as dirty.
+    void mark_tracked_node_dirty(size_t index) noexcept;
+
+    /// @brief Regroups the chains of additions and multiplications in an optimized expression
+    ///     and combines their constants.
+    /// @param texp The expression to regroup.
+    /// @returns The regrouped expression.
+    [[nodiscard]]
+    te_expr* reassociate(te_expr* texp);
+
+    /// @brief Applies the algebraic simplifications to an optimized expression.
+    /// @param texp The expression to simplify.
+    /// @param variableSlots The variables' nodes (any that are removed are taken out of these).
+    /// @returns The simplified expression (which may be one of @c texp's parameters).
+    [[nodiscard]]
+    te_expr* simplify(te_expr* texp, std::vector<variable_slot>& variableSlots);
+
+    /// @brief Moves the pure subexpressions that appear more than once in the compiled
+    ///     expression into m_commonSubexpressions.
+    void eliminate_common_subexpressions();
+
+    /// @brief Evaluates the compiled expression (and its common subexpressions).
+    [[nodiscard]]
+    te_type evaluate_compiled_expression();
+
+    /// @brief Records that @c node is bound to the variable @c name.
+    static void add_variable_slot(std::vector<variable_slot>& slots,
+                                  const te_variable::name_type& name, te_expr* node);
+
+    /// @brief Copies an expression tree.
+    /// @param texp The tree to copy.
+    /// @param copiedNodes Where to record each copied node's original.
+    /// @returns The copy.
+    [[nodiscard]]
+    static te_expr* te_copy(const te_expr* texp,
+                            std::unordered_map<const te_expr*, te_expr*>& copiedNodes);
+
+    /// @brief Clears the information used for incremental compilation.
+    void reset_incremental_state()
+        {
+        m_reparseUnits.clear();
+        m_nodeLinks.clear();
+#ifndef TE_NO_BOOKKEEPING
+        m_symbolReferences.clear();
+        m_symbolUseCounts.clear();
+#endif
+        }
+
+    /// @brief After a successful compile(), records where each node in the compiled expression is
+    ///     and removes the reparse units that were optimized away.
+    void start_incremental_tracking();
+
+    /// @brief Attempts to only parse the part of the expression affected by an edit.
+    /// @param offset The start of the edit.
+    /// @param length The number of characters replaced.
+    /// @param replacementLength The number of characters inserted.
+    /// @param expression The edited expression.
+    /// @returns @c false if the entire expression needs to be compiled again.
+    [[nodiscard]]
+    bool recompile_incrementally(const size_t offset, const size_t length,
+                                 const size_t replacementLength, std::string& expression);
+
+    /// @brief Records where @c texp and its parameters are in the compiled expression.
+    void track_subtree(te_expr* texp, te_expr* parent, const size_t index);
+
+    /// @brief Removes @c texp and its parameters from the compiled expression's node links.
+    void untrack_subtree(const te_expr* texp);
 
-  private:
     /// @brief Resets any resolved variables from USR if not being cached.
     void reset_usr_resolved_if_necessary()
         {
@@ -627,14 +1994,14 @@ class te_parser
     [[nodiscard]]
     const te_expr* get_compiled_expression() const noexcept
         {
-        return m_compiledExpression;
+        return m_compiledExpression.get();
         }
 
     /// @private
     [[nodiscard]]
     const te_expr* get_compiled_expression() const volatile noexcept
         {
-        return m_compiledExpression;
+        return const_cast<const te_parser*>(this)->m_compiledExpression.get();
         }
 
     /// @brief Validates that a variable only contains legal characters
@@ -998,12 +2365,24 @@ class te_parser
 
         const char* m_start{ nullptr };
         const char* m_next{ nullptr };
+        // the start of the current token
+        const char* m_tokenStart{ nullptr };
         token_type m_type{ token_type::TOK_NULL };
         te_variable_flags m_varType{ TE_DEFAULT };
         te_variant_type m_value;
         te_expr* context{ nullptr };
 
         std::set<te_variable>& m_lookup;
+
+        // where to record function arguments, parenthesized groups, and the symbols used
+        // (only used for incremental compilation)
+        std::vector<reparse_unit>* m_reparseUnits{ nullptr };
+        std::vector<symbol_reference>* m_symbolReferences{ nullptr };
+        // where to record the nodes bound to variables
+        std::vector<variable_slot>* m_variableSlots{ nullptr };
+
+        // only check the syntax, don't build any nodes
+        bool m_validateOnly{ false };
         };
 
     [[nodiscard]]
@@ -1031,6 +2410,23 @@ class te_parser
         return ret;
         }
 
+    /// @returns A new node, or @c nullptr if the expression is only being validated.
+    [[nodiscard]]
+    inline static te_expr* new_expr(const state* theState, const te_variable_flags type,
+                                    te_variant_type value,
+                                    const std::initializer_list<te_expr*>& parameters)
+        {
+        return theState->m_validateOnly ? nullptr : new_expr(type, std::move(value), parameters);
+        }
+
+    /// @returns A new node, or @c nullptr if the expression is only being validated.
+    [[nodiscard]]
+    inline static te_expr* new_expr(const state* theState, const te_variable_flags type,
+                                    te_variant_type value)
+        {
+        return theState->m_validateOnly ? nullptr : new_expr(type, std::move(value));
+        }
+
     [[nodiscard]]
     constexpr static bool is_letter(const char ch) noexcept
         {
@@ -1044,9 +2440,78 @@ class te_parser
         @returns null on error.*/
     [[nodiscard]]
     te_expr* te_compile(const std::string_view expression, std::set<te_variable>& variables);
+    /** @brief Checks the syntax of an expression without building it.
+        @param expression The formula to check.
+        @param variables The collection of custom functions and
+            variables to add to the parser.
+        @returns @c true if the expression is valid.*/
+    [[nodiscard]]
+    bool te_validate(const std::string_view expression, std::set<te_variable>& variables);
     /* Evaluates the expression. */
     [[nodiscard]]
     static te_type te_eval(const te_expr* texp);
+    /* Evaluates a node, where M(i) returns the value of its i-th parameter. */
+    template<typename Evaluate>
+    [[nodiscard]]
+    static te_type te_eval_node(const te_expr* texp, const Evaluate& M);
+    /* Evaluates an AND or OR node, only evaluating the arguments needed to get the result. */
+    template<typename Evaluate>
+    [[nodiscard]]
+    static te_type te_eval_short_circuit(const te_expr* texp, const Evaluate& M);
+    /// @returns @c true if @c value is a built-in function (e.g., if() or and())
+    ///     whose arguments after the first are only evaluated when needed.
+    [[nodiscard]]
+    static bool is_short_circuit(const te_variant_type& value);
+
+    /// @brief The bitwise operations that te_eval_integer() evaluates.
+    enum class integer_operation
+        {
+        none,
+        bitwise_and,
+        bitwise_or,
+        bitwise_xor,
+        left_shift,
+        right_shift,
+        left_shift_or_right,
+        right_shift_or_left,
+        left_rotate,
+        right_rotate,
+        left_rotate8,
+        right_rotate8,
+        left_rotate16,
+        right_rotate16,
+        left_rotate32,
+        right_rotate32,
+        left_rotate64,
+        right_rotate64,
+        bitwise_not,
+        bitwise_not8,
+        bitwise_not16,
+        bitwise_not32,
+        bitwise_not64
+        };
+
+    /// @returns The bitwise operation that @c texp is, or integer_operation::none.
+    [[nodiscard]]
+    static integer_operation get_integer_operation(const te_expr* texp);
+    /* Evaluates a bitwise operation, keeping the results of its operands that are
+       bitwise operations as integers. */
+    [[nodiscard]]
+    static uint64_t te_eval_integer(const te_expr* texp, const integer_operation operation);
+    template<typename T>
+    [[nodiscard]]
+    static uint64_t te_eval_integer_operation(const integer_operation operation, const T val);
+    template<typename T1, typename T2>
+    [[nodiscard]]
+    static uint64_t te_eval_integer_operation(const integer_operation operation, const T1 val1,
+                                              const T2 val2);
+    /// @brief Marks the bitwise operations that have bitwise operations as operands
+    ///     to be evaluated with integers.
+    /// @param texp The expression to search.
+    /// @param inSubtree Whether @c texp is an operand of a bitwise operation that is
+    ///     already marked.
+    /// @returns @c true if any operations were marked.
+    static bool evaluate_integer_subtrees(te_expr* texp, const bool inSubtree = false);
 
     /* Frees the expression. */
     /* This is safe to call on null pointers. */
@@ -1061,7 +2526,33 @@ class te_parser
         }
 
     static void te_free_parameters(te_expr* texp);
-    static void optimize(te_expr* texp);
+
+    /// @returns A relative estimate of how long an expression takes to evaluate.
+    /// @details Each node costs one, and each function call costs a few more.
+    [[nodiscard]]
+    static size_t estimate_cost(const te_expr* texp);
+
+    /// @returns The number of parameters owned by @c texp
+    ///     (i.e., not counting a closure's context).
+    [[nodiscard]]
+    static size_t get_owned_parameter_count(const te_expr* texp)
+        {
+        if (is_closure(texp->m_value))
+            {
+            return texp->m_parameters.size() - 1;
+            }
+        return is_function(texp->m_value) ? texp->m_parameters.size() : 0;
+        }
+    /// @brief Evaluates the parts of an expression that only use constants and pure functions.
+    /// @returns @c true if anything was evaluated.
+    static bool optimize(te_expr* texp);
+    /** @brief Records how many arguments a variadic function was called with.
+        @details The unused parameters are removed from the node (so that they are passed
+            as NaN without being evaluated), and built-in functions such as sum() are
+            replaced with versions that take that many arguments.
+        @param texp The function's node.
+        @param argumentCount The number of arguments passed to the function.*/
+    static void specialize_variadic(te_expr* texp, const size_t argumentCount);
 
     [[nodiscard]]
     static auto find_builtin(const std::string_view name)
@@ -1077,6 +2568,15 @@ class te_parser
                                              static_cast<te_type>(0.0), TE_DEFAULT, nullptr });
         }
 
+    /// @returns The variable or function in the symbols shared by compile_many(),
+    ///     or @c m_sharedSymbols->cend() if it isn't there.
+    [[nodiscard]]
+    auto find_shared_lookup(const std::string_view name) const
+        {
+        return m_sharedSymbols->find(te_variable{ te_variable::name_type{ name },
+                                                  static_cast<te_type>(0.0), TE_DEFAULT, nullptr });
+        }
+
     void next_token(state* theState);
     [[nodiscard]]
     te_expr* base(state* theState);
@@ -1108,10 +2608,53 @@ class te_parser
     te_expr* list(state* theState);
 
     std::string m_expression;
-    te_expr* m_compiledExpression{ nullptr };
+    std::shared_ptr<te_expr> m_compiledExpression;
+    // the nodes bound to each variable, in the order that they first appear
+    std::vector<variable_slot> m_variableSlots;
+    // whether rebind() changed any of the variables' addresses
+    bool m_variablesRebound{ false };
+    bool m_commonSubexpressionElimination{ false };
+    simplification m_simplification{ simplification::ieee_safe };
+    reassociation m_reassociation{ reassociation::none };
+    bool m_constantFolding{ true };
+    bool m_integerEvaluation{ true };
+    optimization_level m_optimizationLevel{ optimization_level::basic };
+    std::vector<optimization_pass> m_optimizationReport;
+    std::map<std::string, size_t, std::less<>> m_simplificationCounts;
+    std::shared_ptr<common_subexpressions> m_commonSubexpressions;
+    bool m_incrementalEvaluation{ false };
+    // empty until the compiled expression is evaluated incrementally
+    dirty_tracking m_dirtyTracking;
+
+    std::map<std::string, cached_expression, std::less<>> m_expressionCache;
+    // the cached expressions, from the most-recently used to the least
+    std::list<std::string> m_expressionCacheOrder;
+    size_t m_expressionCacheSize{ 32 };
+    // bumped whenever the variables, functions, or separators change
+    uint64_t m_symbolTableVersion{ 0 };
+    uint64_t m_expressionCacheVersion{ 0 };
+
+    std::shared_ptr<te_formula_cache> m_formulaCache;
+
+    bool m_incrementalCompilation{ false };
+    // the symbol table version when the tracked expression was compiled
+    uint64_t m_incrementalVersion{ 0 };
+    std::vector<reparse_unit> m_reparseUnits;
+    std::unordered_map<const te_expr*, node_link> m_nodeLinks;
+#ifndef TE_NO_BOOKKEEPING
+    // sorted by position
+    std::vector<symbol_reference> m_symbolReferences;
+    std::map<te_variable::name_type, size_t, te_string_less> m_symbolUseCounts;
+#endif
+    std::shared_ptr<const std::string> m_bindingSignature;
+    uint64_t m_bindingSignatureHash{ 0 };
+    uint64_t m_bindingSignatureVersion{ std::numeric_limits<uint64_t>::max() };
 
     std::set<te_variable>::const_iterator m_currentVar;
     bool m_varFound{ false };
+    // symbols that have already been looked up (only used by compile_many())
+    bool m_cacheSymbolLookups{ false };
+    std::unordered_map<std::string, std::set<te_variable>::const_iterator> m_symbolLookups;
 #ifndef TE_NO_BOOKKEEPING
     std::set<te_variable::name_type, te_string_less> m_usedFunctions;
     std::set<te_variable::name_type, te_string_less> m_usedVars;
@@ -1122,8 +2665,25 @@ class te_parser
 
     te_usr_variant_type m_unknownSymbolResolve{ te_usr_noop{} };
     std::set<te_variable::name_type> m_resolvedVariables;
+    // the symbols that the batch resolver has already been asked about
+    std::set<std::string, te_string_less> m_batchRequestedSymbols;
     bool m_keepResolvedVarialbes{ true };
 
+    /// @brief The symbols that compile_many() resolves, shared by its workers.
+    struct shared_resolutions
+        {
+        // serializes the calls to the resolver
+        std::mutex m_mutex;
+        std::map<std::string, te_type, te_string_less> m_values;
+        // the symbols that the batch resolver has already been asked about
+        std::set<std::string, te_string_less> m_batchRequestedSymbols;
+        };
+
+    // the workers in compile_many() look up the parser's variables and functions here
+    // (instead of copying them), and only store the symbols that they resolved themselves
+    const std::set<te_variable>* m_sharedSymbols{ nullptr };
+    shared_resolutions* m_sharedResolutions{ nullptr };
+
     bool m_parseSuccess{ false };
     int64_t m_errorPos{ 0 };
     std::string m_lastErrorMessage;
@@ -1132,4 +2692,669 @@ class te_parser
     char m_listSeparator{ ',' };
     };
 
+/** @brief A thread-safe, size-bounded cache of compiled expressions that
+        can be shared between parsers.
+    @details When more formulas are added than the cache can hold,
+        the least-recently used ones are removed.
+    @par Example:
+    @code
+    auto cache = std::make_shared<te_formula_cache>(10'000);
+
+    // parsers connected to the same cache (and with the same variables)
+    // will only compile a given formula once
+    te_parser tep;
+    tep.set_formula_cache(cache);
+    @endcode*/
+class te_formula_cache
+    {
+  public:
+    /// @brief Constructor.
+    /// @param capacity The maximum number of compiled expressions to store.
+    explicit te_formula_cache(const size_t capacity = 1024) : m_capacity(capacity) {}
+
+    /// @private
+    te_formula_cache(const te_formula_cache&) = delete;
+    /// @private
+    te_formula_cache& operator=(const te_formula_cache&) = delete;
+
+    /// @brief Sets the maximum number of compiled expressions to store.
+    /// @param capacity The number of expressions.
+    /// @note If the cache is larger than this, then the least-recently used expressions
+    ///     are removed (and counted as evictions).
+    void set_capacity(const size_t capacity);
+
+    /// @returns The maximum number of compiled expressions stored.
+    [[nodiscard]]
+    size_t get_capacity() const;
+
+    /// @returns The number of compiled expressions currently stored.
+    [[nodiscard]]
+    size_t size() const;
+
+    /// @brief Removes all compiled expressions (statistics are not reset).
+    void clear();
+
+    /// @returns The number of times that a parser found an expression in the cache.
+    [[nodiscard]]
+    uint64_t get_hits() const noexcept
+        {
+        return m_hits;
+        }
+
+    /// @returns The number of times that a parser did not find an expression
+    ///     in the cache (and had to compile it).
+    [[nodiscard]]
+    uint64_t get_misses() const noexcept
+        {
+        return m_misses;
+        }
+
+    /// @returns The number of expressions that were removed to make room for others.
+    [[nodiscard]]
+    uint64_t get_evictions() const noexcept
+        {
+        return m_evictions;
+        }
+
+    /// @brief Resets the hit, miss, and eviction counts.
+    void reset_statistics() noexcept
+        {
+        m_hits = 0;
+        m_misses = 0;
+        m_evictions = 0;
+        }
+
+  private:
+    friend class te_parser;
+    using formula_type = std::shared_ptr<const te_parser::compiled_formula>;
+    using bindings_type = std::shared_ptr<const std::string>;
+
+    /// @brief A compiled expression and the bindings that it was compiled with.
+    struct entry
+        {
+        std::string m_key;
+        bindings_type m_bindings;
+        formula_type m_formula;
+        };
+
+    using entry_list = std::list<entry>;
+
+    /// @returns The compiled expression stored under @c key, or @c nullptr if not found
+    ///     (or if it was compiled with different bindings).
+    /// @param key The expression's key.
+    /// @param bindings The bindings of the parser looking up the expression
+    ///     (see te_parser::get_binding_signature()).
+    [[nodiscard]]
+    formula_type find(const std::string& key, const std::string& bindings);
+
+    /// @brief Stores a compiled expression.
+    /// @param key The expression's key.
+    /// @param bindings The bindings that it was compiled with.
+    /// @param formula The compiled expression.
+    void insert(std::string key, bindings_type bindings, formula_type formula);
+
+    /// @brief Removes the least-recently used items until there is room for @c capacity items.
+    /// @note The caller must be holding the mutex.
+    void trim(const size_t capacity);
+
+    mutable std::mutex m_mutex;
+    // most-recently used at the front
+    entry_list m_entries;
+    std::unordered_map<std::string_view, entry_list::iterator> m_lookup;
+    size_t m_capacity{ 1024 };
+
+    std::atomic<uint64_t> m_hits{ 0 };
+    std::atomic<uint64_t> m_misses{ 0 };
+    std::atomic<uint64_t> m_evictions{ 0 };
+    };
+
+/** @brief An immutable compiled expression, which can be evaluated from any number of
+        threads at once.
+    @details Programs are created with te_parser::compile_program(). Unlike te_parser::evaluate(),
+        evaluating a program does not store anything, so it does not need to be locked
+        (as long as the values of its variables aren't being changed at the same time).\n
+        The variables' values can also be passed to evaluate() for each call, which lets one
+        program evaluate different data on each thread without rebinding anything.
+    @par Example:
+    @code
+    te_type x{ 3 };
+    te_parser tep;
+    tep.set_variables_and_functions({ { "x", &x } });
+    const auto program = tep.compile_program("x^2 + 1");
+
+    // from any thread
+    const auto result = program->evaluate();
+    if (result.m_success)
+        {
+        std::cout << result.m_value;
+        }
+    else
+        {
+        std::cout << result.m_errorMessage;
+        }
+
+    // with x = 5 (from the slot of x in the values)
+    const auto rowResult = program->evaluate(std::vector<te_type>{ 5 });
+    @endcode*/
+class te_program
+    {
+  public:
+    /// @brief The result of evaluating a program.
+    struct evaluation_result
+        {
+        /// @brief The result, or NaN if there was an error.
+        te_type m_value{ te_parser::te_nan };
+        /// @brief @c false if an error was thrown while evaluating the program.
+        bool m_success{ true };
+        /// @brief The error message (empty if there was no error).
+        std::string m_errorMessage;
+        };
+
+    /// @private
+    te_program(const te_program&) = delete;
+    /// @private
+    te_program& operator=(const te_program&) = delete;
+
+    /// @brief An invalid variable slot.
+    constexpr static size_t npos = std::numeric_limits<size_t>::max();
+
+    /// @returns The result of the program, using the values of the variables that
+    ///     it was compiled with.
+    /// @note This is re-entrant and safe to call from multiple threads at once.
+    [[nodiscard]]
+    evaluation_result evaluate() const
+        {
+        return evaluate_with(nullptr);
+        }
+
+    /** @brief Evaluates the program with the variables' values read from @c values
+            instead of the variables that it was compiled with.
+        @details Because nothing is rebound, one program can be evaluated against
+            different data (e.g., a row of a table) from any number of threads at once.
+        @param values The variables' values, in the order that get_bound_variable_names()
+            returns them (i.e., the value of the variable in slot @c i is at @c values[i]).
+        @returns The result of the program. If the number of values does not match the
+            number of variables, then the result is an error.
+        @note This is re-entrant and safe to call from multiple threads at once.
+        @sa get_variable_slot().*/
+    [[nodiscard]]
+    evaluation_result evaluate(const std::vector<te_type>& values) const
+        {
+        return evaluate(values.data(), values.size());
+        }
+
+#ifdef __cpp_lib_span
+    /// @copydoc evaluate(const std::vector<te_type>&) const
+    [[nodiscard]]
+    evaluation_result evaluate(const std::span<const te_type> values) const
+        {
+        return evaluate(values.data(), values.size());
+        }
+#endif
+
+    /// @brief How evaluate_rows() splits its rows between threads.
+    struct batch_options
+        {
+        /// @brief The number of threads to evaluate the rows with
+        ///     (including the calling thread).
+        size_t m_threadCount{ 1 };
+        /// @brief The number of rows that a thread evaluates at a time, or @c 0 to fit
+        ///     a chunk's values and results into 64 KiB (which fits most L2 caches).
+        size_t m_rowsPerChunk{ 0 };
+        /// @brief Whether to pin each thread to its own core while the rows are evaluated
+        ///     (only supported on Linux; ignored elsewhere).
+        bool m_pinThreads{ false };
+        };
+
+    /// @brief The result of evaluate_rows().
+    struct batch_result
+        {
+        /// @brief The number of rows that failed (whose results are NaN).
+        size_t m_failedRows{ 0 };
+        /// @brief The first row that failed, or @c npos if none did.
+        size_t m_firstFailedRow{ npos };
+        /// @brief The error from the first row that failed.
+        std::string m_errorMessage;
+        };
+
+    /** @brief Evaluates the program for each row of a table, in parallel.
+        @details The rows are split into chunks, which are divided evenly between the threads.
+            A thread that runs out of chunks takes the last chunks from the other threads
+            (i.e., work stealing), so that threads that are slowed down do not hold up the rest.\n
+            Each row's result is written to its own index in @c results, so the results
+            (and the returned batch_result) are the same for any number of threads.
+        @param rows The variables' values for each row, one row after another
+            (each row is in the order that get_bound_variable_names() returns the variables).
+        @param[out] results The results of each row. This is resized to the number of rows
+            (but if the program has no variables, then its size is used as the number of rows).
+        @param options How the rows are split between threads.
+        @returns The number of rows that failed, and the first one's error.
+        @throws std::runtime_error Throws an exception if the number of values in @c rows is
+            not a multiple of the number of variables.*/
+    batch_result evaluate_rows(const std::vector<te_type>& rows, std::vector<te_type>& results,
+                               const batch_options& options) const
+        {
+        if (!m_variableNames.empty())
+            {
+            results.resize(rows.size() / m_variableNames.size());
+            }
+        return evaluate_rows(rows.data(), rows.size(), results.data(), results.size(), options);
+        }
+
+    /// @brief Evaluates the program for each row of a table on the calling thread.
+    /// @copydetails evaluate_rows(const std::vector<te_type>&, std::vector<te_type>&,
+    ///     const batch_options&) const
+    batch_result evaluate_rows(const std::vector<te_type>& rows,
+                               std::vector<te_type>& results) const
+        {
+        return evaluate_rows(rows, results, batch_options{});
+        }
+
+#ifdef __cpp_lib_span
+    /** @copydoc evaluate_rows(const std::vector<te_type>&, std::vector<te_type>&,
+            const batch_options&) const
+        @throws std::runtime_error Throws an exception if @c results does not have
+            a value for each row.*/
+    batch_result evaluate_rows(const std::span<const te_type> rows,
+                               const std::span<te_type> results,
+                               const batch_options& options) const
+        {
+        return evaluate_rows(rows.data(), rows.size(), results.data(), results.size(), options);
+        }
+
+    /// @private
+    batch_result evaluate_rows(const std::span<const te_type> rows,
+                               const std::span<te_type> results) const
+        {
+        return evaluate_rows(rows, results, batch_options{});
+        }
+#endif
+
+    /// @returns The expression that the program was compiled from.
+    [[nodiscard]]
+    const std::string& get_expression() const noexcept
+        {
+        return m_expression;
+        }
+
+    /// @returns The variables that the program is bound to,
+    ///     in the order that they first appear in it.
+    [[nodiscard]]
+    const std::vector<std::string>& get_bound_variable_names() const noexcept
+        {
+        return m_variableNames;
+        }
+
+    /// @returns A relative estimate of how long the program takes to evaluate
+    ///     (based on the number of nodes and function calls in the compiled expression).
+    [[nodiscard]]
+    size_t get_estimated_cost() const noexcept
+        {
+        return m_estimatedCost;
+        }
+
+    /// @returns The slot of a variable (i.e., its index in the values passed to evaluate()),
+    ///     or @c npos if the program doesn't use the variable.
+    /// @param name The name of the variable (not case sensitive).
+    [[nodiscard]]
+    size_t get_variable_slot(const std::string_view name) const noexcept;
+
+  private:
+    friend class te_parser;
+
+    te_program() = default;
+
+    [[nodiscard]]
+    evaluation_result evaluate(const te_type* values, const size_t valueCount) const;
+    batch_result evaluate_rows(const te_type* rows, const size_t valueCount, te_type* results,
+                               const size_t resultCount, const batch_options& options) const;
+    /// @brief Sets the values of the common subexpressions and variables for the
+    ///     evaluations on the current thread.
+    class values_scope;
+    /// @brief Pins the current thread to a core (if requested) while it is in scope.
+    class thread_pinning;
+    /// @returns The result of the program, using the current thread's values.
+    [[nodiscard]]
+    te_type evaluate_current(te_type* subexpressionValues) const;
+    /// @brief Evaluates the program, reading the variables from @c variableValues
+    ///     (or their bound addresses if it is null).
+    [[nodiscard]]
+    evaluation_result evaluate_with(const te_type* variableValues) const;
+
+    /// @brief The context of a node that reads a variable, which is read from the
+    ///     evaluation's values (if it has any) instead of the bound address.
+    class variable_reference : public te_expr
+        {
+      public:
+        variable_reference(const size_t slot, const te_type* address) noexcept
+            : m_slot(slot), m_address(address)
+            {
+            }
+
+        size_t m_slot{ 0 };
+        const te_type* m_address{ nullptr };
+        };
+
+    /// @returns The value of a variable in the current evaluation.
+    [[nodiscard]]
+    static te_type read_variable(const te_expr* context);
+
+    /// @brief The context of a node that reads the result of a common subexpression,
+    ///     which is stored separately for each evaluation.
+    class subexpression_reference : public te_expr
+        {
+      public:
+        explicit subexpression_reference(const size_t index) noexcept : m_index(index) {}
+
+        size_t m_index{ 0 };
+        };
+
+    /// @returns The result of a common subexpression in the current evaluation.
+    [[nodiscard]]
+    static te_type read_subexpression(const te_expr* context);
+
+    std::string m_expression;
+    std::shared_ptr<te_expr> m_compiledExpression;
+    // evaluated (in order) before the compiled expression
+    std::vector<std::shared_ptr<te_expr>> m_subexpressions;
+    std::vector<std::unique_ptr<subexpression_reference>> m_subexpressionReferences;
+    std::vector<std::unique_ptr<variable_reference>> m_variableReferences;
+    std::vector<std::string> m_variableNames;
+    size_t m_estimatedCost{ 0 };
+
+    // the results of the common subexpressions for the evaluation running on this thread
+    static thread_local const te_type* m_currentSubexpressionValues;
+    // the variables' values for the evaluation running on this thread
+    // (null if the variables are read from their bound addresses)
+    static thread_local const te_type* m_currentVariableValues;
+    };
+
+/** @brief A thread-safe registry of programs, keyed by the expressions
+        that they were compiled from.
+    @details This is filled by te_parser::compile_programs(), which can compile
+        the expressions (e.g., all of the formulas in a workbook) on multiple threads.
+    @par Example:
+    @code
+    te_program_registry registry;
+    te_parser tep;
+    tep.set_variables_and_functions({ { "x", &x } });
+    const std::vector<std::string_view> formulas{ "x^2", "sqrt(x)", "x^2" };
+    tep.compile_programs(formulas, registry, std::thread::hardware_concurrency());
+
+    // can be called from any thread
+    const auto program = registry.find("sqrt(x)");
+    @endcode*/
+class te_program_registry
+    {
+  public:
+    te_program_registry() = default;
+    /// @private
+    te_program_registry(const te_program_registry&) = delete;
+    /// @private
+    te_program_registry& operator=(const te_program_registry&) = delete;
+
+    /// @returns The program compiled from @c expression, or null if it isn't registered.
+    /// @param expression The expression.
+    [[nodiscard]]
+    std::shared_ptr<const te_program> find(const std::string_view expression) const;
+
+    /** @brief Adds a program to the registry.
+        @param expression The expression that the program was compiled from.
+        @param program The program.
+        @returns @c false if a program was already registered for @c expression
+            (it is not replaced) or @c program is null.*/
+    bool insert(const std::string_view expression, std::shared_ptr<const te_program> program);
+
+    /// @returns The number of programs in the registry.
+    [[nodiscard]]
+    size_t size() const;
+
+    /// @brief Removes all of the programs.
+    void clear();
+
+  private:
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, std::shared_ptr<const te_program>> m_programs;
+    };
+
+/** @brief A program that can be replaced while other threads are evaluating it
+        (e.g., when a running service receives an updated formula).
+    @details Recompiling a te_parser while another thread is evaluating it frees the
+        expression that the other thread is reading. Instead, compile the new formula
+        into a program and publish() it here. Evaluations that start after that use the
+        new program, while evaluations that are already running finish with the old one,
+        which is destroyed when the last of them releases it.\n
+        Neither side waits for the other: publishing only swaps a pointer and never waits
+        for the readers to finish, and reading only takes a reference to whichever program
+        is current.
+    @par Example:
+    @code
+    te_parser tep;
+    tep.set_variables_and_functions({ { "x", &x } });
+    te_program_handle formula(tep.compile_program("x^2"));
+
+    // evaluator threads
+    const auto result = formula.evaluate();
+
+    // update thread (the parser is only used by this thread)
+    if (auto program = tep.compile_program("x^3"))
+        {
+        formula.publish(std::move(program));
+        }
+    @endcode*/
+class te_program_handle
+    {
+  public:
+    te_program_handle() = default;
+
+    /// @brief Constructor.
+    /// @param program The initial program (can be null).
+    explicit te_program_handle(std::shared_ptr<const te_program> program)
+        : m_program(std::move(program))
+        {
+        }
+
+    /// @private
+    te_program_handle(const te_program_handle&) = delete;
+    /// @private
+    te_program_handle& operator=(const te_program_handle&) = delete;
+
+    /** @returns The current program (or null if none has been published).
+        @details The program stays alive while the returned pointer is held, even if
+            another program is published in the meantime. To evaluate one version of a
+            program more than once (e.g., a batch of rows), hold onto this instead of
+            calling evaluate() for each one.
+        @note This is safe to call from multiple threads at once.*/
+    [[nodiscard]]
+    std::shared_ptr<const te_program> load() const;
+
+    /** @brief Replaces the program that new evaluations will use.
+        @param program The new program.
+        @returns The previous program.
+        @note This is safe to call while other threads are evaluating the handle.*/
+    std::shared_ptr<const te_program> publish(std::shared_ptr<const te_program> program);
+
+    /// @returns The number of programs that have been published.
+    [[nodiscard]]
+    uint64_t get_version() const noexcept
+        {
+        return m_version.load(std::memory_order_acquire);
+        }
+
+    /// @returns The result of the current program, using the values of the variables
+    ///     that it was compiled with. If no program has been published, then the
+    ///     result is an error.
+    /// @note This is safe to call from multiple threads at once.
+    [[nodiscard]]
+    te_program::evaluation_result evaluate() const;
+
+    /// @returns The result of the current program, with its variables' values read
+    ///     from @c values.
+    /// @param values The variables' values (see te_program::evaluate()).
+    /// @note This is safe to call from multiple threads at once.
+    [[nodiscard]]
+    te_program::evaluation_result evaluate(const std::vector<te_type>& values) const;
+
+  private:
+    [[nodiscard]]
+    static te_program::evaluation_result unpublished_result();
+
+#ifdef __cpp_lib_atomic_shared_ptr
+    std::atomic<std::shared_ptr<const te_program>> m_program;
+#else
+    // held only long enough to copy or swap the pointer
+    mutable std::mutex m_mutex;
+    std::shared_ptr<const te_program> m_program;
+#endif
+    std::atomic<uint64_t> m_version{ 0 };
+    };
+
+/** @brief A set of independent programs that are evaluated together (e.g., on each tick
+        of a simulation), spread across multiple threads.
+    @details The programs' costs can vary greatly, so splitting them evenly between
+        threads would leave most threads waiting for the one with the expensive programs.
+        Instead, the programs are ordered from the most expensive to the least (using
+        te_program::get_estimated_cost()) and split into blocks of about the same cost,
+        with the expensive programs in blocks of their own. Each thread takes the next block
+        when it finishes its last one, so the expensive programs are started first and the
+        cheap ones fill in the gaps at the end.
+    @par Example:
+    @code
+    te_type x{ 3 };
+    te_parser tep;
+    tep.set_variables_and_functions({ { "x", &x } });
+    te_formula_set formulas(std::thread::hardware_concurrency());
+    for (const std::string_view formula : { "x^2", "sqrt(x)", "sum(x, 2, 3, x^3)" })
+        {
+        formulas.add(tep.compile_program(formula));
+        }
+
+    // on each tick
+    const auto& tick = formulas.evaluate();
+    std::cout << tick.m_latency.count() << "ns\n";
+    for (size_t i = 0; i < formulas.size(); ++i)
+        {
+        std::cout << formulas.get_results()[i];
+        }
+    @endcode*/
+class te_formula_set
+    {
+  public:
+    /// @brief The timing and errors of a call to evaluate().
+    struct tick_report
+        {
+        /// @brief How long it took to evaluate all of the programs.
+        std::chrono::nanoseconds m_latency{ 0 };
+        /// @brief The number of programs that failed (whose results are NaN).
+        size_t m_failedPrograms{ 0 };
+        /// @brief The number of threads that the programs were evaluated with.
+        size_t m_threadCount{ 1 };
+        };
+
+    /// @brief Constructor.
+    /// @param threadCount The number of threads to evaluate the programs with
+    ///     (including the calling thread).
+    explicit te_formula_set(const size_t threadCount = 1) : m_threadCount(threadCount) {}
+
+    /// @private
+    te_formula_set(const te_formula_set&) = delete;
+    /// @private
+    te_formula_set& operator=(const te_formula_set&) = delete;
+
+    /** @brief Adds a program to the set.
+        @param program The program.
+        @returns The program's index (which is its index in get_results()).
+        @throws std::runtime_error Throws an exception if @c program is null
+            (i.e., it failed to compile).*/
+    size_t add(std::shared_ptr<const te_program> program);
+
+    /// @returns The number of programs in the set.
+    [[nodiscard]]
+    size_t size() const noexcept
+        {
+        return m_programs.size();
+        }
+
+    /// @brief Sets the number of threads to evaluate the programs with.
+    /// @param threadCount The number of threads (including the calling thread).
+    void set_thread_count(const size_t threadCount) noexcept { m_threadCount = threadCount; }
+
+    /// @returns The number of threads to evaluate the programs with.
+    [[nodiscard]]
+    size_t get_thread_count() const noexcept
+        {
+        return m_threadCount;
+        }
+
+    /** @brief Evaluates all of the programs.
+        @returns The tick's latency and the number of programs that failed.
+        @note The set itself is not thread safe, so this should only be called
+            from one thread at a time.*/
+    const tick_report& evaluate();
+
+    /// @returns The results from the last call to evaluate(), in the order that the
+    ///     programs were added (NaN for the programs that failed).
+    [[nodiscard]]
+    const std::vector<te_type>& get_results() const noexcept
+        {
+        return m_results;
+        }
+
+    /// @returns The indices of the programs that failed in the last call to evaluate()
+    ///     (in order).
+    [[nodiscard]]
+    const std::vector<size_t>& get_failed_programs() const noexcept
+        {
+        return m_failedPrograms;
+        }
+
+    /// @returns The report from the last call to evaluate().
+    [[nodiscard]]
+    const tick_report& get_last_tick() const noexcept
+        {
+        return m_lastTick;
+        }
+
+    /// @returns The number of times that evaluate() has been called.
+    [[nodiscard]]
+    size_t get_tick_count() const noexcept
+        {
+        return m_tickCount;
+        }
+
+    /// @returns The longest latency of all of the calls to evaluate().
+    [[nodiscard]]
+    std::chrono::nanoseconds get_max_latency() const noexcept
+        {
+        return m_maxLatency;
+        }
+
+    /// @returns The average latency of all of the calls to evaluate().
+    [[nodiscard]]
+    std::chrono::nanoseconds get_mean_latency() const noexcept
+        {
+        return (m_tickCount == 0) ? std::chrono::nanoseconds{ 0 } :
+                                    m_totalLatency / static_cast<int64_t>(m_tickCount);
+        }
+
+  private:
+    /// @brief Orders the programs by cost and splits them into blocks for the threads.
+    void schedule();
+
+    std::vector<std::shared_ptr<const te_program>> m_programs;
+    size_t m_threadCount{ 1 };
+    // the programs' indices, from the most expensive to the least
+    std::vector<size_t> m_order;
+    // where each block of programs (in m_order) ends
+    std::vector<size_t> m_blockEnds;
+    bool m_scheduled{ false };
+
+    std::vector<te_type> m_results;
+    std::vector<size_t> m_failedPrograms;
+    tick_report m_lastTick;
+    size_t m_tickCount{ 0 };
+    std::chrono::nanoseconds m_maxLatency{ 0 };
+    std::chrono::nanoseconds m_totalLatency{ 0 };
+    };
+
 #endif // __TINYEXPR_PLUS_PLUS_H__